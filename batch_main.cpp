@@ -0,0 +1,631 @@
+#include <QCoreApplication>    // Event-loop-free application object (no window, no GUI)
+#include <QCommandLineParser>  // Parses the command line options
+#include <QElapsedTimer>       // Measures how long the run took in real time
+#include <QFile>               // Output file for the summary
+#include <QJsonArray>          // JSON summary
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>         // Text output to the console or a file
+#include "simulation.h"        // The headless simulation
+#include "metrics.h"           // Summary of the run
+#include "sweep.h"             // Parallel parameter sweep
+#include "scenariofile.h"      // Scenario files
+#include "network.h"           // City grid of intersections
+#include "recorder.h"          // Trajectory recording
+#include "trajectory.h"        // Trajectory reading, for the CSV export
+#include "telemetry.h"         // Hot-path counters and timings
+#include "soak.h"              // Long runs with memory checks
+
+// Parses a duration such as "3600", "90s", "45m", "24h" or "7d" into seconds.
+static bool parseDuration(const QString &text, double *seconds)
+{
+    QString number = text.trimmed();
+    double unit = 1;
+    if (number.endsWith('s')) {
+        number.chop(1);
+    } else if (number.endsWith('m')) {
+        unit = 60;
+        number.chop(1);
+    } else if (number.endsWith('h')) {
+        unit = 3600;
+        number.chop(1);
+    } else if (number.endsWith('d')) {
+        unit = 86400;
+        number.chop(1);
+    }
+    bool ok = false;
+    double value = number.toDouble(&ok);
+    if (!ok || value < 0)
+        return false;
+    *seconds = value * unit;
+    return true;
+}
+
+// Parses a comma-separated list of numbers; an empty text gives `fallback`.
+static bool parseList(const QString &text, double fallback, std::vector<double> *values)
+{
+    values->clear();
+    if (text.isEmpty()) {
+        values->push_back(fallback);
+        return true;
+    }
+    for (const QString &item : text.split(',', Qt::SkipEmptyParts)) {
+        bool ok = false;
+        double value = item.trimmed().toDouble(&ok);
+        if (!ok)
+            return false;
+        values->push_back(value);
+    }
+    return !values->empty();
+}
+
+// Parses a comma-separated list of signal controls such as "fixed,actuated,max-pressure".
+static bool parseControls(const QString &text, std::vector<SignalControl> *controls)
+{
+    controls->clear();
+    for (const QString &item : text.split(',', Qt::SkipEmptyParts)) {
+        SignalControl control;
+        if (!parseSignalControl(item.trimmed().toStdString(), &control))
+            return false;
+        controls->push_back(control);
+    }
+    return !controls->empty();
+}
+
+// Parses a size such as "16x16" into columns and rows.
+static bool parseSize(const QString &text, int *columns, int *rows)
+{
+    const QStringList parts = text.split('x');
+    if (parts.size() != 2)
+        return false;
+    bool okColumns = false, okRows = false;
+    *columns = parts[0].trimmed().toInt(&okColumns);
+    *rows = parts[1].trimmed().toInt(&okRows);
+    return okColumns && okRows && *columns > 0 && *rows > 0;
+}
+
+// Run of `results` with the same timing, demand and seed as `point` under fixed-time control, or nullptr.
+static const SweepResult *fixedTimeTwin(const std::vector<SweepResult> &results, const SweepPoint &point)
+{
+    for (const SweepResult &result : results) {
+        const SweepPoint &other = result.point;
+        if (other.control == SignalControl::FixedTime && other.cycleMs == point.cycleMs && other.split == point.split
+            && other.arrivalScale == point.arrivalScale && other.seed == point.seed)
+            return &result;
+    }
+    return nullptr;
+}
+
+// Name of a trajectory event in the CSV export.
+static const char *eventName(TrajectoryEventKind kind)
+{
+    switch (kind) {
+    case TrajectoryEventKind::Spawn:
+        return "spawn";
+    case TrajectoryEventKind::Stop:
+        return "stop";
+    case TrajectoryEventKind::Cross:
+        return "cross";
+    case TrajectoryEventKind::Despawn:
+        return "despawn";
+    case TrajectoryEventKind::Turn:
+        return "turn";
+    case TrajectoryEventKind::LightChange:
+        break;
+    }
+    return "light";
+}
+
+// Converts a trajectory file to CSV, chunk by chunk: one row per event, then one per car of the
+// frame. Light events give the light index as id and its new state; car rows give their state.
+// The file is memory-mapped, so only the chunk being converted is paged in.
+static bool exportCsv(const QString &path, QIODevice *output, QString *error)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = QString("cannot open %1: %2").arg(path, file.errorString());
+        return false;
+    }
+    const uchar *data = file.size() > 0 ? file.map(0, file.size()) : nullptr;
+    if (!data) {
+        *error = QString("cannot map %1").arg(path);
+        return false;
+    }
+    TrajectoryReader reader(data, std::size_t(file.size()));
+    if (!reader.isValid()) {
+        *error = QString("%1: %2").arg(path, QString::fromStdString(reader.error()));
+        return false;
+    }
+
+    QTextStream out(output);
+    out << "time_ms,record,id,lane,x,y,state\n";
+    for (int c = 0; c < int(reader.chunks().size()); ++c) {
+        const bool ok = reader.readChunk(c, [&out](const TrajectoryFrame &frame) {
+            for (const TrajectoryEvent &event : frame.events) {
+                out << event.timeMs << ',' << eventName(event.kind) << ',' << event.id << ',';
+                if (event.kind == TrajectoryEventKind::LightChange)
+                    out << ",,," << (event.lane ? "green" : "red") << '\n';
+                else
+                    out << event.lane << ",,,\n";
+            }
+            for (const TrajectoryCar &car : frame.cars) {
+                out << frame.timeMs << ",car," << car.id << ',' << car.lane << ',' << QString::number(car.x, 'f', 3)
+                    << ',' << QString::number(car.y, 'f', 3) << ','
+                    << (car.state == VehiclePool::Stopped ? "stopped" : "driving") << '\n';
+            }
+        });
+        if (!ok) {
+            *error = QString("%1: %2").arg(path, QString::fromStdString(reader.error()));
+            return false;
+        }
+    }
+    out.flush();
+    return true;
+}
+
+// Results of a sweep as CSV, one row per run. Runs of other controllers are compared with the
+// fixed-time run on the same arrivals: delay_vs_fixed is the change of the mean delay in percent.
+static QByteArray sweepCsv(const std::vector<SweepResult> &results)
+{
+    QString text;
+    QTextStream out(&text);
+    out << "cycle_s,split,arrival_scale,control,seed,cars,cars_per_hour,mean_delay_s,p95_delay_s,max_delay_s,"
+           "max_queue,conflicts,delay_vs_fixed\n";
+    for (const SweepResult &result : results) {
+        const ApproachSummary &total = result.summary.total;
+        out << result.point.cycleMs / 1000.0 << ',' << result.point.split << ',' << result.point.arrivalScale << ','
+            << signalControlName(result.point.control) << ',' << result.point.seed << ',' << total.throughput << ','
+            << QString::number(total.perHour, 'f', 1) << ',' << QString::number(total.meanDelay, 'f', 3) << ','
+            << QString::number(total.p95Delay, 'f', 3) << ',' << QString::number(total.maxDelay, 'f', 3) << ','
+            << total.maxQueue << ',' << result.summary.conflicts << ',';
+        const SweepResult *fixed = fixedTimeTwin(results, result.point);
+        if (fixed && fixed->summary.total.meanDelay > 0)
+            out << QString::number((total.meanDelay / fixed->summary.total.meanDelay - 1) * 100, 'f', 1);
+        out << '\n';
+    }
+    return text.toUtf8();
+}
+
+// Mean delay of each controller over all of its runs, against fixed-time, as a short table.
+static QString controlComparison(const std::vector<SweepResult> &results)
+{
+    QString text;
+    QTextStream out(&text);
+    double fixedDelay = -1;
+    for (SignalControl control : {SignalControl::FixedTime, SignalControl::Actuated, SignalControl::MaxPressure}) {
+        double sum = 0;
+        int runs = 0;
+        for (const SweepResult &result : results) {
+            if (result.point.control == control) {
+                sum += result.summary.total.meanDelay;
+                ++runs;
+            }
+        }
+        if (runs == 0)
+            continue;
+        const double delay = sum / runs;
+        out << qSetFieldWidth(14) << Qt::left << signalControlName(control) << qSetFieldWidth(0)
+            << "mean delay " << QString::number(delay, 'f', 2) << " s over " << runs << " runs";
+        if (control == SignalControl::FixedTime)
+            fixedDelay = delay;
+        else if (fixedDelay > 0)
+            out << " (" << QString::number((delay / fixedDelay - 1) * 100, 'f', 1) << "% vs fixed)";
+        out << "\n";
+    }
+    return text;
+}
+
+// One summary row as a JSON object.
+static QJsonObject approachJson(const ApproachSummary &row)
+{
+    QJsonObject object;
+    object["name"] = QString::fromStdString(row.name);
+    object["throughput"] = double(row.throughput);
+    object["throughputPerHour"] = row.perHour;
+    object["meanDelay"] = row.meanDelay;
+    object["p95Delay"] = row.p95Delay;
+    object["maxDelay"] = row.maxDelay;
+    object["maxQueue"] = row.maxQueue;
+    return object;
+}
+
+// The whole summary as a JSON document.
+static QByteArray summaryJson(const RunSummary &summary, quint64 seed, double wallSeconds)
+{
+    QJsonObject object;
+    object["seed"] = QString::number(seed);
+    object["simulatedSeconds"] = summary.simulatedSeconds;
+    object["wallSeconds"] = wallSeconds;
+    object["spawned"] = double(summary.spawned);
+    object["despawned"] = double(summary.despawned);
+    object["dropped"] = double(summary.dropped);
+    object["conflicts"] = double(summary.conflicts);
+    QJsonArray approaches;
+    for (const ApproachSummary &row : summary.approaches)
+        approaches.append(approachJson(row));
+    object["approaches"] = approaches;
+    object["total"] = approachJson(summary.total);
+    return QJsonDocument(object).toJson(QJsonDocument::Indented);
+}
+
+// The whole summary as a text table.
+static QString summaryText(const RunSummary &summary, quint64 seed, double wallSeconds)
+{
+    QString text;
+    QTextStream out(&text);
+    out << "seed " << seed << ", simulated " << summary.simulatedSeconds << " s in " << wallSeconds << " s ("
+        << (wallSeconds > 0 ? summary.simulatedSeconds / wallSeconds : 0) << "x real time)\n";
+    out << "spawned " << summary.spawned << ", despawned " << summary.despawned << ", dropped " << summary.dropped
+        << ", conflicts " << summary.conflicts << "\n\n";
+    out << qSetFieldWidth(10) << Qt::left << "approach" << Qt::right << "cars" << "cars/h" << "mean(s)"
+        << "p95(s)" << "max(s)" << "maxQueue" << qSetFieldWidth(0) << "\n";
+    QList<ApproachSummary> rows(summary.approaches.begin(), summary.approaches.end());
+    rows.append(summary.total);
+    for (const ApproachSummary &row : rows) {
+        out << qSetFieldWidth(10) << Qt::left << QString::fromStdString(row.name) << Qt::right
+            << row.throughput << QString::number(row.perHour, 'f', 1) << QString::number(row.meanDelay, 'f', 2)
+            << QString::number(row.p95Delay, 'f', 2) << QString::number(row.maxDelay, 'f', 2) << row.maxQueue
+            << qSetFieldWidth(0) << "\n";
+    }
+    return text;
+}
+
+// Batch runner: simulates a scenario for a given simulated duration as fast as the CPU allows
+// and writes throughput, delay and queue metrics. No window is created.
+// With --cycles, --splits or --rates it sweeps signal timings and demand instead and writes
+// one CSV row per run; with several --controls it compares each signal controller with fixed-time.
+// With --network it simulates a grid of intersections on several threads.
+// A single run can stream every car and event to a trajectory file with --record, and
+// --export-csv turns such a file into CSV. --save-state keeps the final state of a single run
+// and --load-state starts a single run or every run of a sweep from such a state.
+// --soak runs a single simulation for a long time (e.g. -d 14d), reports its cars and memory
+// periodically and fails if resident memory keeps growing once the road has filled.
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("carros_batch");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs the traffic simulation without a window, faster than real time.");
+    parser.addHelpOption();
+    QCommandLineOption scenarioOption({"s", "scenario"}, "Scenario to simulate: a scenario JSON file, or the built-in cross.", "scenario", "cross");
+    QCommandLineOption durationOption({"d", "duration"}, "Simulated duration, e.g. 3600, 90m, 24h, 7d.", "duration", "1h");
+    QCommandLineOption seedOption("seed", "Random seed.", "seed", "0");
+    QCommandLineOption outputOption({"o", "output"}, "Write the summary to this file instead of the console.", "file");
+    QCommandLineOption formatOption("format", "Summary format: text or json.", "format", "text");
+    QCommandLineOption cyclesOption("cycles", "Sweep: comma-separated cycle lengths in seconds.", "list");
+    QCommandLineOption splitsOption("splits", "Sweep: comma-separated shares of the cycle given to phase 0.", "list");
+    QCommandLineOption ratesOption("rates", "Sweep: comma-separated arrival rate multipliers.", "list");
+    QCommandLineOption controlOption("control", "Signal control of every junction: fixed, actuated or max-pressure "
+                                     "(default: as the scenario says).", "policy");
+    QCommandLineOption controlsOption("controls", "Sweep: comma-separated signal controls run on the same arrivals, "
+                                      "e.g. fixed,actuated,max-pressure (default: --control, or fixed).", "list");
+    QCommandLineOption replicationsOption("replications", "Sweep: seeds per combination, from --seed up.", "count", "1");
+    QCommandLineOption threadsOption({"j", "threads"}, "Sweep and network: worker threads (0 = all cores).", "count", "0");
+    QCommandLineOption networkOption("network", "Simulate a city grid of this many intersections, e.g. 16x16, "
+                                     "instead of the scenario.", "size");
+    QCommandLineOption regionsOption("regions", "Network: regions the grid is cut into, e.g. 4x4.", "size", "4x4");
+    QCommandLineOption greenWaveOption("green-wave", "Network: light offset per intersection along the diagonal, in ms.",
+                                       "ms", "0");
+    QCommandLineOption recordOption("record", "Single run: stream cars and events to this trajectory file.", "file");
+    QCommandLineOption recordEveryOption("record-every", "Single run: record every this many steps of 20 ms.",
+                                         "steps", "1");
+    QCommandLineOption exportOption("export-csv", "Convert this trajectory file to CSV (to --output or the console) "
+                                    "and exit.", "file");
+    QCommandLineOption telemetryOption("telemetry", "Count steps, spawns and allocations and time every step, then write "
+                                       "the totals to this file at exit (- for the console).", "file");
+    QCommandLineOption saveStateOption("save-state", "Single run: save the final simulation state to this file.", "file");
+    QCommandLineOption loadStateOption("load-state", "Single run or sweep: start from this saved state instead of an "
+                                       "empty road; only what follows it is measured. A --seed other than the "
+                                       "state's draws new arrivals.", "file");
+    QCommandLineOption soakOption("soak", "Single run: report cars and memory every --report-every and fail (exit "
+                                  "code 2) if resident memory grows past the baseline of the warm-up.");
+    QCommandLineOption reportEveryOption("report-every", "Soak: simulated time between reports.", "duration", "1h");
+    QCommandLineOption warmupOption("warmup", "Soak: reports before the memory baseline is taken.", "count", "2");
+    QCommandLineOption toleranceOption("rss-tolerance", "Soak: resident memory growth allowed over the baseline, in MiB.",
+                                       "MiB", "16");
+    QCommandLineOption vehicleLimitOption("vehicle-limit", "Single run and soak: drop arrivals beyond this many cars "
+                                          "on the road and waiting to enter it (0 = no limit). A soak defaults to the "
+                                          "capacity of the car pool.", "count", "0");
+    parser.addOptions({soakOption, reportEveryOption, warmupOption, toleranceOption, vehicleLimitOption,
+                       saveStateOption, loadStateOption, telemetryOption, recordOption, recordEveryOption, exportOption, scenarioOption, durationOption, seedOption, outputOption, formatOption,
+                       cyclesOption, splitsOption, ratesOption, controlOption, controlsOption,
+                       replicationsOption, threadsOption,
+                       networkOption, regionsOption, greenWaveOption});
+    parser.process(app);
+
+    QTextStream err(stderr);
+    Telemetry::setEnabled(parser.isSet(telemetryOption));
+
+    if (parser.isSet(exportOption)) {
+        // Streamed straight to the output: a long recording gives far more CSV than fits in memory
+        QFile output;
+        bool opened = false;
+        if (parser.isSet(outputOption)) {
+            output.setFileName(parser.value(outputOption));
+            opened = output.open(QIODevice::WriteOnly | QIODevice::Truncate);
+        } else {
+            opened = output.open(stdout, QIODevice::WriteOnly);
+        }
+        if (!opened) {
+            err << "Cannot write " << output.fileName() << ": " << output.errorString() << "\n";
+            return 1;
+        }
+        QString error;
+        if (!exportCsv(parser.value(exportOption), &output, &error)) {
+            err << "Cannot export: " << error << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    double seconds = 0;
+    if (!parseDuration(parser.value(durationOption), &seconds)) {
+        err << "Invalid duration: " << parser.value(durationOption) << "\n";
+        return 1;
+    }
+    bool ok = false;
+    quint64 seed = parser.value(seedOption).toULongLong(&ok);
+    if (!ok) {
+        err << "Invalid seed: " << parser.value(seedOption) << "\n";
+        return 1;
+    }
+    const QString format = parser.value(formatOption);
+    if (format != "text" && format != "json") {
+        err << "Invalid format: " << format << "\n";
+        return 1;
+    }
+
+    // Layout of every simulation of this run; a file is parsed once and its tables copied into the setup
+    ParameterSweep::Setup setup;
+    if (parser.value(scenarioOption) == "cross") {
+        setup = [](Simulation &sim) { sim.loadDefaultCross(); };
+    } else {
+        Scenario scenario;
+        QString error;
+        if (!readScenarioFile(parser.value(scenarioOption), &scenario, &error)) {
+            err << "Invalid scenario: " << error << "\n";
+            return 1;
+        }
+        setup = [scenario](Simulation &sim) { scenario.apply(sim); };
+    }
+
+    // Saved state to start from, checked against the layout by whoever restores it
+    std::vector<std::uint8_t> initialState;
+    if (parser.isSet(loadStateOption)) {
+        QFile file(parser.value(loadStateOption));
+        if (!file.open(QIODevice::ReadOnly)) {
+            err << "Cannot read " << file.fileName() << ": " << file.errorString() << "\n";
+            return 1;
+        }
+        const QByteArray bytes = file.readAll();
+        initialState.assign(bytes.begin(), bytes.end());
+    }
+
+    // One policy for every junction, keeping the limits the layout gives
+    SignalControl control = SignalControl::FixedTime;
+    if (parser.isSet(controlOption)) {
+        if (!parseSignalControl(parser.value(controlOption).toStdString(), &control)) {
+            err << "Invalid control: " << parser.value(controlOption) << "\n";
+            return 1;
+        }
+        setup = [setup, control](Simulation &sim) {
+            setup(sim);
+            for (int j = 0; j < int(sim.junctions().size()); ++j)
+                sim.setSignalControl(j, control, sim.junctions()[j].timing);
+        };
+    }
+
+    QByteArray report;
+    if (parser.isSet(networkOption)) {
+        // Network mode: one grid cut into regions, simulated in lock step on the worker threads
+        NetworkConfig config;
+        if (!parseSize(parser.value(networkOption), &config.columns, &config.rows)
+            || !parseSize(parser.value(regionsOption), &config.regionColumns, &config.regionRows)) {
+            err << "Invalid network or region size\n";
+            return 1;
+        }
+        config.greenWaveMs = parser.value(greenWaveOption).toInt();
+        config.control = control;
+
+        RoadNetwork network(config, seed);
+        QElapsedTimer clock;
+        clock.start();
+        network.start();
+        network.run(qint64(seconds * 1000.0) / Simulation::TickMs, parser.value(threadsOption).toInt());
+        const double wallSeconds = clock.nsecsElapsed() / 1e9;
+        err << network.intersectionCount() << " intersections in " << network.regionCount() << " regions, "
+            << network.carsInNetwork() << " cars in the network at the end\n";
+
+        const RunSummary summary = summarize(network);
+        report = format == "json" ? summaryJson(summary, seed, wallSeconds)
+                                  : summaryText(summary, seed, wallSeconds).toUtf8();
+    } else if (parser.isSet(cyclesOption) || parser.isSet(splitsOption) || parser.isSet(ratesOption)
+               || parser.isSet(controlsOption)) {
+        // Sweep mode: one independent run per combination, spread over the cores
+        std::vector<double> cycles, splits, rates;
+        if (!parseList(parser.value(cyclesOption), 14, &cycles) || !parseList(parser.value(splitsOption), 0.5, &splits)
+            || !parseList(parser.value(ratesOption), 1, &rates)) {
+            err << "Invalid sweep list\n";
+            return 1;
+        }
+        for (double cycle : cycles) {
+            if (!(cycle > 0 && cycle <= 3600)) {
+                err << "Invalid cycle: " << cycle << " (must be above 0 and at most 3600 seconds)\n";
+                return 1;
+            }
+        }
+        for (double split : splits) {
+            if (!(split >= 0 && split <= 1)) {
+                err << "Invalid split: " << split << " (must be within [0, 1])\n";
+                return 1;
+            }
+        }
+        for (double rate : rates) {
+            if (!(rate >= ParameterSweep::MinArrivalScale && rate <= ParameterSweep::MaxArrivalScale)) {
+                err << "Invalid rate: " << rate << " (must be a multiplier within [0.001, 1000])\n";
+                return 1;
+            }
+        }
+        std::vector<SignalControl> controls;
+        const QString controlList = parser.isSet(controlsOption) ? parser.value(controlsOption)
+                                                                 : QString(signalControlName(control));
+        if (!parseControls(controlList, &controls)) {
+            err << "Invalid control list: " << controlList << "\n";
+            return 1;
+        }
+        std::vector<int> cyclesMs;
+        for (double cycle : cycles)
+            cyclesMs.push_back(int(cycle * 1000));
+        const int replications = qMax(1, parser.value(replicationsOption).toInt());
+
+        ParameterSweep sweep(setup, qint64(seconds * 1000.0));
+        std::string error;
+        if (parser.isSet(loadStateOption) && !sweep.setInitialState(initialState, &error)) {
+            err << "Cannot load state: " << QString::fromStdString(error) << "\n";
+            return 1;
+        }
+        std::vector<SweepPoint> points = ParameterSweep::grid(cyclesMs, splits, rates, controls, replications, seed);
+        for (const SweepPoint &point : points) {
+            if (!ParameterSweep::validPoint(point, &error)) {
+                err << "Invalid sweep point (cycle " << point.cycleMs / 1000.0 << " s): "
+                    << QString::fromStdString(error) << "\n";
+                return 1;
+            }
+        }
+        QElapsedTimer clock;
+        clock.start();
+        std::vector<SweepResult> results = sweep.run(points, parser.value(threadsOption).toInt());
+        err << results.size() << " runs in " << clock.nsecsElapsed() / 1e9 << " s\n";
+        if (controls.size() > 1)
+            err << controlComparison(results);
+        report = sweepCsv(results);
+    } else {
+        Simulation sim(seed);
+        setup(sim);
+        if (parser.isSet(loadStateOption)) {
+            std::string error;
+            if (!sim.restoreState(initialState.data(), initialState.size(), &error)) {
+                err << "Cannot load state: " << QString::fromStdString(error) << "\n";
+                return 1;
+            }
+            if (parser.isSet(seedOption) && sim.seed() != seed)
+                sim.reseed(seed);
+            sim.resetMeasurements();
+        }
+        const int vehicleLimit = parser.value(vehicleLimitOption).toInt();
+        if (parser.isSet(soakOption) && parser.isSet(vehicleLimitOption) && vehicleLimit <= 0) {
+            err << "A soak needs a vehicle limit above 0\n";
+            return 1;
+        }
+        sim.setVehicleLimit(vehicleLimit);
+
+        // The recorder encodes and writes on its own thread; this loop only hands it copies
+        TrajectoryRecorder recorder;
+        const bool recording = parser.isSet(recordOption);
+        if (recording && parser.isSet(soakOption)) {
+            err << "--record cannot be combined with --soak\n";
+            return 1;
+        }
+        const int recordEvery = qMax(1, parser.value(recordEveryOption).toInt());
+        if (recording && !recorder.open(parser.value(recordOption).toStdString(), sim)) {
+            err << "Cannot record: " << QString::fromStdString(recorder.error()) << "\n";
+            return 1;
+        }
+
+        // Run the whole duration in fixed steps, without any wall-clock pacing
+        QElapsedTimer clock;
+        clock.start();
+        if (!parser.isSet(loadStateOption))
+            sim.start();
+        if (parser.isSet(soakOption)) {
+            // Soak: the same steps in slices, with a report line after each
+            SoakConfig soak;
+            soak.durationMs = qint64(seconds * 1000.0) / Simulation::TickMs * Simulation::TickMs;
+            double reportEvery = 0;
+            if (!parseDuration(parser.value(reportEveryOption), &reportEvery)) {
+                err << "Invalid report interval: " << parser.value(reportEveryOption) << "\n";
+                return 1;
+            }
+            soak.reportEveryMs = qint64(reportEvery * 1000.0);
+            soak.warmupReports = qMax(0, parser.value(warmupOption).toInt());
+            soak.growthToleranceBytes = quint64(qMax(0.0, parser.value(toleranceOption).toDouble()) * 1024 * 1024);
+            const auto reportLine = [&err](const SoakSample &sample) {
+                err << "soak " << QString::number(sample.timeMs / 3600000.0, 'f', 1) << " h ("
+                    << QString::number(sample.wallSeconds, 'f', 0) << " s): " << sample.cars << " cars (peak "
+                    << sample.peakCars << "), " << sample.waiting << " waiting (limit " << sample.vehicleLimit
+                    << "), " << sample.capacity << " slots, " << sample.spawned << " spawned, " << sample.despawned
+                    << " despawned, " << sample.dropped << " dropped, " << QString::number(sample.allocationsPerStep, 'f', 2) << " allocs/step, rss "
+                    << (sample.residentBytes >> 20) << " MiB (peak " << (sample.peakResidentBytes >> 20) << " MiB";
+                if (sample.baselineBytes > 0)
+                    err << ", baseline " << (sample.baselineBytes >> 20) << " MiB";
+                err << ")\n";
+                err.flush();
+            };
+            std::string error;
+            if (!runSoak(sim, soak, reportLine, &error)) {
+                err << "SOAK FAILED: " << QString::fromStdString(error) << "\n";
+                return 2;
+            }
+            if (residentMemoryBytes() == 0)
+                err << "soak: resident memory unknown on this platform, growth not checked\n";
+        } else {
+            const qint64 steps = qint64(seconds * 1000.0) / Simulation::TickMs;
+            for (qint64 i = 0; i < steps; ++i) {
+                sim.step();
+                if (recording && (i + 1) % recordEvery == 0)
+                    recorder.record(sim);
+            }
+        }
+        if (recording) {
+            if (!recorder.close()) {
+                err << "Cannot record: " << QString::fromStdString(recorder.error()) << "\n";
+                return 1;
+            }
+            err << "recorded " << recorder.recordedFrames() << " frames, " << recorder.bytesWritten() << " bytes\n";
+        }
+        const double wallSeconds = clock.nsecsElapsed() / 1e9;
+
+        if (parser.isSet(saveStateOption)) {
+            std::vector<std::uint8_t> state;
+            sim.saveState(state);
+            QFile file(parser.value(saveStateOption));
+            if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+                || file.write(reinterpret_cast<const char *>(state.data()), qint64(state.size())) != qint64(state.size())) {
+                err << "Cannot write " << file.fileName() << ": " << file.errorString() << "\n";
+                return 1;
+            }
+        }
+
+        const RunSummary summary = summarize(sim);
+        report = format == "json" ? summaryJson(summary, sim.seed(), wallSeconds)
+                                  : summaryText(summary, sim.seed(), wallSeconds).toUtf8();
+    }
+
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            err << "Cannot write " << file.fileName() << ": " << file.errorString() << "\n";
+            return 1;
+        }
+        file.write(report);
+    } else {
+        QTextStream(stdout) << report;
+    }
+
+    // Every worker thread has ended by now, so the totals cover the whole run
+    if (parser.isSet(telemetryOption)) {
+        const QByteArray telemetry = QByteArray::fromStdString(Telemetry::report());
+        if (parser.value(telemetryOption) == "-") {
+            err << telemetry;
+        } else {
+            QFile file(parser.value(telemetryOption));
+            if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                err << "Cannot write " << file.fileName() << ": " << file.errorString() << "\n";
+                return 1;
+            }
+            file.write(telemetry);
+        }
+    }
+    return 0;
+}
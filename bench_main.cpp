@@ -0,0 +1,405 @@
+#include <QApplication>        // Needed by QGraphicsScene and pixmaps, even without a window
+#include <QCommandLineParser>  // Parses the command line options
+#include <QElapsedTimer>       // Times every benchmark
+#include <QFile>               // Output file for the results
+#include <QGraphicsObject>     // Base of the per-car items of the animation baseline
+#include <QGraphicsScene>      // Scenes rendered offscreen
+#include <QImage>              // Offscreen render target
+#include <QJsonArray>          // JSON results
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>            // Renders scenes into the image
+#include <QPropertyAnimation>  // The animation baseline
+#include <QTextStream>         // CSV results and progress on the console
+#include <algorithm>           // std::max
+#include <vector>              // Sizes and results
+#include "kinematics.h"        // The car update kernels, per instruction set
+#include "rng.h"               // Random slots and rectangles
+#include "scene.h"             // The application's scene, rendered as the GUI draws it
+#include "simsnapshot.h"       // Snapshots fed to the car layer
+#include "simulation.h"        // The simulation core
+#include "spatialgrid.h"       // The spatial index
+#include "spritecache.h"       // Car image of the animation baseline
+#include "vehiclepool.h"       // Spawn and despawn churn
+#include "vehiclelayer.h"      // The item drawing every car
+
+// Benchmarks of the simulation core and the renderer at growing car counts.
+//
+// Every benchmark repeats its operation until --min-time has passed and reports one row:
+//
+//   benchmark   what was measured (see the functions below)
+//   cars        cars in the simulation, index or scene
+//   iterations  repetitions timed
+//   ns_per_op   mean wall time of one repetition
+//   ns_per_car  ns_per_op / cars, which stays flat while a cost grows linearly
+//
+// as CSV (default) or JSON, so two runs can be compared row by row to catch regressions.
+
+// One result row.
+struct BenchResult
+{
+    QString benchmark;
+    qint64 cars;
+    qint64 iterations;
+    double nsPerOp;
+};
+
+// Repeats `body` until `minNs` have passed, at least once, and returns the count and mean time.
+template <typename Body>
+static BenchResult measure(const QString &benchmark, qint64 cars, qint64 minNs, Body &&body)
+{
+    QElapsedTimer clock;
+    qint64 iterations = 0;
+    clock.start();
+    do {
+        body();
+        ++iterations;
+    } while (clock.nsecsElapsed() < minNs);
+    return BenchResult{benchmark, cars, iterations, double(clock.nsecsElapsed()) / double(iterations)};
+}
+
+// Layout holding about `cars` cars in free flow, without lights: parallel lanes 1000 units long,
+// driven in 10 s, each receiving a car every second. Car following keeps them apart at that
+// spacing, so every car moves on every step. Stepping until the roads are full takes 10
+// simulated seconds, whatever the size.
+static const int BenchLaneCars = 10;     // Cars per lane once full
+static const double BenchLaneSpacing = 20;
+
+static void buildFreeFlow(Simulation &sim, qint64 cars)
+{
+    const int lanes = int(std::max<qint64>(1, (cars + BenchLaneCars - 1) / BenchLaneCars));
+    sim.setVehicleCapacity(int(cars) + 2 * lanes);
+    const int junction = sim.addJunction(1, 3600000);
+    const int approach = sim.addApproach(junction, "bench");
+    for (int l = 0; l < lanes; ++l) {
+        const double y = l * BenchLaneSpacing;
+        const int lane = sim.addLane(approach, 0, y, 1000, y, 10000, l % 4, 0.01, 90, 10);
+        sim.setSpriteSize(lane, 1024, 1024);
+    }
+    sim.setArrivalInterval(approach, 1000, 1001);
+    sim.setGridBounds(-100, -100, 1200, float(lanes * BenchLaneSpacing + 200), 64);
+}
+
+// Builds and fills a free-flow layout of `cars` cars.
+static void fillFreeFlow(Simulation &sim, qint64 cars)
+{
+    buildFreeFlow(sim, cars);
+    sim.start();
+    sim.advance(10000 + Simulation::TickMs);
+}
+
+// Results nothing else reads are stored here, so the compiler cannot drop the work producing them.
+static volatile qint64 benchSink;
+
+// Time of one Simulation::step() of a full free-flow layout, with every car moving. The roads
+// stay full, so the layout serves the following benchmarks as well.
+static BenchResult benchStep(Simulation &sim, qint64 minNs)
+{
+    return measure("step", sim.vehicles().size(), minNs, [&]() { sim.step(); });
+}
+
+// The car update kernel alone with instruction set `isa` (accelerations, then integration) over
+// a copy of the cars of a full free-flow layout. The copy is never reset: cars driving on past the
+// ends of their lanes cost the kernel the same, and the lane end handling is not part of it.
+static BenchResult benchKinematics(const Simulation &sim, KinematicsIsa isa, qint64 minNs)
+{
+    VehiclePool pool = sim.vehicles();
+    KinematicsLanes lanes;
+    lanes.update(sim.lanes(), sim.lights());
+    const CarFollowing &idm = sim.carFollowing();
+    const KinematicsParams params{idm.maxAccel, idm.comfortDecel, idm.maxDecel, idm.minGap, idm.headway,
+                                  Simulation::TickMs / 1000.0f, float(idm.stoppedSpeed)};
+    std::vector<std::uint8_t> flags(std::size_t(pool.capacity()));
+    return measure(QString("kinematics_") + kinematicsIsaName(isa), pool.size(), minNs, [&]() {
+        computeAccelerations(isa, pool, lanes, params, pool.highWater());
+        integrateCars(isa, pool, lanes, params, pool.highWater(), flags.data());
+    });
+}
+
+// One spawn and one despawn in a pool holding `cars` cars, at random slots, so the free list
+// keeps being reordered as a busy road reorders it.
+static BenchResult benchChurn(qint64 cars, qint64 minNs)
+{
+    VehiclePool pool(int(cars) + 1);
+    std::vector<int> slots;
+    for (qint64 i = 0; i < cars; ++i)
+        slots.push_back(pool.spawn(std::uint32_t(i), 0, 0, 1));
+    Rng rng(1);
+    std::uint32_t id = std::uint32_t(cars);
+    return measure("spawn_despawn", cars, minNs, [&]() {
+        const std::size_t k = std::size_t(rng.bounded(0, int(slots.size())));
+        pool.despawn(slots[k]);
+        slots[k] = pool.spawn(id++, 0, 0, 1);
+    });
+}
+
+// Rebuilding the spatial index over every car of a snapshot of a full free-flow layout, as
+// every step does.
+static BenchResult benchGridBuild(const Simulation &sim, const SimSnapshot &snapshot, qint64 minNs)
+{
+    SpatialGrid grid = sim.grid();
+    return measure("grid_build", snapshot.count(), minNs, [&]() {
+        grid.build(snapshot.minX.data(), snapshot.minY.data(), snapshot.maxX.data(), snapshot.maxY.data(),
+                   snapshot.live.data(), snapshot.count());
+    });
+}
+
+// Looking up the cars inside an 800x800 window at a random place of the same layout, as the
+// renderer culls a view at natural size.
+static BenchResult benchGridQuery(const Simulation &sim, const SimSnapshot &snapshot, qint64 minNs)
+{
+    const float height = float(sim.lanes().size() * BenchLaneSpacing);
+    Rng rng(2);
+    qint64 found = 0;
+    BenchResult result = measure("grid_query", snapshot.count(), minNs, [&]() {
+        const float y = float(rng.uniform()) * height - 400;
+        snapshot.grid.queryUnique(100, y, 900, y + 800, [&](int) { ++found; });
+    });
+    benchSink = found;
+    return result;
+}
+
+// Renders `scene` (area `source`) into an 800x800 image.
+static BenchResult benchRender(const QString &benchmark, qint64 cars, QGraphicsScene &scene, const QRectF &source,
+                               qint64 minNs)
+{
+    QImage image(800, 800, QImage::Format_ARGB32_Premultiplied);
+    return measure(benchmark, cars, minNs, [&]() {
+        image.fill(Qt::darkGray);
+        QPainter painter(&image);
+        scene.render(&painter, QRectF(image.rect()), source);
+    });
+}
+
+// The car layer of the application over a full free-flow layout, rendered at natural size (sprites)
+// and with the whole layout in view (dots or lane bars, depending on its size).
+static std::vector<BenchResult> benchLayerRender(const Simulation &sim, const SimSnapshot &snapshot, qint64 minNs)
+{
+    QGraphicsScene scene;
+    VehicleLayer *layer = new VehicleLayer(sim);
+    layer->setSnapshot(&snapshot, 0.5f);
+    scene.addItem(layer);
+    const QRectF all = layer->boundingRect();
+    const QRectF window(all.center().x() - 400, all.center().y() - 400, 800, 800);
+    std::vector<BenchResult> results;
+    results.push_back(benchRender("render_layer_window", snapshot.count(), scene, window, minNs));
+    results.push_back(benchRender("render_layer_all", snapshot.count(), scene, all, minNs));
+    layer->setSnapshot(nullptr, 1);
+    return results;
+}
+
+// The application's Scene on the original crossing, rendered as the main window shows it.
+static BenchResult benchSceneRender(qint64 minNs)
+{
+    Scene scene;
+    scene.setTimeScale(-1);
+    scene.start();
+    QElapsedTimer settle;
+    settle.start();
+    while (settle.elapsed() < 200)  // Lets the simulation thread put cars on the road
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 20);
+    QCoreApplication::processEvents();
+    return benchRender("render_scene_cross", scene.snapshot().count(), scene, QRectF(0, 0, 800, 800), minNs);
+}
+
+// One car of the original design: its own item, moved by its own QPropertyAnimation from one end
+// of its lane to the other in 2 s.
+class AnimatedCar : public QGraphicsObject
+{
+public:
+    AnimatedCar(const QPixmap &pixmap, qreal x0, qreal x1, qreal y)
+        : animation(this, "x")
+        , image(pixmap)
+    {
+        setPos(x0, y);
+        animation.setStartValue(x0);
+        animation.setEndValue(x1);
+        animation.setDuration(2000);
+        animation.setEasingCurve(QEasingCurve::Linear);
+    }
+
+    QRectF boundingRect() const override
+    {
+        return QRectF(image.rect());
+    }
+
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *, QWidget *) override
+    {
+        painter->drawPixmap(0, 0, image);
+    }
+
+    QPropertyAnimation animation;
+
+private:
+    QPixmap image;
+};
+
+// Baseline of the per-car item and animation design this project started from: one animation
+// tick (every animation moved to the same time, as the animation timer does each frame) and a
+// render, with `cars` items on the same lanes as the free-flow layout.
+static std::vector<BenchResult> benchAnimationBaseline(qint64 cars, qint64 minNs)
+{
+    const QPixmap pixmap = SpriteCache::instance().transformed(":/imagens/carro.png", 0.01, 90).pixmap;
+    QGraphicsScene scene;
+    std::vector<AnimatedCar *> items;
+    items.reserve(std::size_t(cars));
+    for (qint64 i = 0; i < cars; ++i) {
+        const qint64 lane = i / BenchLaneCars;
+        const qreal start = -qreal(i % BenchLaneCars) * 100;  // Spread along the lane like the free-flow cars
+        AnimatedCar *car = new AnimatedCar(pixmap, start, start + 1000, lane * BenchLaneSpacing);
+        scene.addItem(car);
+        items.push_back(car);
+    }
+
+    int timeMs = 0;
+    std::vector<BenchResult> results;
+    results.push_back(measure("baseline_animation_tick", cars, minNs, [&]() {
+        timeMs = (timeMs + Simulation::TickMs) % 2000;
+        for (AnimatedCar *car : items)
+            car->animation.setCurrentTime(timeMs);
+    }));
+    const QRectF all = scene.itemsBoundingRect();
+    const QRectF window(all.center().x() - 400, all.center().y() - 400, 800, 800);
+    results.push_back(benchRender("baseline_render_window", cars, scene, window, minNs));
+    results.push_back(benchRender("baseline_render_all", cars, scene, all, minNs));
+    return results;  // The scene deletes the items
+}
+
+// Parses a comma-separated list of car counts.
+static bool parseSizes(const QString &text, std::vector<qint64> *sizes)
+{
+    sizes->clear();
+    for (const QString &item : text.split(',', Qt::SkipEmptyParts)) {
+        bool ok = false;
+        const qint64 value = item.trimmed().toLongLong(&ok);
+        if (!ok || value <= 0)
+            return false;
+        sizes->push_back(value);
+    }
+    return !sizes->empty();
+}
+
+// CSV results, one row per benchmark and size.
+static QByteArray resultsCsv(const std::vector<BenchResult> &results)
+{
+    QString text;
+    QTextStream out(&text);
+    out << "benchmark,cars,iterations,ns_per_op,ns_per_car\n";
+    for (const BenchResult &r : results) {
+        out << r.benchmark << ',' << r.cars << ',' << r.iterations << ',' << QString::number(r.nsPerOp, 'f', 1) << ','
+            << QString::number(r.cars > 0 ? r.nsPerOp / double(r.cars) : 0.0, 'f', 3) << '\n';
+    }
+    out.flush();
+    return text.toUtf8();
+}
+
+// JSON results: the same rows as objects.
+static QByteArray resultsJson(const std::vector<BenchResult> &results)
+{
+    QJsonArray rows;
+    for (const BenchResult &r : results) {
+        QJsonObject row;
+        row["benchmark"] = r.benchmark;
+        row["cars"] = double(r.cars);
+        row["iterations"] = double(r.iterations);
+        row["ns_per_op"] = r.nsPerOp;
+        row["ns_per_car"] = r.cars > 0 ? r.nsPerOp / double(r.cars) : 0.0;
+        rows.append(row);
+    }
+    return QJsonDocument(QJsonObject{{"results", rows}}).toJson();
+}
+
+// Entry point of the benchmark runner.
+int main(int argc, char *argv[])
+{
+    QApplication app(argc, argv);
+    QCoreApplication::setApplicationName("carros_bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks of the traffic simulation and its renderer. Runs without a display "
+                                     "with QT_QPA_PLATFORM=offscreen.");
+    parser.addHelpOption();
+    QCommandLineOption sizesOption("sizes", "Comma-separated car counts.", "list", "100,1000,10000,100000,1000000");
+    QCommandLineOption baselineOption("baseline-max", "Largest car count of the QPropertyAnimation baseline, whose "
+                                      "items take about a kilobyte each.", "cars", "100000");
+    QCommandLineOption minTimeOption("min-time", "Minimum time spent repeating each benchmark, in ms.", "ms", "200");
+    QCommandLineOption filterOption("filter", "Only run the benchmarks whose name contains this text.", "text");
+    QCommandLineOption outputOption({"o", "output"}, "Write the results to this file instead of the console.", "file");
+    QCommandLineOption formatOption("format", "Results format: csv or json.", "format", "csv");
+    parser.addOptions({sizesOption, baselineOption, minTimeOption, filterOption, outputOption, formatOption});
+    parser.process(app);
+
+    QTextStream err(stderr);
+    std::vector<qint64> sizes;
+    if (!parseSizes(parser.value(sizesOption), &sizes)) {
+        err << "Invalid sizes: " << parser.value(sizesOption) << "\n";
+        return 1;
+    }
+    const QString format = parser.value(formatOption);
+    if (format != "csv" && format != "json") {
+        err << "Invalid format: " << format << "\n";
+        return 1;
+    }
+    const qint64 minNs = qMax(1, parser.value(minTimeOption).toInt()) * qint64(1000000);
+    const qint64 baselineMax = parser.value(baselineOption).toLongLong();
+    const QString filter = parser.value(filterOption);
+    auto selected = [&](const QString &name) { return filter.isEmpty() || name.contains(filter); };
+
+    std::vector<BenchResult> results;
+    auto add = [&](const BenchResult &result) {
+        err << result.benchmark << " " << result.cars << ": " << QString::number(result.nsPerOp / 1000.0, 'f', 2) << " us\n";
+        err.flush();
+        results.push_back(result);
+    };
+
+    for (qint64 cars : sizes) {
+        // One full layout per size: filling a million cars takes far longer than measuring them
+        if (selected("step") || selected("kinematics") || selected("grid_build") || selected("grid_query")
+            || selected("render_layer")) {
+            Simulation sim(1);
+            fillFreeFlow(sim, cars);
+            if (selected("step"))
+                add(benchStep(sim, minNs));
+            for (KinematicsIsa isa : {KinematicsIsa::Scalar, KinematicsIsa::Avx2}) {
+                if (selected(QString("kinematics_") + kinematicsIsaName(isa)) && kinematicsIsaSupported(isa))
+                    add(benchKinematics(sim, isa, minNs));
+            }
+
+            // Snapshot of the last two steps, as the renderer receives them
+            SimSnapshot snapshot;
+            SimPositions previous;
+            previous.capture(sim);
+            sim.step();
+            snapshot.capture(sim, previous);
+            if (selected("grid_build"))
+                add(benchGridBuild(sim, snapshot, minNs));
+            if (selected("grid_query"))
+                add(benchGridQuery(sim, snapshot, minNs));
+            if (selected("render_layer")) {
+                for (const BenchResult &result : benchLayerRender(sim, snapshot, minNs))
+                    add(result);
+            }
+        }
+        if (selected("spawn_despawn"))
+            add(benchChurn(cars, minNs));
+        if (selected("baseline") && cars <= baselineMax) {
+            for (const BenchResult &result : benchAnimationBaseline(cars, minNs))
+                add(result);
+        }
+    }
+    if (selected("render_scene"))
+        add(benchSceneRender(minNs));
+
+    const QByteArray report = format == "json" ? resultsJson(results) : resultsCsv(results);
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            err << "Cannot write " << file.fileName() << ": " << file.errorString() << "\n";
+            return 1;
+        }
+        file.write(report);
+    } else {
+        QTextStream(stdout) << report;
+    }
+    return 0;
+}
@@ -9,17 +9,28 @@ CONFIG += c++17
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
-    carro.cpp \
+    frameexport.cpp \
     main.cpp \
     mainwindow.cpp \
+    metricsoverlay.cpp \
     scene.cpp \
-    semaforo.cpp
+    scenariofile.cpp \
+    semaforo.cpp \
+    spritecache.cpp \
+    vehiclelayer.cpp
 
 HEADERS += \
-    carro.h \
+    frameexport.h \
     mainwindow.h \
+    metricsoverlay.h \
     scene.h \
-    semaforo.h
+    scenariofile.h \
+    semaforo.h \
+    spritecache.h \
+    vehiclelayer.h
+
+# Simulation core, shared with carros_batch.pro
+include(simcore.pri)
 
 FORMS += \
     mainwindow.ui
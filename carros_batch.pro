@@ -0,0 +1,22 @@
+QT       += core
+QT       -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = carros_batch
+
+# Simulation core, shared with carros.pro
+include(simcore.pri)
+
+SOURCES += \
+    batch_main.cpp \
+    scenariofile.cpp
+
+HEADERS += \
+    scenariofile.h
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
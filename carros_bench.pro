@@ -0,0 +1,28 @@
+QT       += core gui widgets
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = carros_bench
+
+# Simulation core, shared with carros.pro
+include(simcore.pri)
+
+# The renderer of the application, benchmarked offscreen
+SOURCES += \
+    bench_main.cpp \
+    scene.cpp \
+    scenariofile.cpp \
+    semaforo.cpp \
+    spritecache.cpp \
+    vehiclelayer.cpp
+
+HEADERS += \
+    scene.h \
+    scenariofile.h \
+    semaforo.h \
+    spritecache.h \
+    vehiclelayer.h
+
+RESOURCES += \
+    resource.qrc
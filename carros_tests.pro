@@ -0,0 +1,10 @@
+CONFIG += c++17 console
+CONFIG -= app_bundle qt
+
+TARGET = carros_tests
+
+# Simulation core, shared with carros.pro
+include(simcore.pri)
+
+SOURCES += \
+    tests_main.cpp
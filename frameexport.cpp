@@ -0,0 +1,295 @@
+#include "frameexport.h"          // Header file for the FrameExporter class
+#include "replay.h"               // Frames of a recording
+#include "scene.h"                // Renders the frames as the main window shows them
+#include "simsnapshot.h"          // What the producer hands to the renderer
+#include "spritecache.h"          // Picture of the original crossing
+#include <QCoreApplication>       // Events of the scene between frames
+#include <QDir>                   // Output directory
+#include <QFile>                  // Raw video output and the recording
+#include <QImage>                 // Offscreen render target
+#include <QPainter>               // Renders the scene into the image
+#include <algorithm>              // std::min
+#include <atomic>                 // Write failure, seen by the other threads
+#include <cmath>                  // std::floor
+#include <condition_variable>     // Waits of the queues
+#include <deque>                  // Slots waiting in a queue
+#include <memory>                 // The recording's player
+#include <mutex>
+#include <thread>                 // Producer and writer threads
+#include <vector>                 // Recycled snapshots and images
+
+// Slot numbers handed from one thread to another, oldest first. The slots themselves live in
+// an array both threads share, and a slot belongs to the thread that popped its number last. A
+// pair of queues (free slots one way, filled slots the other) bounds how far a thread can run
+// ahead to the size of the array.
+class SlotQueue
+{
+public:
+    SlotQueue() : m_closed(false) {}
+
+    // Hands `slot` to the other side.
+    void push(int slot)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_slots.push_back(slot);
+        }
+        m_ready.notify_one();
+    }
+
+    // Waits for a slot; -1 once the queue is closed and empty.
+    int pop()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_ready.wait(lock, [this] { return !m_slots.empty() || m_closed; });
+        if (m_slots.empty())
+            return -1;
+        const int slot = m_slots.front();
+        m_slots.pop_front();
+        return slot;
+    }
+
+    // No more slots will come: pop() returns -1 after the remaining ones.
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_ready.notify_all();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_ready;
+    std::deque<int> m_slots;
+    bool m_closed;
+};
+
+// A snapshot to render, with its interpolation factor.
+struct ExportSnapshot
+{
+    SimSnapshot snapshot;
+    float alpha;
+};
+
+// A rendered frame and its number.
+struct ExportImage
+{
+    QImage image;
+    int index;
+};
+
+// 30 frames per second of the whole layout at 800x800, with a few frames of slack per stage.
+FrameExportOptions::FrameExportOptions()
+    : fps(30)
+    , durationS(-1)
+    , size(800, 800)
+    , queueFrames(8)
+{
+}
+
+// Nothing runs before run().
+FrameExporter::FrameExporter(const QString &layout, const FrameExportOptions &options)
+    : m_layout(layout)
+    , m_options(options)
+    , m_frames(0)
+{
+}
+
+// The producer and the writer are started here and joined before returning, whatever happens.
+bool FrameExporter::run()
+{
+    m_frames = 0;
+    if (m_options.fps <= 0 || m_options.size.isEmpty() || m_options.queueFrames <= 0) {
+        m_error = "Invalid frame rate, size or queue length";
+        return false;
+    }
+
+    // Frame source: the recording, mapped for the producer, or a simulation of its own
+    const bool recording = m_layout.endsWith(".trj");
+    QFile recordingFile(m_layout);
+    std::unique_ptr<TrajectoryReplay> replay;
+    Simulation sim;
+    std::int64_t startMs = 0;
+    double durationS = m_options.durationS < 0 ? 60 : m_options.durationS;
+    if (recording) {
+        const uchar *data = nullptr;
+        if (recordingFile.open(QIODevice::ReadOnly))
+            data = recordingFile.map(0, recordingFile.size());
+        if (!data) {
+            m_error = "Cannot map " + m_layout + ": " + recordingFile.errorString();
+            return false;
+        }
+        replay.reset(new TrajectoryReplay(data, std::size_t(recordingFile.size())));
+        if (!replay->isValid()) {
+            m_error = "Cannot play " + m_layout + ": " + QString::fromStdString(replay->error());
+            return false;
+        }
+        startMs = replay->startMs();
+        const double recordedS = double(replay->endMs() - startMs) / 1000;
+        durationS = m_options.durationS < 0 ? recordedS : std::min(durationS, recordedS);
+    } else {
+        sim = Scene::buildSimulation(m_layout);
+        sim.start();
+        startMs = sim.timeMs();
+    }
+    const int frameCount = int(std::floor(durationS * m_options.fps));
+
+    // Output: numbered images in a directory, or one raw stream
+    const bool raw = m_options.output == "-" || m_options.output.endsWith(".rgb");
+    const QString streamName = m_options.output == "-" ? QString("stdout") : m_options.output;
+    QFile stream;
+    QDir directory(m_options.output);
+    if (m_options.output == "-") {
+        if (!stream.open(stdout, QIODevice::WriteOnly)) {
+            m_error = "Cannot write to " + streamName + ": " + stream.errorString();
+            return false;
+        }
+    } else if (raw) {
+        stream.setFileName(m_options.output);
+        if (!stream.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            m_error = "Cannot write " + streamName + ": " + stream.errorString();
+            return false;
+        }
+    } else if (!directory.mkpath(".")) {
+        m_error = "Cannot create the directory " + m_options.output;
+        return false;
+    }
+
+    // Recycled frames; declared before the scene, which points to one of them until it goes away
+    const int slots = m_options.queueFrames;
+    std::vector<ExportSnapshot> snapshots(std::size_t(slots), ExportSnapshot{SimSnapshot(), 1});
+    std::vector<ExportImage> images(std::size_t(slots), ExportImage{QImage(), -1});
+
+    // The scene as the main window shows it: the original crossing over its picture at natural
+    // size, any other layout whole on plain asphalt. It only draws what the producer captures.
+    Scene scene(m_layout, nullptr, Scene::DisplayOnly);
+    QRectF source = scene.layoutRect();
+    if (m_layout.isEmpty()) {
+        scene.setBackdrop(SpriteCache::instance().scaled(":/imagens/cross.jpg", QSize(800, 800)), QRectF(0, 0, 800, 800));
+        source = QRectF(0, 0, 800, 800);
+    } else {
+        scene.setBackgroundBrush(QColor(60, 60, 60));
+    }
+
+    SlotQueue freeSnapshots, readySnapshots, freeImages, readyImages;
+    for (int i = 0; i < slots; ++i) {
+        freeSnapshots.push(i);
+        freeImages.push(i);
+    }
+    std::atomic<bool> failed(false);
+    QString writeError;
+
+    // Producer: one snapshot per frame, at the simulated time of the frame
+    std::thread producer([&]() {
+        SimPositions previous;
+        SimSnapshot decoded;  // The replay keeps the frames it decoded last in here
+        if (!replay)
+            previous.capture(sim);
+        for (int f = 0; f < frameCount; ++f) {
+            const double timeMs = double(startMs) + f * 1000.0 / m_options.fps;
+            const int slot = freeSnapshots.pop();
+            if (slot < 0)
+                break;  // The export failed
+            ExportSnapshot &frame = snapshots[std::size_t(slot)];
+            if (replay) {
+                frame.alpha = replay->show(std::int64_t(timeMs), decoded);
+                frame.snapshot = decoded;
+            } else {
+                // Steps up to the first one at or after the frame time; the positions before the
+                // last of them are kept for the interpolation
+                while (double(sim.timeMs()) < timeMs) {
+                    if (double(sim.timeMs() + Simulation::TickMs) >= timeMs)
+                        previous.capture(sim);
+                    sim.step();
+                }
+                frame.snapshot.capture(sim, previous);
+                frame.alpha = float(1 - (double(sim.timeMs()) - timeMs) / Simulation::TickMs);
+            }
+            readySnapshots.push(slot);
+        }
+        readySnapshots.close();
+    });
+
+    // Writer: encodes the images in order; after a failure it only hands them back
+    std::thread writer([&]() {
+        for (;;) {
+            const int slot = readyImages.pop();
+            if (slot < 0)
+                break;
+            const ExportImage &frame = images[std::size_t(slot)];
+            if (!failed) {
+                bool ok = true;
+                if (raw) {
+                    // Packed RGB24 rows, without the padding of QImage's scan lines
+                    const QImage rgb = frame.image.convertToFormat(QImage::Format_RGB888);
+                    const qint64 rowBytes = qint64(rgb.width()) * 3;
+                    for (int y = 0; ok && y < rgb.height(); ++y)
+                        ok = stream.write(reinterpret_cast<const char *>(rgb.constScanLine(y)), rowBytes) == rowBytes;
+                    if (!ok)
+                        writeError = "Cannot write " + streamName + ": " + stream.errorString();
+                } else {
+                    const QString path = directory.filePath(QString("frame_%1.png").arg(frame.index, 6, 10, QChar('0')));
+                    ok = frame.image.save(path, "PNG");
+                    if (!ok)
+                        writeError = "Cannot write " + path;
+                }
+                if (!ok)
+                    failed = true;
+            }
+            freeImages.push(slot);
+        }
+    });
+
+    // Renderer, on this thread: every snapshot into the next free image
+    const QRectF target(QPointF(0, 0), QSizeF(m_options.size));
+    for (;;) {
+        const int slot = readySnapshots.pop();
+        if (slot < 0)
+            break;
+        if (failed) {
+            freeSnapshots.close();  // Stops the producer; its pending frames are dropped
+            continue;
+        }
+        const int imageSlot = freeImages.pop();
+        ExportImage &frame = images[std::size_t(imageSlot)];
+        if (frame.image.size() != m_options.size)
+            frame.image = QImage(m_options.size, QImage::Format_RGB32);
+        frame.image.fill(QColor(60, 60, 60));
+        scene.showSnapshot(&snapshots[std::size_t(slot)].snapshot, snapshots[std::size_t(slot)].alpha);
+        {
+            QPainter painter(&frame.image);
+            scene.render(&painter, target, source, Qt::KeepAspectRatio);
+        }
+        frame.index = m_frames++;
+        freeSnapshots.push(slot);  // The scene only reads it again in the next showSnapshot()
+        readyImages.push(imageSlot);
+        QCoreApplication::processEvents();  // Updates the scene schedules for views it does not have
+    }
+    readyImages.close();
+    writer.join();
+    producer.join();
+
+    if (stream.isOpen() && !stream.flush() && !failed) {
+        writeError = "Cannot write " + streamName + ": " + stream.errorString();
+        failed = true;
+    }
+    if (failed) {
+        m_error = writeError;
+        return false;
+    }
+    return true;
+}
+
+// Reason of the last failure.
+const QString &FrameExporter::error() const
+{
+    return m_error;
+}
+
+// Frames rendered by the last run().
+int FrameExporter::frames() const
+{
+    return m_frames;
+}
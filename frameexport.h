@@ -0,0 +1,54 @@
+#ifndef FRAMEEXPORT_H
+#define FRAMEEXPORT_H
+
+#include <QSize>     // Frame size
+#include <QString>   // Layout and output paths
+
+// What FrameExporter produces.
+struct FrameExportOptions
+{
+    QString output;         // Directory for numbered PNG images, a raw video file (.rgb), or "-" for
+                            // raw video on stdout
+    int fps;                // Frames per simulated second
+    double durationS;       // Simulated seconds; negative: 60 s of a simulation, all of a recording
+    QSize size;             // Frame size in pixels
+    int queueFrames;        // Frames each queue between the threads may hold
+
+    FrameExportOptions();
+};
+
+// Renders a layout frame by frame into images, without a window, at a fixed simulated frame
+// rate rather than the wall clock, so the export runs as fast as the machine allows (with
+// QT_QPA_PLATFORM=offscreen on a box without a display).
+//
+// Three threads form a pipeline: a producer steps its own copy of the simulation (or decodes
+// the recording) and captures one snapshot per frame; the calling thread, the only one allowed
+// to touch the pixmaps of the scene, renders each snapshot with Scene into a QImage; a writer
+// encodes and writes the images. Snapshots and images are recycled through bounded queues, so
+// memory stays flat and the fastest stage waits for the slowest one instead of running ahead.
+//
+// Raw video is packed RGB24, one frame after the other, e.g. for
+//   ffmpeg -f rawvideo -pix_fmt rgb24 -s 800x800 -r 30 -i frames.rgb out.mp4
+class FrameExporter
+{
+public:
+    // Constructor: `layout` as for Scene (empty for the original crossing).
+    FrameExporter(const QString &layout, const FrameExportOptions &options);
+
+    // Exports every frame. Must be called from the GUI thread. False if the output cannot be
+    // written or the recording cannot be read; error() says why.
+    bool run();
+
+    const QString &error() const;
+
+    // Frames rendered by the last run().
+    int frames() const;
+
+private:
+    QString m_layout;
+    FrameExportOptions m_options;
+    QString m_error;
+    int m_frames;
+};
+
+#endif // FRAMEEXPORT_H
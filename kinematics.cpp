@@ -0,0 +1,410 @@
+#include "kinematics.h"   // Header file for the kinematics kernel
+#include "simulation.h"   // SimLane and SimLight
+#include <algorithm>      // std::max, std::min
+#include <cmath>          // std::sqrt
+#include <cstring>        // std::memcpy
+#include <limits>         // Infinities of the lane tables
+
+// The AVX2 kernel is built into every x86-64 binary and only called after a CPU check, so the
+// rest of the program needs no special compiler flags.
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define KINEMATICS_AVX2 1
+#define KINEMATICS_AVX2_TARGET __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define KINEMATICS_AVX2 1
+#define KINEMATICS_AVX2_TARGET
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+// Lane tables are rebuilt every step: one row per lane, against several values per car.
+void KinematicsLanes::update(const std::vector<SimLane> &lanes, const std::vector<SimLight> &lights)
+{
+    lane.resize(lanes.size());
+    for (std::size_t l = 0; l < lanes.size(); ++l) {
+        const SimLane &from = lanes[l];
+        KinematicsLane &to = lane[l];
+        to.speed = from.speed;
+        to.carLength = from.carLength;
+        to.redStopS = from.light >= 0 && !lights[from.light].green ? from.stopS
+                                                                   : -std::numeric_limits<double>::infinity();
+        to.length = from.length;
+        to.x0 = from.x0;
+        to.y0 = from.y0;
+        to.dirX = from.dirX;
+        to.dirY = from.dirY;
+        to.detectorS = from.detectorS;
+        to.turnS = std::numeric_limits<double>::infinity();
+        for (const SimTurn &turn : from.turns)
+            to.turnS = std::min(to.turnS, turn.s);
+        to.endS = from.length;
+        // The front car of a lane linked to a lane of this simulation follows the last car of
+        // that lane; across simulations it cannot see it
+        to.exitLeader = from.exitLane >= 0 && from.exitRegion < 0 ? lanes[from.exitLane].tail : -1;
+    }
+}
+
+// Intelligent Driver Model: free-road acceleration minus an interaction term for the closest
+// obstacle, which is either the car ahead or the stop line when the light is red. Also runs the
+// cars left over by the vector kernel.
+static void accelerationsScalar(VehiclePool &pool, const KinematicsLanes &lanes, const KinematicsParams &params,
+                                int begin, int end)
+{
+    const float *s = pool.s.data();
+    const float *v = pool.v.data();
+    const double brakeTerm = 2 * std::sqrt(params.maxAccel * params.comfortDecel);
+    for (int i = begin; i < end; ++i) {
+        if (pool.state[i] == VehiclePool::Free)
+            continue;
+        const KinematicsLane &lane = lanes.lane[pool.lane[i]];
+        const double speed = v[i];
+        const double ratio = speed / lane.speed;
+        const double freeRoad = 1 - ratio * ratio * ratio * ratio;
+
+        double interaction = 0;
+
+        // Car ahead, found in O(1) through the lane list, or the last car of the linked lane
+        int leader = pool.leader[i];
+        double ahead = leader >= 0 ? s[leader] - s[i] : 0;
+        if (leader < 0 && lane.exitLeader >= 0) {
+            leader = lane.exitLeader;
+            ahead = lane.length - s[i] + s[leader];
+        }
+        if (leader >= 0) {
+            double gap = std::max(0.1, ahead - lane.carLength);
+            double dv = speed - v[leader];
+            double desired = params.minGap + std::max(0.0, speed * params.headway + speed * dv / brakeTerm);
+            interaction = std::max(interaction, (desired / gap) * (desired / gap));
+        }
+
+        // Red light: the stop line acts as a standing car, unless the driver is already past it
+        // or could not stop before it even braking at maxDecel (the light turned red too late)
+        if (s[i] < lane.redStopS) {
+            double gap = lane.redStopS - s[i];
+            if (speed * speed / (2 * params.maxDecel) < gap) {
+                gap = std::max(0.1, gap);
+                double desired = params.minGap + std::max(0.0, speed * params.headway + speed * speed / brakeTerm);
+                interaction = std::max(interaction, (desired / gap) * (desired / gap));
+            }
+        }
+
+        pool.a[i] = float(params.maxAccel * (freeRoad - interaction));
+    }
+}
+
+// Scalar integration, also used for the cars left over by the vector kernel.
+static void integrateScalar(VehiclePool &pool, const KinematicsLanes &lanes, const KinematicsParams &params,
+                            int begin, int end, std::uint8_t *flags)
+{
+    const float dt = params.dt;
+    for (int i = begin; i < end; ++i) {
+        if (pool.state[i] == VehiclePool::Free) {
+            flags[i] = 0;
+            continue;
+        }
+        const KinematicsLane &lane = lanes.lane[pool.lane[i]];
+        const float oldS = pool.s[i];
+        const float newV = std::max(0.0f, pool.v[i] + pool.a[i] * dt);
+        const float s = oldS + (pool.v[i] + newV) * 0.5f * dt;
+        pool.s[i] = s;
+        pool.v[i] = newV;
+        pool.age[i] += dt;
+        pool.state[i] = newV < params.stoppedSpeed ? VehiclePool::Stopped : VehiclePool::Driving;
+        pool.x[i] = float(lane.x0 + lane.dirX * s);
+        pool.y[i] = float(lane.y0 + lane.dirY * s);
+
+        std::uint8_t flag = 0;
+        if (oldS < lane.detectorS && s >= lane.detectorS)
+            flag |= KinematicsDetector;
+        if (pool.turn[i] >= 0 && s >= lane.turnS)
+            flag |= KinematicsTurn;
+        if (s >= lane.endS)
+            flag |= KinematicsEnd;
+        flags[i] = flag;
+    }
+}
+
+#ifdef KINEMATICS_AVX2
+
+// Byte k of spreadBits[m] is bit k of m: turns eight lane masks into eight per-slot bytes.
+static const struct SpreadBits
+{
+    std::uint64_t bytes[256];
+    SpreadBits()
+    {
+        for (int m = 0; m < 256; ++m) {
+            bytes[m] = 0;
+            for (int k = 0; k < 8; ++k)
+                bytes[m] |= std::uint64_t((m >> k) & 1) << (8 * k);
+        }
+    }
+} spreadBits;
+
+// std::max(a, b) returns `a` unless a < b; _mm256_max_pd(x, y) returns `y` unless x > y. With
+// the arguments swapped both agree on every input, signed zeros included, which keeps the two
+// kernels bit-identical.
+KINEMATICS_AVX2_TARGET static inline __m256d maxLikeStd(__m256d a, __m256d b)
+{
+    return _mm256_max_pd(b, a);
+}
+
+// Four rows of four doubles, one per car, turned into four vectors of one field each.
+KINEMATICS_AVX2_TARGET static inline void transpose(const double *row0, const double *row1, const double *row2,
+                                                    const double *row3, __m256d *field)
+{
+    const __m256d r0 = _mm256_loadu_pd(row0);
+    const __m256d r1 = _mm256_loadu_pd(row1);
+    const __m256d r2 = _mm256_loadu_pd(row2);
+    const __m256d r3 = _mm256_loadu_pd(row3);
+    const __m256d low01 = _mm256_unpacklo_pd(r0, r1);   // r0[0] r1[0] r0[2] r1[2]
+    const __m256d high01 = _mm256_unpackhi_pd(r0, r1);  // r0[1] r1[1] r0[3] r1[3]
+    const __m256d low23 = _mm256_unpacklo_pd(r2, r3);
+    const __m256d high23 = _mm256_unpackhi_pd(r2, r3);
+    field[0] = _mm256_permute2f128_pd(low01, low23, 0x20);
+    field[1] = _mm256_permute2f128_pd(high01, high23, 0x20);
+    field[2] = _mm256_permute2f128_pd(low01, low23, 0x31);
+    field[3] = _mm256_permute2f128_pd(high01, high23, 0x31);
+}
+
+// Four cars per iteration, in double precision like the scalar kernel. Free slots are computed
+// on lane 0 without a leader, and their result is thrown away. Lanes and cars ahead are loaded
+// one by one: they are scattered, and scalar loads overlap their cache misses better than a
+// gather does.
+KINEMATICS_AVX2_TARGET static void accelerationsAvx2(VehiclePool &pool, const KinematicsLanes &lanes,
+                                                     const KinematicsParams &params, int end)
+{
+    const float *s = pool.s.data();
+    const float *v = pool.v.data();
+    float *a = pool.a.data();
+    const KinematicsLane *table = lanes.lane.data();
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d tenth = _mm256_set1_pd(0.1);
+    const __m256d minGap = _mm256_set1_pd(params.minGap);
+    const __m256d headway = _mm256_set1_pd(params.headway);
+    const __m256d maxAccel = _mm256_set1_pd(params.maxAccel);
+    const __m256d brakeTerm = _mm256_set1_pd(2 * std::sqrt(params.maxAccel * params.comfortDecel));
+    const __m256d twiceMaxDecel = _mm256_set1_pd(2 * params.maxDecel);
+    const __m128i minusOne = _mm_set1_epi32(-1);
+
+    int i = 0;
+    for (; i + 4 <= end; i += 4) {
+        std::int32_t states;
+        std::memcpy(&states, pool.state.data() + i, sizeof states);
+        const __m128i live = _mm_xor_si128(_mm_cmpeq_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(states)),
+                                                           _mm_setzero_si128()), minusOne);
+        alignas(16) std::int32_t index[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(index),
+                        _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pool.lane.data() + i)), live));
+        const KinematicsLane *lane[4] = {table + index[0], table + index[1], table + index[2], table + index[3]};
+
+        // Car ahead on the lane, or else the last car of the linked lane
+        const __m128i ownLeader = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pool.leader.data() + i));
+        const __m128i exitLeader = _mm_set_epi32(lane[3]->exitLeader, lane[2]->exitLeader, lane[1]->exitLeader,
+                                                 lane[0]->exitLeader);
+        const __m128i noLeader = _mm_cmplt_epi32(ownLeader, _mm_setzero_si128());
+        const __m128i useExit = _mm_and_si128(noLeader, _mm_cmpgt_epi32(exitLeader, minusOne));
+        const __m128i leader = _mm_blendv_epi8(ownLeader, exitLeader, noLeader);
+        const __m128i hasLeader = _mm_and_si128(live, _mm_cmpgt_epi32(leader, minusOne));
+        alignas(16) std::int32_t ahead[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(ahead), _mm_and_si128(leader, hasLeader));
+        const __m128 leaderS = _mm_and_ps(_mm_set_ps(s[ahead[3]], s[ahead[2]], s[ahead[1]], s[ahead[0]]),
+                                          _mm_castsi128_ps(hasLeader));
+        const __m128 leaderV = _mm_and_ps(_mm_set_ps(v[ahead[3]], v[ahead[2]], v[ahead[1]], v[ahead[0]]),
+                                          _mm_castsi128_ps(hasLeader));
+        __m256d field[4];
+        transpose(&lane[0]->speed, &lane[1]->speed, &lane[2]->speed, &lane[3]->speed, field);
+        const __m256d laneSpeed = field[0], carLength = field[1], stopS = field[2], length = field[3];
+
+        const __m128 ownS = _mm_loadu_ps(s + i);
+        const __m256d position = _mm256_cvtps_pd(ownS);
+        const __m256d speed = _mm256_cvtps_pd(_mm_loadu_ps(v + i));
+        const __m256d ratio = _mm256_div_pd(speed, laneSpeed);
+        const __m256d freeRoad =
+            _mm256_sub_pd(one, _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(ratio, ratio), ratio), ratio));
+
+        // Car ahead: on the same lane the distance is a float difference, as in the scalar kernel
+        const __m256d aheadOwn = _mm256_cvtps_pd(_mm_sub_ps(leaderS, ownS));
+        const __m256d aheadExit = _mm256_add_pd(_mm256_sub_pd(length, position), _mm256_cvtps_pd(leaderS));
+        const __m256d distance =
+            _mm256_blendv_pd(aheadOwn, aheadExit, _mm256_castsi256_pd(_mm256_cvtepi32_epi64(useExit)));
+        const __m256d gap = maxLikeStd(tenth, _mm256_sub_pd(distance, carLength));
+        const __m256d dv = _mm256_sub_pd(speed, _mm256_cvtps_pd(leaderV));
+        const __m256d desired = _mm256_add_pd(
+            minGap, maxLikeStd(zero, _mm256_add_pd(_mm256_mul_pd(speed, headway),
+                                                   _mm256_div_pd(_mm256_mul_pd(speed, dv), brakeTerm))));
+        const __m256d ratioAhead = _mm256_div_pd(desired, gap);
+        __m256d interaction = _mm256_blendv_pd(zero, maxLikeStd(zero, _mm256_mul_pd(ratioAhead, ratioAhead)),
+                                               _mm256_castsi256_pd(_mm256_cvtepi32_epi64(hasLeader)));
+
+        // Red light
+        const __m256d stopGap = _mm256_sub_pd(stopS, position);
+        const __m256d speed2 = _mm256_mul_pd(speed, speed);
+        const __m256d red = _mm256_and_pd(_mm256_cmp_pd(position, stopS, _CMP_LT_OQ),
+                                          _mm256_cmp_pd(_mm256_div_pd(speed2, twiceMaxDecel), stopGap, _CMP_LT_OQ));
+        const __m256d desiredStop = _mm256_add_pd(
+            minGap, maxLikeStd(zero, _mm256_add_pd(_mm256_mul_pd(speed, headway), _mm256_div_pd(speed2, brakeTerm))));
+        const __m256d ratioStop = _mm256_div_pd(desiredStop, maxLikeStd(tenth, stopGap));
+        interaction = _mm256_blendv_pd(interaction, maxLikeStd(interaction, _mm256_mul_pd(ratioStop, ratioStop)), red);
+
+        const __m128 acc = _mm256_cvtpd_ps(_mm256_mul_pd(maxAccel, _mm256_sub_pd(freeRoad, interaction)));
+        _mm_storeu_ps(a + i, _mm_blendv_ps(_mm_loadu_ps(a + i), acc, _mm_castsi128_ps(live)));
+    }
+    accelerationsScalar(pool, lanes, params, i, end);
+}
+
+// Eight cars per iteration: the float update of the scalar kernel, then the lane rows in two
+// halves of four. Flags and states are assembled as eight bytes and stored at once.
+KINEMATICS_AVX2_TARGET static void integrateAvx2(VehiclePool &pool, const KinematicsLanes &lanes,
+                                                 const KinematicsParams &params, int end, std::uint8_t *flags)
+{
+    const KinematicsLane *table = lanes.lane.data();
+    const __m256 dt = _mm256_set1_ps(params.dt);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 stopped = _mm256_set1_ps(params.stoppedSpeed);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256i minusOne = _mm256_set1_epi32(-1);
+
+    int i = 0;
+    for (; i + 8 <= end; i += 8) {
+        std::int64_t states, turns;
+        std::memcpy(&states, pool.state.data() + i, sizeof states);
+        std::memcpy(&turns, pool.turn.data() + i, sizeof turns);
+        const __m256 live = _mm256_castsi256_ps(_mm256_xor_si256(
+            _mm256_cmpeq_epi32(_mm256_cvtepu8_epi32(_mm_cvtsi64_si128(states)), _mm256_setzero_si256()), minusOne));
+        const int liveBits = _mm256_movemask_ps(live);
+        const int turnBits = _mm256_movemask_ps(_mm256_castsi256_ps(
+            _mm256_cmpgt_epi32(_mm256_cvtepi8_epi32(_mm_cvtsi64_si128(turns)), minusOne)));
+
+        const __m256 oldS = _mm256_loadu_ps(pool.s.data() + i);
+        const __m256 v = _mm256_loadu_ps(pool.v.data() + i);
+        const __m256 newV = _mm256_max_ps(_mm256_add_ps(v, _mm256_mul_ps(_mm256_loadu_ps(pool.a.data() + i), dt)), zero);
+        const __m256 s = _mm256_add_ps(oldS, _mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(v, newV), half), dt));
+        const __m256 age = _mm256_loadu_ps(pool.age.data() + i);
+        _mm256_storeu_ps(pool.s.data() + i, _mm256_blendv_ps(oldS, s, live));
+        _mm256_storeu_ps(pool.v.data() + i, _mm256_blendv_ps(v, newV, live));
+        _mm256_storeu_ps(pool.age.data() + i, _mm256_blendv_ps(age, _mm256_add_ps(age, dt), live));
+        const int stoppedBits = _mm256_movemask_ps(_mm256_cmp_ps(newV, stopped, _CMP_LT_OQ)) & liveBits;
+
+        alignas(32) std::int32_t index[8];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(index),
+                           _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(pool.lane.data() + i)),
+                                            _mm256_castps_si256(live)));
+        int detectorBits = 0, pendingBits = 0, endBits = 0;
+        __m128 x[2], y[2];
+        for (int h = 0; h < 2; ++h) {
+            const std::int32_t *l = index + 4 * h;
+            const KinematicsLane *lane[4] = {table + l[0], table + l[1], table + l[2], table + l[3]};
+            const __m256d from = _mm256_cvtps_pd(h ? _mm256_extractf128_ps(oldS, 1) : _mm256_castps256_ps128(oldS));
+            const __m256d to = _mm256_cvtps_pd(h ? _mm256_extractf128_ps(s, 1) : _mm256_castps256_ps128(s));
+
+            __m256d position[4], events[4];
+            transpose(&lane[0]->x0, &lane[1]->x0, &lane[2]->x0, &lane[3]->x0, position);
+            x[h] = _mm256_cvtpd_ps(_mm256_add_pd(position[0], _mm256_mul_pd(position[2], to)));
+            y[h] = _mm256_cvtpd_ps(_mm256_add_pd(position[1], _mm256_mul_pd(position[3], to)));
+
+            transpose(&lane[0]->detectorS, &lane[1]->detectorS, &lane[2]->detectorS, &lane[3]->detectorS, events);
+            detectorBits |= _mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(from, events[0], _CMP_LT_OQ),
+                                                             _mm256_cmp_pd(to, events[0], _CMP_GE_OQ))) << (4 * h);
+            pendingBits |= _mm256_movemask_pd(_mm256_cmp_pd(to, events[1], _CMP_GE_OQ)) << (4 * h);
+            endBits |= _mm256_movemask_pd(_mm256_cmp_pd(to, events[2], _CMP_GE_OQ)) << (4 * h);
+        }
+        const __m256 newX = _mm256_insertf128_ps(_mm256_castps128_ps256(x[0]), x[1], 1);
+        const __m256 newY = _mm256_insertf128_ps(_mm256_castps128_ps256(y[0]), y[1], 1);
+        _mm256_storeu_ps(pool.x.data() + i, _mm256_blendv_ps(_mm256_loadu_ps(pool.x.data() + i), newX, live));
+        _mm256_storeu_ps(pool.y.data() + i, _mm256_blendv_ps(_mm256_loadu_ps(pool.y.data() + i), newY, live));
+
+        detectorBits &= liveBits;
+        pendingBits &= turnBits & liveBits;
+        endBits &= liveBits;
+        const std::uint64_t flagBytes = spreadBits.bytes[detectorBits] | spreadBits.bytes[pendingBits] << 1
+                                        | spreadBits.bytes[endBits] << 2;
+        const std::uint64_t stateBytes = spreadBits.bytes[liveBits] + spreadBits.bytes[stoppedBits];
+        std::memcpy(flags + i, &flagBytes, sizeof flagBytes);
+        std::memcpy(pool.state.data() + i, &stateBytes, sizeof stateBytes);
+    }
+    integrateScalar(pool, lanes, params, i, end, flags);
+}
+
+// CPUID: AVX2, and an operating system saving the YMM registers.
+static bool cpuHasAvx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    const bool osSavesYmm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return osSavesYmm && (info[1] & (1 << 5));
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // KINEMATICS_AVX2
+
+// Checked once; AVX2 needs both the CPU and a build for x86-64.
+bool kinematicsIsaSupported(KinematicsIsa isa)
+{
+    switch (isa) {
+    case KinematicsIsa::Avx2: {
+#ifdef KINEMATICS_AVX2
+        static const bool avx2 = cpuHasAvx2();
+        return avx2;
+#else
+        return false;
+#endif
+    }
+    case KinematicsIsa::Scalar:
+        break;
+    }
+    return true;
+}
+
+// AVX2 where available.
+KinematicsIsa bestKinematicsIsa()
+{
+    return kinematicsIsaSupported(KinematicsIsa::Avx2) ? KinematicsIsa::Avx2 : KinematicsIsa::Scalar;
+}
+
+// Lower-case names.
+const char *kinematicsIsaName(KinematicsIsa isa)
+{
+    switch (isa) {
+    case KinematicsIsa::Avx2:
+        return "avx2";
+    case KinematicsIsa::Scalar:
+        break;
+    }
+    return "scalar";
+}
+
+// Dispatches to the kernel of `isa`.
+void computeAccelerations(KinematicsIsa isa, VehiclePool &pool, const KinematicsLanes &lanes,
+                          const KinematicsParams &params, int end)
+{
+#ifdef KINEMATICS_AVX2
+    if (isa == KinematicsIsa::Avx2 && !lanes.lane.empty()) {  // Free slots read lane 0
+        accelerationsAvx2(pool, lanes, params, end);
+        return;
+    }
+#endif
+    accelerationsScalar(pool, lanes, params, 0, end);
+}
+
+// Dispatches to the kernel of `isa`.
+void integrateCars(KinematicsIsa isa, VehiclePool &pool, const KinematicsLanes &lanes,
+                   const KinematicsParams &params, int end, std::uint8_t *flags)
+{
+#ifdef KINEMATICS_AVX2
+    if (isa == KinematicsIsa::Avx2 && !lanes.lane.empty()) {  // Free slots read lane 0
+        integrateAvx2(pool, lanes, params, end, flags);
+        return;
+    }
+#endif
+    integrateScalar(pool, lanes, params, 0, end, flags);
+}
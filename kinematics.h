@@ -0,0 +1,88 @@
+#ifndef KINEMATICS_H
+#define KINEMATICS_H
+
+#include <cstdint>        // Per-slot flags
+#include <vector>         // Per-lane tables
+#include "vehiclepool.h"  // The arrays the kernel runs over
+
+struct SimLane;
+struct SimLight;
+
+// Per-step car update of Simulation, as a kernel over the arrays of VehiclePool: the IDM
+// acceleration of every car (car ahead, red light), then the integration of speeds and
+// positions. Each pass is one straight loop without data-dependent branches, so at a million
+// cars its cost is the memory it streams through: the pool arrays, the lane of each car and the
+// car ahead of it.
+//
+// Two implementations give bit-identical results: a scalar one, and an AVX2 one processing four
+// cars at a time (eight in the float part of the integration) in the same arithmetic, in the
+// same order, with the same rounding. The AVX2 one is used when the CPU supports it; a run therefore gives the same
+// result on any machine, and a saved state resumes identically on another one. This holds as long
+// as the compiler does not fuse a multiplication and an addition into one multiply-add, which
+// rounds once instead of twice: simcore.pri builds the core with -ffp-contract=off for that.
+
+// Instruction sets the kernel is written for.
+enum class KinematicsIsa
+{
+    Scalar,     // Plain C++, any CPU
+    Avx2        // x86-64 with AVX2, 4 cars per instruction
+};
+
+// Fastest instruction set of this CPU, checked once.
+KinematicsIsa bestKinematicsIsa();
+
+// Whether this CPU (and this build) can run `isa`.
+bool kinematicsIsaSupported(KinematicsIsa isa);
+
+// Names used by the benchmarks.
+const char *kinematicsIsaName(KinematicsIsa isa);
+
+// What integrateCars() found about a car, per slot. The caller handles these one by one; every
+// other car needs no more work in this step.
+enum KinematicsFlag : std::uint8_t
+{
+    KinematicsDetector = 1,   // Passed the loop detector of its lane
+    KinematicsTurn = 2,       // Has a turn pending and may have reached it (check the turn's own point)
+    KinematicsEnd = 4         // Reached the end of its lane
+};
+
+// Car-following parameters (see CarFollowing) and the step.
+struct KinematicsParams
+{
+    double maxAccel, comfortDecel, maxDecel, minGap, headway;
+    float dt;                   // Step in seconds
+    float stoppedSpeed;         // Below this speed a car is Stopped
+};
+
+// What the kernel reads about a lane, in rows of four doubles: the vector kernel loads the row of
+// four cars at once and transposes them, where gathering each field would cost a gather per field.
+struct KinematicsLane
+{
+    double speed, carLength, redStopS, length;  // Car following; redStopS is the stop line while
+                                                // its light is red, -infinity otherwise
+    double x0, y0, dirX, dirY;                  // Scene position
+    double detectorS, turnS, endS;              // Detector (-1 if none), first turn point (+infinity
+                                                // if none) and lane length again, for the end test
+    std::int32_t exitLeader;                    // Last car of the linked lane of this simulation, -1 if none
+};
+
+// Per-lane tables of the kernel, refreshed before every step from the lanes and the lights.
+struct KinematicsLanes
+{
+    std::vector<KinematicsLane> lane;
+
+    // Copies what the kernel needs from `lanes` and the current state of `lights`.
+    void update(const std::vector<SimLane> &lanes, const std::vector<SimLight> &lights);
+};
+
+// Stores the IDM acceleration of every car below `end` in pool.a, from the positions at the
+// start of the step: no car moves, so the result does not depend on the slot order.
+void computeAccelerations(KinematicsIsa isa, VehiclePool &pool, const KinematicsLanes &lanes,
+                          const KinematicsParams &params, int end);
+
+// Moves every car below `end` by one step with its acceleration: speed, distance, age, state
+// and scene position. Writes the KinematicsFlag of each slot to `flags` (0 for free slots).
+void integrateCars(KinematicsIsa isa, VehiclePool &pool, const KinematicsLanes &lanes,
+                   const KinematicsParams &params, int end, std::uint8_t *flags);
+
+#endif // KINEMATICS_H
@@ -1,6 +1,10 @@
 #include "mainwindow.h"    // Include the header file for the MainWindow class
 
 #include <QApplication>    // Include the QApplication class, which manages GUI application control flow and main settings
+#include <QCommandLineParser>  // Include QCommandLineParser to read the optional layout argument
+#include <QElapsedTimer>   // Wall time of a frame export
+#include <QTextStream>     // Export errors and summary on the console
+#include "frameexport.h"   // Frame export without a window
 
 // The main function is the entry point for the application.
 int main(int argc, char *argv[])
@@ -9,9 +13,55 @@ int main(int argc, char *argv[])
     // The argc and argv parameters allow the application to accept command-line arguments.
     QApplication a(argc, argv);
 
+    // Optional layout: a scenario JSON file, grid:CxR or a recording to play back; without it the
+    // original crossing is shown.
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addPositionalArgument("layout", "Scenario JSON file, grid:CxR for a city grid, or a .trj recording to replay.", "[layout]");
+    QCommandLineOption exportOption("export", "Render the layout to numbered PNG images in this directory, to a raw RGB24 "
+                                    "video file (.rgb) or to stdout (-) instead of showing a window. Runs without a "
+                                    "display with QT_QPA_PLATFORM=offscreen.", "output");
+    QCommandLineOption fpsOption("fps", "Export: frames per simulated second.", "fps", "30");
+    QCommandLineOption durationOption("duration", "Export: simulated seconds (default: 60, or the whole recording).", "seconds");
+    QCommandLineOption sizeOption("size", "Export: frame size, e.g. 1280x720.", "size", "800x800");
+    QCommandLineOption queueOption("queue", "Export: frames each stage may run ahead of the next.", "frames", "8");
+    parser.addOptions({exportOption, fpsOption, durationOption, sizeOption, queueOption});
+    parser.process(a);
+    const QString layout = parser.positionalArguments().value(0);
+
+    // Export mode: frames go to the output as fast as they can be rendered, and no window opens
+    if (parser.isSet(exportOption)) {
+        QTextStream err(stderr);
+        FrameExportOptions options;
+        options.output = parser.value(exportOption);
+        const QStringList size = parser.value(sizeOption).split('x');
+        bool okFps, okWidth, okHeight, okQueue, okDuration = true;
+        options.fps = parser.value(fpsOption).toInt(&okFps);
+        options.size = QSize(size.value(0).toInt(&okWidth), size.value(1).toInt(&okHeight));
+        options.queueFrames = parser.value(queueOption).toInt(&okQueue);
+        if (parser.isSet(durationOption))
+            options.durationS = parser.value(durationOption).toDouble(&okDuration);
+        if (!okFps || !okWidth || !okHeight || size.size() != 2 || !okQueue || !okDuration
+            || (parser.isSet(durationOption) && options.durationS < 0)) {
+            err << "Invalid export options\n";
+            return 1;
+        }
+        QElapsedTimer clock;
+        clock.start();
+        FrameExporter exporter(layout, options);
+        if (!exporter.run()) {
+            err << "Export failed: " << exporter.error() << "\n";
+            return 1;
+        }
+        const double seconds = clock.elapsed() / 1000.0;
+        err << "Exported " << exporter.frames() << " frames in " << QString::number(seconds, 'f', 1) << " s ("
+            << QString::number(exporter.frames() / qMax(seconds, 0.001), 'f', 1) << " frames/s)\n";
+        return 0;
+    }
+
     // Create an instance of the MainWindow class.
     // This is the main window of the application, typically containing the UI and any central widgets.
-    MainWindow w;
+    MainWindow w(layout);
 
     // Display the main window on the screen.
     // The 'show()' function makes the window visible and initializes its event loop.
@@ -1,10 +1,25 @@
 #include "mainwindow.h"     // Include the MainWindow class header
 #include "ui_mainwindow.h"   // Include the UI generated header for the MainWindow UI elements
 #include <QString>           // Include QString to manipulate text strings
-#include <QGraphicsPixmapItem> // Include QGraphicsPixmapItem to handle image objects in the scene
+#include <QLabel>            // Include QLabel to show the replay time
+#include <QPaintEvent>       // Include QPaintEvent to count the repainted pixels of the view
+#include <QSignalBlocker>    // Include QSignalBlocker to move the replay slider without seeking
+#include <QSlider>           // Include QSlider to scrub through a replay
+#include <QTimer>            // Include QTimer to refresh the status bar periodically
+#include <QWheelEvent>       // Include QWheelEvent to zoom the view with the mouse wheel
+#include <cmath>             // Include cmath for std::pow (zoom factor per wheel notch)
+#include "spritecache.h"     // Include the sprite cache the background is taken from
+#include "metricsoverlay.h"  // Include the overlay showing the live figures over the view
+#include "telemetry.h"       // Include the telemetry counters the overlay reads
+
+// Simulation speeds selectable with the slider, in simulated ms per real ms:
+// paused, 1x to 1000x, and as fast as the simulation thread can step.
+static const double SpeedSteps[] = {0, 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, -1};
+static const int SpeedCount = int(sizeof(SpeedSteps) / sizeof(SpeedSteps[0]));
+static const int RealTime = 1;  // Slider position of 1x
 
 // Constructor for MainWindow. It initializes the main window UI and sets up the graphical scene and its elements.
-MainWindow::MainWindow(QWidget *parent)
+MainWindow::MainWindow(const QString &layout, QWidget *parent)
     : QMainWindow(parent)   // Call the base class constructor with the parent widget
     , ui(new Ui::MainWindow) // Initialize the UI pointer for the main window
 {
@@ -13,33 +28,85 @@ MainWindow::MainWindow(QWidget *parent)
 
     // Create a new Scene object that will serve as the graphics scene where items are displayed.
     // This scene will contain all the graphical elements such as cars, background, etc.
-    s = new Scene(this);
-
-    // Add the background image (scenario) to the scene.
-    // QGraphicsPixmapItem is used to display a pixmap (an image). The image is scaled to fit 800x800 size
-    // with smooth transformation and aspect ratio preserved.
-    QGraphicsPixmapItem *cenarioImg = new QGraphicsPixmapItem(QPixmap(":/imagens/cross.jpg")
-                                                                  .scaled(800, 800, Qt::KeepAspectRatio, Qt::SmoothTransformation));
-
-    // Set the range of the horizontal slider, which is used to control the number of cars or another parameter.
-    ui->horizontalSlider->setRange(1, 5);  // Slider allows selecting a value between 1 and 5
+    s = new Scene(layout, this);
 
-    // Add the background image (cenarioImg) to the scene `s`.
-    s->addItem(cenarioImg);
+    // The horizontal slider selects the simulation speed, one position per entry of SpeedSteps.
+    ui->horizontalSlider->setRange(0, SpeedCount - 1);
+    ui->horizontalSlider->setPageStep(1);
+    ui->horizontalSlider->setValue(RealTime);  // Signals the slot, which sets the speed and its label
 
-    // Configure the QGraphicsView to display the scene. Set the scene's viewable area to 800x800 pixels,
-    // which matches the size of the background image.
-    ui->graphicsView->setSceneRect(0, 0, 800, 800);
+    // The view can be panned over the whole layout, not only the 800x800 around the original crossing.
+    QRectF sceneArea = s->layoutRect();
+    if (layout.isEmpty()) {
+        // Add the background image (scenario) to the scene, as its backdrop: the view caches it
+        // pre-rendered below. The image comes from the sprite cache already scaled to fit 800x800
+        // size with smooth transformation and aspect ratio preserved.
+        s->setBackdrop(SpriteCache::instance().scaled(":/imagens/cross.jpg", QSize(800, 800)), QRectF(0, 0, 800, 800));
+        sceneArea |= QRectF(0, 0, 800, 800);
+    } else {
+        s->setBackgroundBrush(QColor(60, 60, 60));  // Plain asphalt under layouts without a picture
+    }
+    ui->graphicsView->setSceneRect(sceneArea);
 
     // Set the scene `s` to the QGraphicsView, which is the widget responsible for displaying the scene on the UI.
     ui->graphicsView->setScene(s);
 
-    // Disable scroll bars for the graphics view since the scene fits exactly within the view.
+    // Scroll bars stay hidden: the view is panned by dragging and zoomed with the mouse wheel.
     ui->graphicsView->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
     ui->graphicsView->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    ui->graphicsView->setDragMode(QGraphicsView::ScrollHandDrag);
+    ui->graphicsView->setTransformationAnchor(QGraphicsView::AnchorUnderMouse);
+    ui->graphicsView->viewport()->installEventFilter(this);
 
-    // Fix the size of the QGraphicsView to 800x800, so it perfectly matches the scene size.
+    // Only the changed parts of the view are repainted: the background comes from a pre-rendered
+    // copy, and the scene reports the changed areas (see VehicleLayer) as a region, not a bounding
+    // rectangle, so two cars in opposite corners do not repaint everything between them.
+    ui->graphicsView->setCacheMode(QGraphicsView::CacheBackground);
+    ui->graphicsView->setViewportUpdateMode(QGraphicsView::MinimalViewportUpdate);
+
+    // Fix the size of the QGraphicsView to 800x800, the size of the original picture.
     ui->graphicsView->setFixedSize(800, 800);
+
+    // Live figures over the top-left corner of the view; the counters behind them stay on for the whole session.
+    Telemetry::setEnabled(true);
+    new MetricsOverlay(s, ui->graphicsView);
+
+    // Start on the original crossing at its natural size, or on the whole layout.
+    if (layout.isEmpty())
+        ui->graphicsView->centerOn(400, 400);
+    else
+        ui->graphicsView->fitInView(sceneArea, Qt::KeepAspectRatio);
+
+    // A replay gets a slider in the status bar to scrub through the recording, in steps of 100 ms.
+    // Dragging it seeks; every frame moves it along without seeking again.
+    if (s->isReplay()) {
+        QSlider *scrubber = new QSlider(Qt::Horizontal, this);
+        scrubber->setRange(int(s->replayStartMs() / 100), int(s->replayEndMs() / 100));
+        scrubber->setPageStep(100);  // 10 seconds
+        scrubber->setMinimumWidth(400);
+        QLabel *replayTime = new QLabel(this);
+        ui->statusbar->addPermanentWidget(scrubber);
+        ui->statusbar->addPermanentWidget(replayTime);
+        connect(scrubber, &QSlider::valueChanged, s, [this](int value) { s->seek(qint64(value) * 100); });
+        connect(s, &Scene::timeChanged, this, [scrubber, replayTime](qint64 timeMs) {
+            const QSignalBlocker blocker(scrubber);
+            scrubber->setValue(int(timeMs / 100));
+            replayTime->setText(QString("%1:%2").arg(timeMs / 60000).arg(timeMs / 1000 % 60, 2, 10, QChar('0')));
+        });
+
+        // Recordings start paused; Começar plays them
+        ui->horizontalSlider->setValue(0);
+    }
+
+    // Show the conflict counter and the sprite cache counters once per second.
+    QTimer *statusTimer = new QTimer(this);
+    connect(statusTimer, &QTimer::timeout, this, [this]() {
+        ui->nCollisions->setText(QString::number(s->snapshot().conflicts));
+
+        const SpriteCache &cache = SpriteCache::instance();
+        ui->statusbar->showMessage(QString("Sprite cache: %1 hits, %2 misses").arg(cache.hits()).arg(cache.misses()));
+    });
+    statusTimer->start(1000);
 }
 
 // Destructor for MainWindow. Cleans up the dynamically allocated UI resources when the window is closed.
@@ -48,12 +115,38 @@ MainWindow::~MainWindow()
     delete ui;  // Delete the UI pointer to avoid memory leaks
 }
 
+// Each wheel notch zooms by 15% around the mouse, between 1% and 800% of the natural size.
+// Paint events start the scene's frame timing and count the pixels they cover.
+bool MainWindow::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == ui->graphicsView->viewport() && event->type() == QEvent::Paint) {
+        const qreal ratio = ui->graphicsView->viewport()->devicePixelRatioF();
+        quint64 pixels = 0;
+        for (const QRect &rect : static_cast<QPaintEvent *>(event)->region())
+            pixels += quint64(rect.width() * ratio) * quint64(rect.height() * ratio);
+        s->beginFrame(pixels);
+        return false;  // The view still paints
+    }
+    if (watched == ui->graphicsView->viewport() && event->type() == QEvent::Wheel) {
+        const QWheelEvent *wheel = static_cast<QWheelEvent *>(event);
+        const qreal factor = std::pow(1.15, wheel->angleDelta().y() / 120.0);
+        const qreal current = ui->graphicsView->transform().m11();
+        const qreal target = qBound(0.01, current * factor, 8.0);
+        ui->graphicsView->scale(target / current, target / current);
+        return true;  // The view must not scroll as well
+    }
+    return QMainWindow::eventFilter(watched, event);
+}
+
 // Slot connected to the "Começar" (Start) button click event.
 // When the button is clicked, this function is triggered and starts the scene's operations (e.g., moving cars).
 void MainWindow::on_comecar_clicked()
 {
     s->start();  // Call the start method of the Scene to begin any animations or processes
-    qDebug() << "ol";  // Output a debug message to the console for verification
+
+    // Starting a paused simulation would show nothing moving: resume it in real time
+    if (ui->horizontalSlider->value() == 0)
+        ui->horizontalSlider->setValue(RealTime);
 }
 
 // Slot connected to the "Parar" (Stop) button click event.
@@ -63,11 +156,26 @@ void MainWindow::on_parar_clicked()
     s->stop();  // Call the stop method of the Scene to halt any animations or processes
 }
 
+// Slot connected to the "Passo" (Step) button click event.
+// Pauses the simulation if needed and advances it by a single step.
+void MainWindow::on_passo_clicked()
+{
+    ui->horizontalSlider->setValue(0);
+    s->stepOnce();
+}
+
 // Slot connected to the horizontal slider value change event.
-// This function is triggered when the user changes the slider value.
+// This function is triggered when the user changes the slider value and sets the simulation speed.
 void MainWindow::on_horizontalSlider_valueChanged(int value)
 {
-    // Convert the integer slider value to a QString and update the label (ncars) to display the value.
-    QString numberString = QString::number(value);
-    ui->ncars->setText(numberString);  // Update the text of the ncars label to show the current slider value
+    const double scale = SpeedSteps[qBound(0, value, SpeedCount - 1)];
+    s->setTimeScale(scale);
+
+    // Show the speed in the label (ncars) next to the slider
+    if (scale == 0)
+        ui->ncars->setText("Paused");
+    else if (scale < 0)
+        ui->ncars->setText("Max");
+    else
+        ui->ncars->setText(QString("%1x").arg(scale));
 }
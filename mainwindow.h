@@ -16,8 +16,9 @@ class MainWindow : public QMainWindow
     Q_OBJECT  // Macro required for any class that uses Qt's signal/slot mechanism or the meta-object system
 
 public:
-    // Constructor: Initializes the MainWindow object. Takes an optional parent widget parameter, which is set to nullptr by default.
-    explicit MainWindow(QWidget *parent = nullptr);
+    // Constructor: Initializes the MainWindow object showing `layout` (see Scene). Takes an optional parent
+    // widget parameter, which is set to nullptr by default.
+    explicit MainWindow(const QString &layout = QString(), QWidget *parent = nullptr);
 
     // Destructor: Cleans up any dynamically allocated resources when the MainWindow object is destroyed.
     ~MainWindow();
@@ -37,9 +38,16 @@ private slots:
     // Slot triggered when the "stop" button (probably a QPushButton) is clicked
     void on_parar_clicked();
 
-    // Slot triggered when the horizontal slider's value changes (likely to adjust a setting such as game speed or volume)
+    // Slot triggered when the "step" button is clicked: advances a paused simulation by one step
+    void on_passo_clicked();
+
+    // Slot triggered when the horizontal slider's value changes: selects the simulation speed
     void on_horizontalSlider_valueChanged(int value);
 
+protected:
+    // Zooms the view around the mouse on wheel events of its viewport, and reports its paint events to the scene.
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
 private:
     // Pointer to the Scene object, which likely handles the graphical elements of the application (e.g., rendering a game world or UI components)
     Scene *s;
@@ -0,0 +1,163 @@
+#include "metrics.h"       // Header file for DelayHistogram and the run summary
+#include "simulation.h"    // Source of the measurements
+#include "network.h"       // Regions of a road network
+#include <algorithm>       // std::max, std::min
+
+// Constructor: an empty histogram.
+DelayHistogram::DelayHistogram()
+    : m_buckets(BucketCount, 0)
+    , m_count(0)
+    , m_sum(0)
+    , m_max(0)
+{
+}
+
+// Records one delay in its bucket.
+void DelayHistogram::add(double seconds)
+{
+    int bucket = std::min(BucketCount - 1, std::max(0, int(seconds / BucketSeconds)));
+    ++m_buckets[bucket];
+    ++m_count;
+    m_sum += seconds;
+    m_max = std::max(m_max, seconds);
+}
+
+// Number of delays recorded.
+std::uint64_t DelayHistogram::count() const
+{
+    return m_count;
+}
+
+// Mean delay, 0 when empty.
+double DelayHistogram::mean() const
+{
+    return m_count ? m_sum / double(m_count) : 0.0;
+}
+
+// Largest delay recorded.
+double DelayHistogram::max() const
+{
+    return m_max;
+}
+
+// Walks the buckets until the requested share of samples is reached and returns the upper
+// edge of that bucket (never more than the real maximum).
+double DelayHistogram::percentile(double p) const
+{
+    if (m_count == 0)
+        return 0.0;
+    const double target = p * double(m_count);
+    std::uint64_t seen = 0;
+    for (int bucket = 0; bucket < BucketCount; ++bucket) {
+        seen += m_buckets[bucket];
+        if (double(seen) >= target)
+            return std::min(m_max, (bucket + 1) * BucketSeconds);
+    }
+    return m_max;
+}
+
+// Adds the other histogram's samples.
+void DelayHistogram::merge(const DelayHistogram &other)
+{
+    for (int bucket = 0; bucket < BucketCount; ++bucket)
+        m_buckets[bucket] += other.m_buckets[bucket];
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    m_max = std::max(m_max, other.m_max);
+}
+
+// Sample count per bucket.
+const std::vector<std::uint32_t> &DelayHistogram::buckets() const
+{
+    return m_buckets;
+}
+
+// Sum of the samples.
+double DelayHistogram::sum() const
+{
+    return m_sum;
+}
+
+// Replaces the contents; missing buckets are empty.
+void DelayHistogram::setState(const std::vector<std::uint32_t> &buckets, double sum, double max)
+{
+    m_buckets = buckets;
+    m_buckets.resize(BucketCount, 0);
+    m_count = 0;
+    for (std::uint32_t count : m_buckets)
+        m_count += count;
+    m_sum = sum;
+    m_max = max;
+}
+
+// Fills one summary row from a histogram.
+static ApproachSummary summaryRow(const std::string &name, const DelayHistogram &delays, int maxQueue, double hours)
+{
+    ApproachSummary row;
+    row.name = name;
+    row.throughput = delays.count();
+    row.perHour = hours > 0 ? double(delays.count()) / hours : 0.0;
+    row.meanDelay = delays.mean();
+    row.p95Delay = delays.percentile(0.95);
+    row.maxDelay = delays.max();
+    row.maxQueue = maxQueue;
+    return row;
+}
+
+// Collects the per-approach measurements of the simulation into a summary.
+RunSummary summarize(const Simulation &sim)
+{
+    RunSummary summary;
+    summary.simulatedSeconds = double(sim.timeMs() - sim.measuredSinceMs()) / 1000.0;
+    summary.spawned = sim.spawnedCount();
+    summary.despawned = sim.despawnedCount();
+    summary.dropped = sim.droppedCount();
+    summary.conflicts = sim.totalConflicts();
+
+    const double hours = summary.simulatedSeconds / 3600.0;
+    DelayHistogram all;
+    int maxQueue = 0;
+    const std::vector<SimApproach> &approaches = sim.approaches();
+    const std::vector<SimApproachStats> &stats = sim.approachStats();
+    for (std::size_t a = 0; a < approaches.size(); ++a) {
+        summary.approaches.push_back(summaryRow(approaches[a].name, stats[a].delays, stats[a].maxQueue, hours));
+        all.merge(stats[a].delays);
+        maxQueue = std::max(maxQueue, stats[a].maxQueue);
+    }
+    summary.total = summaryRow("total", all, maxQueue, hours);
+    return summary;
+}
+
+// Sums the counters of every region and merges the delays of all their approaches.
+RunSummary summarize(const RoadNetwork &network)
+{
+    RunSummary summary;
+    summary.simulatedSeconds = double(network.timeMs()) / 1000.0;
+    summary.spawned = 0;
+    summary.despawned = 0;
+    summary.dropped = 0;
+    summary.conflicts = 0;
+
+    const double hours = summary.simulatedSeconds / 3600.0;
+    DelayHistogram all;
+    int maxQueue = 0;
+    for (int r = 0; r < network.regionCount(); ++r) {
+        const Simulation &sim = network.region(r);
+        summary.spawned += sim.spawnedCount();
+        summary.despawned += sim.despawnedCount();
+        summary.dropped += sim.droppedCount();
+        summary.conflicts += sim.totalConflicts();
+
+        DelayHistogram region;
+        int regionQueue = 0;
+        for (const SimApproachStats &stats : sim.approachStats()) {
+            region.merge(stats.delays);
+            regionQueue = std::max(regionQueue, stats.maxQueue);
+        }
+        summary.approaches.push_back(summaryRow("region " + std::to_string(r), region, regionQueue, hours));
+        all.merge(region);
+        maxQueue = std::max(maxQueue, regionQueue);
+    }
+    summary.total = summaryRow("total", all, maxQueue, hours);
+    return summary;
+}
@@ -0,0 +1,79 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <cstdint>     // Fixed-width counters
+#include <string>      // Approach names in the summary
+#include <vector>      // Histogram buckets and summary rows
+
+class Simulation;
+class RoadNetwork;
+
+// Fixed-size histogram of delays in seconds, used to report means and percentiles without
+// keeping every sample. Buckets are 0.25 s wide up to 10 minutes; longer delays land in the
+// last bucket and are still counted exactly in the sum and the maximum.
+class DelayHistogram
+{
+public:
+    static constexpr double BucketSeconds = 0.25;
+    static constexpr int BucketCount = 2400;
+
+    DelayHistogram();
+
+    // Records one delay.
+    void add(double seconds);
+
+    // Number of delays recorded, their mean and their maximum.
+    std::uint64_t count() const;
+    double mean() const;
+    double max() const;
+
+    // Delay below which a fraction `p` (0..1) of the samples lie, to bucket precision.
+    double percentile(double p) const;
+
+    // Adds the samples of another histogram to this one.
+    void merge(const DelayHistogram &other);
+
+    // Raw contents, for saving and restoring a histogram. setState() takes the count from the buckets.
+    const std::vector<std::uint32_t> &buckets() const;
+    double sum() const;
+    void setState(const std::vector<std::uint32_t> &buckets, double sum, double max);
+
+private:
+    std::vector<std::uint32_t> m_buckets;  // Sample count per bucket
+    std::uint64_t m_count;                 // Total samples
+    double m_sum;                          // Sum of the samples
+    double m_max;                          // Largest sample
+};
+
+// Summary of one approach over a run.
+struct ApproachSummary
+{
+    std::string name;        // Approach name from the layout
+    std::uint64_t throughput;  // Cars that left the scene
+    double perHour;          // Throughput scaled to cars per hour of simulated time
+    double meanDelay;        // Mean delay in seconds
+    double p95Delay;         // 95th percentile delay in seconds
+    double maxDelay;         // Largest delay in seconds
+    int maxQueue;            // Longest queue (cars stopped or waiting to enter) at any step
+};
+
+// Summary of a whole run, as written by the batch runner.
+struct RunSummary
+{
+    double simulatedSeconds;              // Simulated time covered
+    std::uint64_t spawned;                // Cars spawned
+    std::uint64_t despawned;              // Cars that left the scene
+    std::uint64_t dropped;                // Spawns refused because the vehicle pool was full
+    std::uint64_t conflicts;              // Conflicts detected in the crossing boxes
+    std::vector<ApproachSummary> approaches;  // One row per approach
+    ApproachSummary total;                // All approaches together
+};
+
+// Builds the summary of the simulation's current state.
+RunSummary summarize(const Simulation &sim);
+
+// Builds the summary of a road network, with one row per region instead of per approach.
+// Delays are measured per lane, from one intersection to the next.
+RunSummary summarize(const RoadNetwork &network);
+
+#endif // METRICS_H
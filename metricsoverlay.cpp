@@ -0,0 +1,95 @@
+#include "metricsoverlay.h"   // Header file for the MetricsOverlay class
+#include "telemetry.h"        // Step and frame timings
+#include <QFontDatabase>      // Fixed-width font, so the columns line up
+
+// Formats a duration in nanoseconds with a unit that keeps it short.
+static QString duration(double ns)
+{
+    if (ns >= 1e6)
+        return QString("%1 ms").arg(ns / 1e6, 0, 'f', 2);
+    return QString("%1 us").arg(ns / 1e3, 0, 'f', 1);
+}
+
+// Constructor: a translucent, mouse-transparent label in the corner of the view.
+MetricsOverlay::MetricsOverlay(const Scene *source, QWidget *view)
+    : QLabel(view)
+    , scene(source)
+    , lastTimeMs(0)
+    , lastSpawned(0)
+    , spawnRate(0)
+    , lastFrames(0)
+    , lastPixels(0)
+{
+    setTextFormat(Qt::PlainText);
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    setStyleSheet("QLabel { background-color: rgba(0, 0, 0, 160); color: white; padding: 4px; }");
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+    move(8, 8);
+
+    refreshTimer = new QTimer(this);
+    connect(refreshTimer, &QTimer::timeout, this, &MetricsOverlay::refresh);
+    refreshTimer->start(500);
+    refresh();
+}
+
+// Snapshot figures are per simulation; timings are per process, summed over every thread.
+void MetricsOverlay::refresh()
+{
+    const SimSnapshot &snapshot = scene->snapshot();
+    if (snapshot.timeMs > lastTimeMs) {
+        spawnRate = double(snapshot.spawned - lastSpawned) * 1000.0 / double(snapshot.timeMs - lastTimeMs);
+    } else if (snapshot.timeMs < lastTimeMs) {
+        spawnRate = 0;  // A replay jumped back
+    }
+    lastTimeMs = snapshot.timeMs;
+    lastSpawned = snapshot.spawned;
+
+    QStringList lines;
+    lines << QString("time %1 s   cars %2   spawns %3/s")
+                 .arg(snapshot.timeMs / 1000.0, 0, 'f', 1)
+                 .arg(snapshot.count())
+                 .arg(spawnRate, 0, 'f', 2);
+
+    // Approaches: one row each, or the first ones and the rest summed
+    const int count = int(snapshot.approachThroughput.size());
+    if (count > 0) {
+        lines << QString("%1 %2 %3 %4").arg("approach", -12).arg("out", 7).arg("queue", 6).arg("delay", 8);
+        const QStringList &names = scene->approachNames();
+        quint64 restOut = 0;
+        int restQueue = 0;
+        for (int a = 0; a < count; ++a) {
+            if (a < MaxApproachRows || count == MaxApproachRows + 1) {
+                lines << QString("%1 %2 %3 %4")
+                             .arg(names.value(a).left(12), -12)
+                             .arg(snapshot.approachThroughput[a], 7)
+                             .arg(snapshot.approachQueue[a], 6)
+                             .arg(QString("%1 s").arg(snapshot.approachDelay[a], 0, 'f', 1), 8);
+            } else {
+                restOut += snapshot.approachThroughput[a];
+                restQueue += snapshot.approachQueue[a];
+            }
+        }
+        if (count > MaxApproachRows + 1)
+            lines << QString("%1 %2 %3").arg(QString("+%1 more").arg(count - MaxApproachRows), -12).arg(restOut, 7).arg(restQueue, 6);
+    }
+
+    const TelemetryTotals totals = Telemetry::totals();
+    const DurationHistogram &step = totals.timing(TelemetryTiming::Step);
+    const DurationHistogram &frame = totals.timing(TelemetryTiming::Frame);
+    const quint64 steps = totals.counter(TelemetryCounter::Steps);
+    lines << QString("step  %1 mean  %2 p99").arg(duration(step.mean()), 9).arg(duration(step.percentile(0.99)), 9);
+    lines << QString("frame %1 mean  %2 p99").arg(duration(frame.mean()), 9).arg(duration(frame.percentile(0.99)), 9);
+    lines << QString("frames %1   allocs/step %2")
+                 .arg(totals.counter(TelemetryCounter::Frames))
+                 .arg(steps ? double(totals.counter(TelemetryCounter::Allocations)) / double(steps) : 0.0, 0, 'f', 3);
+
+    // Repainted pixels per frame since the last refresh: what dirty-region repainting saves
+    const quint64 frames = totals.counter(TelemetryCounter::Frames) - lastFrames;
+    const quint64 pixels = totals.counter(TelemetryCounter::RepaintedPixels) - lastPixels;
+    lastFrames = totals.counter(TelemetryCounter::Frames);
+    lastPixels = totals.counter(TelemetryCounter::RepaintedPixels);
+    lines << QString("repaint %1 px/frame").arg(frames ? pixels / frames : 0);
+
+    setText(lines.join('\n'));
+    adjustSize();
+}
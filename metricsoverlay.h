@@ -0,0 +1,42 @@
+#ifndef METRICSOVERLAY_H
+#define METRICSOVERLAY_H
+
+// Including necessary Qt classes
+#include <QLabel>     // The overlay is a translucent label over the view
+#include <QTimer>     // Refreshes the figures
+#include "scene.h"    // Source of the snapshot and approach names
+
+// Figures of the running simulation drawn over the top-left corner of a view: simulated time,
+// cars alive, spawn rate, per-approach throughput, queue and delay from the scene's snapshot,
+// and the step and frame timings, frame count, repainted pixels and allocations per step from
+// the telemetry.
+// It ignores the mouse, so the view under it still pans.
+class MetricsOverlay : public QLabel
+{
+    Q_OBJECT
+
+public:
+    // Approaches listed one per line; further ones are summed into a single line.
+    static constexpr int MaxApproachRows = 8;
+
+    // Constructor: shows the figures of `source` over `view` and refreshes them twice per second.
+    MetricsOverlay(const Scene *source, QWidget *view);
+
+private:
+    // Rewrites the text from the current snapshot and telemetry totals.
+    void refresh();
+
+    const Scene *scene;
+    QTimer *refreshTimer;
+
+    // Snapshot figures at the previous refresh, for the spawn rate
+    qint64 lastTimeMs;
+    quint64 lastSpawned;
+    double spawnRate;   // Spawns per simulated second over the last refresh
+
+    // Telemetry totals at the previous refresh, for the repainted pixels per frame
+    quint64 lastFrames;
+    quint64 lastPixels;
+};
+
+#endif // METRICSOVERLAY_H
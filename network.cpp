@@ -0,0 +1,310 @@
+#include "network.h"            // Header file for the RoadNetwork class
+#include <algorithm>            // std::min, std::max
+#include <condition_variable>   // Barrier between the phases of a tick
+#include <mutex>
+#include <string>               // Approach names
+#include <thread>               // Worker threads
+
+// Directions of travel. The incoming lane of an intersection is named after the direction
+// its cars move in, e.g. the Eastbound lane enters from the west.
+enum Direction { Eastbound = 0, Westbound = 1, Southbound = 2, Northbound = 3, DirectionCount = 4 };
+
+// Unit vector, and the car sprite of the original crossing that faces that way.
+struct DirectionInfo
+{
+    int dx, dy;             // Direction of travel
+    const char *name;       // Used in approach names
+    int sprite;             // Sprite id, scale, rotation and car length, as in loadDefaultCross
+    double scale, rotation, carLength;
+};
+
+static const DirectionInfo directions[DirectionCount] = {
+    { 1, 0, "eastbound", 3, 0.29, -90, 135},
+    {-1, 0, "westbound", 2, 0.30, 90, 140},
+    { 0, 1, "southbound", 1, 0.27, 180, 116},
+    { 0, -1, "northbound", 0, 0.10, 0, 102},
+};
+
+// Reusable barrier for a fixed number of threads (std::barrier needs C++20).
+class Barrier
+{
+public:
+    explicit Barrier(int count) : m_count(count), m_waiting(0), m_generation(0) {}
+
+    // Blocks until `count` threads have arrived.
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const std::uint64_t generation = m_generation;
+        if (++m_waiting == m_count) {
+            m_waiting = 0;
+            ++m_generation;
+            m_condition.notify_all();
+            return;
+        }
+        m_condition.wait(lock, [&] { return m_generation != generation; });
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    int m_count;                // Threads taking part
+    int m_waiting;              // Threads arrived in the current generation
+    std::uint64_t m_generation; // Completed rounds
+};
+
+// Default grid: 16x16 intersections in 4x4 regions, with the timing of the original crossing.
+NetworkConfig::NetworkConfig()
+    : columns(16)
+    , rows(16)
+    , spacing(1000)
+    , boxSize(360)
+    , entryLength(600)
+    , speed(290)
+    , phaseMs(7000)
+    , greenWaveMs(0)
+    , control(SignalControl::FixedTime)
+    , meanArrivalMs(6000)
+    , regionColumns(4)
+    , regionRows(4)
+{
+}
+
+// Constructor: the regions are filled in by build().
+RoadNetwork::RoadNetwork(const NetworkConfig &config, std::uint64_t seed)
+    : m_config(config)
+{
+    m_config.columns = std::max(1, m_config.columns);
+    m_config.rows = std::max(1, m_config.rows);
+    m_config.regionColumns = std::max(1, std::min(m_config.regionColumns, m_config.columns));
+    m_config.regionRows = std::max(1, std::min(m_config.regionRows, m_config.rows));
+    build(seed);
+}
+
+// Regions are rectangular blocks of intersections.
+int RoadNetwork::regionOf(int column, int row) const
+{
+    const int rc = column * m_config.regionColumns / m_config.columns;
+    const int rr = row * m_config.regionRows / m_config.rows;
+    return rr * m_config.regionColumns + rc;
+}
+
+// Every intersection gets a two-phase junction, a light and an approach per incoming lane, and
+// its crossing box as conflict zone. Lanes run from the exit of the previous box (or from
+// outside the grid) to the exit of their own box, with the stop line at the box entry.
+void RoadNetwork::build(std::uint64_t seed)
+{
+    const int regionCount = m_config.regionColumns * m_config.regionRows;
+    m_regions.reserve(regionCount);
+    for (int r = 0; r < regionCount; ++r)
+        m_regions.emplace_back(Rng(seed, std::uint64_t(r)).next());
+
+    const double half = m_config.boxSize / 2;
+    const double side = m_config.boxSize / 4;       // Distance of a lane from the road centre line (opposite
+                                                    // lanes must be further apart than a car is wide)
+    const int cycleMs = 2 * m_config.phaseMs;
+
+    // Area of each region, for its spatial grid
+    std::vector<double> minX(regionCount, 1e300), minY(regionCount, 1e300);
+    std::vector<double> maxX(regionCount, -1e300), maxY(regionCount, -1e300);
+
+    m_incoming.assign(std::size_t(m_config.columns) * m_config.rows * DirectionCount, LaneRef{-1, -1});
+    for (int row = 0; row < m_config.rows; ++row) {
+        for (int column = 0; column < m_config.columns; ++column) {
+            const int r = regionOf(column, row);
+            Simulation &sim = m_regions[r];
+            const double cx = column * m_config.spacing;
+            const double cy = row * m_config.spacing;
+
+            int j = sim.addJunction(2, m_config.phaseMs);
+            sim.setSignalControl(j, m_config.control, m_config.timing);
+            if (m_config.greenWaveMs > 0)
+                sim.setPhaseOffset(j, int((std::int64_t(column + row) * m_config.greenWaveMs) % cycleMs));
+
+            for (int d = 0; d < DirectionCount; ++d) {
+                const DirectionInfo &info = directions[d];
+
+                // Lanes keep to the right of the centre line
+                const double offsetX = -info.dy * side;
+                const double offsetY = info.dx * side;
+
+                // Lanes from a neighbouring intersection start at its box exit; the others come from outside
+                const int fromColumn = column - info.dx;
+                const int fromRow = row - info.dy;
+                const bool inside = fromColumn >= 0 && fromColumn < m_config.columns && fromRow >= 0
+                                    && fromRow < m_config.rows;
+                const double approachLength = inside ? m_config.spacing - m_config.boxSize : m_config.entryLength;
+
+                const double x0 = cx + offsetX - info.dx * (approachLength + half);
+                const double y0 = cy + offsetY - info.dy * (approachLength + half);
+                const double x1 = cx + offsetX + info.dx * half;
+                const double y1 = cy + offsetY + info.dy * half;
+                const double length = approachLength + m_config.boxSize;
+
+                // Phase 0 gives green to the east-west lanes, phase 1 to the north-south ones
+                const int phase = info.dx != 0 ? 0 : 1;
+                int light = sim.addLight(j, phase, cx + offsetX - info.dx * half, cy + offsetY - info.dy * half,
+                                         info.dx != 0 ? 90 : 0);
+
+                int a = sim.addApproach(j, "r" + std::to_string(row) + "c" + std::to_string(column) + " " + info.name);
+                if (inside)
+                    sim.setNoArrivals(a);
+                else
+                    sim.setExponentialArrivals(a, m_config.meanArrivalMs);
+
+                int lane = sim.addLane(a, x0, y0, x1, y1, length / m_config.speed * 1000.0, info.sprite, info.scale,
+                                       info.rotation, info.carLength);
+                sim.setStopLine(lane, light, approachLength);
+
+                // The position is the front of the car; the body trails behind it, centred on the lane
+                const double width = m_config.boxSize / 6;
+                const double bodyX = info.dx != 0 ? (info.dx > 0 ? -info.carLength : 0) : -width / 2;
+                const double bodyY = info.dy != 0 ? (info.dy > 0 ? -info.carLength : 0) : -width / 2;
+                sim.setCarBody(lane, bodyX, bodyY, info.dx != 0 ? info.carLength : width,
+                               info.dy != 0 ? info.carLength : width);
+
+                m_incoming[(std::size_t(row) * m_config.columns + column) * DirectionCount + d] = LaneRef{r, lane};
+                minX[r] = std::min({minX[r], x0, x1});
+                minY[r] = std::min({minY[r], y0, y1});
+                maxX[r] = std::max({maxX[r], x0, x1});
+                maxY[r] = std::max({maxY[r], y0, y1});
+            }
+
+            sim.addConflictZone(j, cx - half, cy - half, cx + half, cy + half);
+        }
+    }
+
+    // Cars crossing an intersection continue straight on to the next one, or leave the grid
+    for (int row = 0; row < m_config.rows; ++row) {
+        for (int column = 0; column < m_config.columns; ++column) {
+            for (int d = 0; d < DirectionCount; ++d) {
+                const int nextColumn = column + directions[d].dx;
+                const int nextRow = row + directions[d].dy;
+                if (nextColumn < 0 || nextColumn >= m_config.columns || nextRow < 0 || nextRow >= m_config.rows)
+                    continue;
+                const LaneRef from = m_incoming[(std::size_t(row) * m_config.columns + column) * DirectionCount + d];
+                const LaneRef to = m_incoming[(std::size_t(nextRow) * m_config.columns + nextColumn) * DirectionCount + d];
+                m_regions[from.region].setLaneExit(from.lane, to.region == from.region ? -1 : to.region, to.lane);
+            }
+        }
+    }
+
+    // Cars are sparse over a region, so cells of about a car keep the index small
+    for (int r = 0; r < regionCount; ++r) {
+        const double margin = 200;
+        m_regions[r].setGridBounds(float(minX[r] - margin), float(minY[r] - margin),
+                                   float(maxX[r] - minX[r] + 2 * margin), float(maxY[r] - minY[r] + 2 * margin), 128);
+    }
+}
+
+// Starts every region.
+void RoadNetwork::start()
+{
+    for (Simulation &sim : m_regions)
+        sim.start();
+}
+
+// Steps one share of the regions, after dropping the hand-offs delivered last tick.
+void RoadNetwork::stepRegions(int worker, int workers)
+{
+    for (int r = worker; r < int(m_regions.size()); r += workers) {
+        m_regions[r].clearOutbox();
+        m_regions[r].step();
+    }
+}
+
+// Each target region reads every outbox in region order, so the arrival order is fixed.
+void RoadNetwork::deliver(int worker, int workers)
+{
+    for (int target = worker; target < int(m_regions.size()); target += workers) {
+        Simulation &sim = m_regions[target];
+        for (const Simulation &source : m_regions) {
+            for (const SimHandoff &handoff : source.outbox()) {
+                if (handoff.region == target)
+                    sim.receive(handoff.lane);
+            }
+        }
+    }
+}
+
+// One tick on the calling thread.
+void RoadNetwork::step()
+{
+    stepRegions(0, 1);
+    deliver(0, 1);
+}
+
+// Ticks in lock step: step, barrier, deliver, barrier.
+void RoadNetwork::run(std::int64_t steps, int threads)
+{
+    if (threads <= 0)
+        threads = int(std::max(1u, std::thread::hardware_concurrency()));
+    threads = std::max(1, std::min(threads, int(m_regions.size())));
+    if (threads == 1) {
+        for (std::int64_t i = 0; i < steps; ++i)
+            step();
+        return;
+    }
+
+    Barrier barrier(threads);
+    auto worker = [&](int self) {
+        for (std::int64_t i = 0; i < steps; ++i) {
+            stepRegions(self, threads);
+            barrier.wait();     // Every outbox of this tick is complete
+            deliver(self, threads);
+            barrier.wait();     // Every outbox has been read and may be cleared
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; ++t)
+        pool.emplace_back(worker, t);
+    worker(0);  // The calling thread works too
+    for (std::thread &thread : pool)
+        thread.join();
+}
+
+// Grid parameters after clamping.
+const NetworkConfig &RoadNetwork::config() const
+{
+    return m_config;
+}
+
+// Number of intersections.
+int RoadNetwork::intersectionCount() const
+{
+    return m_config.columns * m_config.rows;
+}
+
+// Number of regions.
+int RoadNetwork::regionCount() const
+{
+    return int(m_regions.size());
+}
+
+// Simulation of one region.
+const Simulation &RoadNetwork::region(int r) const
+{
+    return m_regions[r];
+}
+
+// Every region runs the same ticks, so any of them gives the network clock.
+std::int64_t RoadNetwork::timeMs() const
+{
+    return m_regions.front().timeMs();
+}
+
+// Cars alive in the pools plus cars between two lanes; new arrivals queued outside the grid have
+// not entered yet.
+std::uint64_t RoadNetwork::carsInNetwork() const
+{
+    std::uint64_t count = 0;
+    for (const Simulation &sim : m_regions) {
+        count += std::uint64_t(sim.vehicles().size());
+        for (const SimLane &lane : sim.lanes()) {
+            for (const SimArrival &arrival : lane.waiting)
+                count += arrival.transfer ? 1 : 0;
+        }
+    }
+    return count;
+}
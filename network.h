@@ -0,0 +1,93 @@
+#ifndef NETWORK_H
+#define NETWORK_H
+
+#include <cstdint>        // Seeds and step counts
+#include <vector>         // Regions and lane tables
+#include "simulation.h"   // Each region is a Simulation of its own
+
+// Parameters of a square city grid of signalised intersections.
+struct NetworkConfig
+{
+    int columns;            // Intersections per row
+    int rows;               // Intersections per column
+    double spacing;         // Distance between neighbouring intersections
+    double boxSize;         // Side of the crossing box of each intersection
+    double entryLength;     // Length of the lanes feeding the grid from outside
+    double speed;           // Free-flow speed on every lane, scene units per second
+    int phaseMs;            // Duration of each of the two phases (east-west green, then north-south)
+    int greenWaveMs;        // Offset added per intersection along the diagonal, to coordinate the lights
+    SignalControl control;  // Policy of every intersection's lights
+    SignalTiming timing;    // Its limits, for actuated and max-pressure control
+    int meanArrivalMs;      // Mean interval of the (Poisson) arrivals on each entry lane
+    int regionColumns;      // The grid is cut into regionColumns x regionRows rectangular regions
+    int regionRows;
+
+    NetworkConfig();
+};
+
+// Grid of intersections simulated as several regions in parallel.
+//
+// Every intersection has four incoming lanes, one per direction, and cars drive straight on.
+// A lane belongs to the region of the intersection it leads to, so each region is an
+// ordinary Simulation holding its junctions and the lanes approaching them. When a car
+// crosses an intersection it continues on the lane towards the next one: inside a region
+// the lanes are linked directly, across a region boundary the car goes through the source
+// region's outbox and is delivered to the target region between two steps.
+//
+// One tick runs in two phases separated by barriers: every worker steps its own regions,
+// then every worker collects the hand-offs addressed to its regions from all outboxes, in
+// region order. Regions only read each other's outboxes, and always in the same order, so
+// the result depends on the seed and the partition, never on the number of threads.
+class RoadNetwork
+{
+public:
+    // Constructor: builds the grid and its regions. Region r draws its random numbers from
+    // its own stream of `seed`.
+    explicit RoadNetwork(const NetworkConfig &config, std::uint64_t seed = 0);
+
+    // Starts the light cycles and the arrivals of every region.
+    void start();
+
+    // Runs `steps` ticks on `threads` worker threads (<= 0 uses every hardware thread;
+    // never more threads than regions). The calling thread is one of the workers.
+    void run(std::int64_t steps, int threads);
+
+    // Runs one tick on the calling thread.
+    void step();
+
+    // Layout and state.
+    const NetworkConfig &config() const;
+    int intersectionCount() const;
+    int regionCount() const;
+    const Simulation &region(int r) const;
+    std::int64_t timeMs() const;
+
+    // Cars currently on the road or queued to enter the next lane, over all regions.
+    std::uint64_t carsInNetwork() const;
+
+private:
+    // Where the lane leading into an intersection from one direction lives.
+    struct LaneRef
+    {
+        int region;     // Region owning the lane
+        int lane;       // Lane index in that region's simulation
+    };
+
+    // Builds the lanes, lights and junctions of every intersection, then links the lanes.
+    void build(std::uint64_t seed);
+
+    // Region of the intersection at (column, row).
+    int regionOf(int column, int row) const;
+
+    // Steps the regions of `worker` (every `workers`-th region starting at `worker`).
+    void stepRegions(int worker, int workers);
+
+    // Delivers to the regions of `worker` the cars waiting in every outbox for them.
+    void deliver(int worker, int workers);
+
+    NetworkConfig m_config;             // Grid parameters
+    std::vector<Simulation> m_regions;  // One simulation per region
+    std::vector<LaneRef> m_incoming;    // Incoming lane per intersection and direction
+};
+
+#endif // NETWORK_H
@@ -0,0 +1,397 @@
+#include "recorder.h"     // Header file for the TrajectoryRecorder class
+#include "simulation.h"   // The simulation being recorded
+#include <cmath>          // std::lround for the position quantisation
+#include <cstring>        // std::memcpy
+
+// Little-endian and variable-length encoding into a byte vector.
+static void putU32(std::vector<std::uint8_t> &out, std::uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        out.push_back(std::uint8_t(value >> (8 * i)));
+}
+
+static void putI64(std::vector<std::uint8_t> &out, std::int64_t value)
+{
+    putU32(out, std::uint32_t(std::uint64_t(value)));
+    putU32(out, std::uint32_t(std::uint64_t(value) >> 32));
+}
+
+static void putF32(std::vector<std::uint8_t> &out, double value)
+{
+    float f = float(value);
+    std::uint32_t bits;
+    std::memcpy(&bits, &f, sizeof bits);
+    putU32(out, bits);
+}
+
+static void putVarint(std::vector<std::uint8_t> &out, std::uint64_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(std::uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(std::uint8_t(value));
+}
+
+static void putZigzag(std::vector<std::uint8_t> &out, std::int64_t value)
+{
+    putVarint(out, (std::uint64_t(value) << 1) ^ std::uint64_t(value >> 63));
+}
+
+// Constructor: nothing is open yet.
+TrajectoryRecorder::TrajectoryRecorder()
+    : m_file(nullptr)
+    , m_closing(false)
+    , m_dropWhenFull(false)
+    , m_recorded(0)
+    , m_dropped(0)
+    , m_frameNumber(0)
+    , m_chunkFirstMs(0)
+    , m_chunkLastMs(0)
+    , m_chunkFrames(0)
+    , m_bytes(0)
+{
+}
+
+// Destructor: a recorder going out of scope still leaves a complete file.
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+    close();
+}
+
+// Header, then the writer thread.
+bool TrajectoryRecorder::open(const std::string &path, const Simulation &sim)
+{
+    close();
+    m_error.clear();
+    m_file = std::fopen(path.c_str(), "wb");
+    if (!m_file) {
+        m_error = "cannot create " + path;
+        return false;
+    }
+
+    std::vector<std::uint8_t> header(TrajectoryMagic, TrajectoryMagic + sizeof TrajectoryMagic);
+    putU32(header, Simulation::TickMs);
+    putU32(header, Quantum);
+    putU32(header, std::uint32_t(sim.lanes().size()));
+    putU32(header, std::uint32_t(sim.lights().size()));
+    m_stopS.clear();
+    for (const SimLane &lane : sim.lanes()) {
+        for (double value : {lane.x0, lane.y0, lane.x1, lane.y1, lane.carLength, lane.scale, lane.rotation,
+                             lane.bodyX, lane.bodyY, lane.bodyW, lane.bodyH})
+            putF32(header, value);
+        header.push_back(std::uint8_t(lane.sprite));
+        m_stopS.push_back(lane.light >= 0 ? lane.stopS : -1);
+    }
+    for (const SimLight &light : sim.lights()) {
+        putF32(header, light.x);
+        putF32(header, light.y);
+        putF32(header, light.rotation);
+    }
+    m_bytes = 0;
+    write(header.data(), header.size());
+
+    // Writer state starts empty: the first frame is a keyframe with every car new
+    m_slotLive.clear();
+    m_liveSlots.clear();
+    m_lights.clear();
+    m_frameNumber = 0;
+    m_chunk.clear();
+    m_chunkFrames = 0;
+
+    m_frames.assign(MaxQueuedFrames, Frame());
+    m_free.clear();
+    for (int i = MaxQueuedFrames - 1; i >= 0; --i)
+        m_free.push_back(i);
+    m_queued.clear();
+    m_closing = false;
+    m_recorded = 0;
+    m_dropped = 0;
+    m_thread = std::thread(&TrajectoryRecorder::run, this);
+    return m_error.empty();
+}
+
+// Overflow policy.
+void TrajectoryRecorder::setDropWhenFull(bool drop)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_dropWhenFull = drop;
+}
+
+// Copies the live slots into a free buffer, waiting for one or dropping the frame if there is none.
+void TrajectoryRecorder::record(const Simulation &sim)
+{
+    int index;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_file)
+            return;
+        if (m_free.empty() && m_dropWhenFull) {
+            ++m_dropped;
+            return;
+        }
+        m_freed.wait(lock, [this] { return !m_free.empty(); });
+        index = m_free.back();
+        m_free.pop_back();
+    }
+
+    // The buffer belongs to this thread until it is queued; its arrays keep their capacity
+    Frame &frame = m_frames[index];
+    const VehiclePool &pool = sim.vehicles();
+    frame.timeMs = sim.timeMs();
+    frame.slot.clear();
+    frame.id.clear();
+    frame.lane.clear();
+    frame.state.clear();
+    frame.x.clear();
+    frame.y.clear();
+    frame.s.clear();
+    for (int i = 0; i < pool.highWater(); ++i) {
+        if (pool.state[i] == VehiclePool::Free)
+            continue;
+        frame.slot.push_back(i);
+        frame.id.push_back(pool.id[i]);
+        frame.lane.push_back(pool.lane[i]);
+        frame.state.push_back(pool.state[i]);
+        frame.x.push_back(pool.x[i]);
+        frame.y.push_back(pool.y[i]);
+        frame.s.push_back(pool.s[i]);
+    }
+    frame.lightGreen.resize(sim.lights().size());
+    for (std::size_t l = 0; l < frame.lightGreen.size(); ++l)
+        frame.lightGreen[l] = sim.lights()[l].green ? 1 : 0;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queued.push_back(index);
+        ++m_recorded;
+    }
+    m_wake.notify_one();
+}
+
+// Drains the queue, then stops the writer and closes the file.
+bool TrajectoryRecorder::close()
+{
+    if (!m_thread.joinable())
+        return m_error.empty();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closing = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (std::fclose(m_file) != 0 && m_error.empty())
+        m_error = "cannot write the trajectory file";
+    m_file = nullptr;
+    return m_error.empty();
+}
+
+// First error, if any.
+const std::string &TrajectoryRecorder::error() const
+{
+    return m_error;
+}
+
+// Frames queued for writing.
+std::uint64_t TrajectoryRecorder::recordedFrames() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_recorded;
+}
+
+// Frames lost because the writer was behind.
+std::uint64_t TrajectoryRecorder::droppedFrames() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dropped;
+}
+
+// Header and chunks written.
+std::uint64_t TrajectoryRecorder::bytesWritten() const
+{
+    return m_bytes;
+}
+
+// Encodes queued frames in order until close() and an empty queue.
+void TrajectoryRecorder::run()
+{
+    for (;;) {
+        int index;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_closing || !m_queued.empty(); });
+            if (m_queued.empty())
+                break;  // Closing, and everything was written
+            index = m_queued.front();
+            m_queued.pop_front();
+        }
+
+        encode(m_frames[index]);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_free.push_back(index);
+        }
+        m_freed.notify_one();
+    }
+    flushChunk();
+}
+
+// Compares the frame with the previous one slot by slot: a slot whose id changed or that is no
+// longer listed lost its car (despawn), one not listed before or with a new id gained one (spawn),
+// and a car listed on another lane than before turned.
+void TrajectoryRecorder::encode(const Frame &frame)
+{
+    const bool keyframe = m_chunkFrames == 0;
+    if (keyframe)
+        m_chunkFirstMs = frame.timeMs;
+    ++m_frameNumber;
+
+    // Grow the per-slot tables to the highest slot of this frame
+    const std::size_t slots = frame.slot.empty() ? 0 : std::size_t(frame.slot.back()) + 1;
+    if (slots > m_slotLive.size()) {
+        m_slotLive.resize(slots, 0);
+        m_slotId.resize(slots);
+        m_slotLane.resize(slots);
+        m_slotState.resize(slots);
+        m_slotX.resize(slots);
+        m_slotY.resize(slots);
+        m_slotS.resize(slots);
+        m_slotSeen.resize(slots, 0);
+        m_slotIndex.resize(slots);
+    }
+    const int count = int(frame.slot.size());
+    for (int k = 0; k < count; ++k) {
+        m_slotSeen[frame.slot[k]] = m_frameNumber;
+        m_slotIndex[frame.slot[k]] = k;
+    }
+
+    m_events.clear();
+    auto event = [this](TrajectoryEventKind kind, std::uint32_t id, std::int32_t lane) {
+        m_events.push_back(std::uint8_t(kind));
+        putVarint(m_events, id);
+        putVarint(m_events, std::uint64_t(lane));
+    };
+    int events = 0;
+
+    // Cars gone since the previous frame
+    for (std::int32_t slot : m_liveSlots) {
+        const bool sameCar = m_slotSeen[slot] == m_frameNumber && frame.id[m_slotIndex[slot]] == m_slotId[slot];
+        if (!sameCar) {
+            event(TrajectoryEventKind::Despawn, m_slotId[slot], m_slotLane[slot]);
+            ++events;
+            m_slotLive[slot] = 0;
+        }
+    }
+
+    // Cars, with their spawn, stop and stop-line events
+    m_cars.clear();
+    putVarint(m_cars, std::uint64_t(count));
+    std::int32_t previousSlot = -1;
+    m_liveSlots.clear();
+    for (int k = 0; k < count; ++k) {
+        const std::int32_t slot = frame.slot[k];
+        const bool known = m_slotLive[slot] && m_slotId[slot] == frame.id[k];
+        const bool turned = known && m_slotLane[slot] != frame.lane[k];
+        const std::int32_t qx = std::int32_t(std::lround(frame.x[k] * Quantum));
+        const std::int32_t qy = std::int32_t(std::lround(frame.y[k] * Quantum));
+
+        if (!known) {
+            event(TrajectoryEventKind::Spawn, frame.id[k], frame.lane[k]);
+            ++events;
+        }
+        if (turned) {
+            event(TrajectoryEventKind::Turn, frame.id[k], frame.lane[k]);
+            ++events;
+        }
+        if (frame.state[k] == VehiclePool::Stopped && (!known || m_slotState[slot] != VehiclePool::Stopped)) {
+            event(TrajectoryEventKind::Stop, frame.id[k], frame.lane[k]);
+            ++events;
+        }
+        const double stopS = m_stopS[frame.lane[k]];
+        if (known && !turned && stopS >= 0 && m_slotS[slot] < stopS && frame.s[k] >= stopS) {
+            event(TrajectoryEventKind::Cross, frame.id[k], frame.lane[k]);
+            ++events;
+        }
+
+        putVarint(m_cars, std::uint64_t(slot - previousSlot - 1));
+        const bool full = keyframe || !known || turned;
+        m_cars.push_back(std::uint8_t((full ? 1 : 0) | (frame.state[k] & 3) << 1));
+        if (full) {
+            putVarint(m_cars, frame.id[k]);
+            putVarint(m_cars, std::uint64_t(frame.lane[k]));
+            putZigzag(m_cars, qx);
+            putZigzag(m_cars, qy);
+        } else {
+            putZigzag(m_cars, std::int64_t(qx) - m_slotX[slot]);
+            putZigzag(m_cars, std::int64_t(qy) - m_slotY[slot]);
+        }
+        previousSlot = slot;
+
+        m_slotLive[slot] = 1;
+        m_slotId[slot] = frame.id[k];
+        m_slotLane[slot] = frame.lane[k];
+        m_slotState[slot] = frame.state[k];
+        m_slotX[slot] = qx;
+        m_slotY[slot] = qy;
+        m_slotS[slot] = frame.s[k];
+        m_liveSlots.push_back(slot);
+    }
+
+    // A keyframe restates every light, so its real changes go in as events
+    const bool allLights = keyframe || m_lights.size() != frame.lightGreen.size();
+    if (keyframe && m_lights.size() == frame.lightGreen.size()) {
+        for (std::size_t l = 0; l < frame.lightGreen.size(); ++l) {
+            if (m_lights[l] != frame.lightGreen[l]) {
+                event(TrajectoryEventKind::LightChange, std::uint32_t(l), frame.lightGreen[l]);
+                ++events;
+            }
+        }
+    }
+
+    // Frame: time step, lights, events, cars
+    putVarint(m_chunk, keyframe ? 0 : std::uint64_t(frame.timeMs - m_chunkLastMs));
+    int lightChanges = 0;
+    for (std::size_t l = 0; l < frame.lightGreen.size(); ++l)
+        lightChanges += allLights || m_lights[l] != frame.lightGreen[l];
+    putVarint(m_chunk, std::uint64_t(lightChanges));
+    for (std::size_t l = 0; l < frame.lightGreen.size(); ++l) {
+        if (allLights || m_lights[l] != frame.lightGreen[l])
+            putVarint(m_chunk, std::uint64_t(l) << 1 | frame.lightGreen[l]);
+    }
+    m_lights = frame.lightGreen;
+    putVarint(m_chunk, std::uint64_t(events));
+    m_chunk.insert(m_chunk.end(), m_events.begin(), m_events.end());
+    m_chunk.insert(m_chunk.end(), m_cars.begin(), m_cars.end());
+
+    m_chunkLastMs = frame.timeMs;
+    if (++m_chunkFrames == FramesPerChunk)
+        flushChunk();
+}
+
+// Chunk header and payload.
+void TrajectoryRecorder::flushChunk()
+{
+    if (m_chunkFrames == 0)
+        return;
+    std::vector<std::uint8_t> header;
+    putU32(header, TrajectoryChunkMagic);
+    putU32(header, std::uint32_t(m_chunk.size()));
+    putI64(header, m_chunkFirstMs);
+    putI64(header, m_chunkLastMs);
+    putU32(header, m_chunkFrames);
+    write(header.data(), header.size());
+    write(m_chunk.data(), m_chunk.size());
+    m_chunk.clear();
+    m_chunkFrames = 0;
+}
+
+// Raw write; the first failure is kept for close() to report.
+void TrajectoryRecorder::write(const void *data, std::size_t size)
+{
+    if (std::fwrite(data, 1, size, m_file) != size && m_error.empty())
+        m_error = "cannot write the trajectory file";
+    m_bytes += size;
+}
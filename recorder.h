@@ -0,0 +1,128 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <condition_variable>  // Wakes the writer thread
+#include <cstdint>             // Counters and clock values
+#include <cstdio>              // Output file
+#include <deque>               // Frames waiting to be written
+#include <mutex>
+#include <string>              // Path and error message
+#include <thread>              // Writer thread
+#include <vector>              // Frame buffers and per-slot tables
+#include "trajectory.h"        // File format
+
+class Simulation;
+
+// Streams the cars and lights of a simulation to a trajectory file (format in trajectory.h).
+//
+// record() runs on the simulation thread and only copies the live slots into a frame buffer
+// taken from a fixed pool; a writer thread derives the events, delta-encodes the frames into
+// chunks and writes them, so file I/O and encoding never run on the simulation thread and
+// memory never exceeds MaxQueuedFrames buffers. When the writer falls behind and every buffer
+// is in use, record() waits for one by default, which keeps a batch recording complete; with
+// setDropWhenFull(true), e.g. next to a real-time display, it drops the frame instead. Dropped
+// frames are counted; the file stays decodable, and events spanning a gap are reported at the
+// next recorded frame.
+class TrajectoryRecorder
+{
+public:
+    // Frames per chunk: with one frame per 20 ms step, a chunk covers one second.
+    static constexpr int FramesPerChunk = 50;
+
+    // Frame buffers shared by the simulation and the writer.
+    static constexpr int MaxQueuedFrames = 256;
+
+    // Positions are stored in 1/Quantum scene units.
+    static constexpr int Quantum = 8;
+
+    TrajectoryRecorder();
+
+    // Destructor: closes the file if still open.
+    ~TrajectoryRecorder();
+
+    TrajectoryRecorder(const TrajectoryRecorder &) = delete;
+    TrajectoryRecorder &operator=(const TrajectoryRecorder &) = delete;
+
+    // Creates `path`, writes the header with the lanes and lights of `sim`, and starts the writer.
+    // Returns false and sets error() if the file cannot be written.
+    bool open(const std::string &path, const Simulation &sim);
+
+    // Whether record() drops frames rather than waiting when every buffer is queued.
+    void setDropWhenFull(bool drop);
+
+    // Queues the current state of `sim` (simulation thread).
+    void record(const Simulation &sim);
+
+    // Writes everything queued, closes the file and stops the writer. Returns false and sets
+    // error() if a write failed along the way.
+    bool close();
+
+    const std::string &error() const;
+
+    // Frames recorded and dropped so far, and bytes written (complete once closed).
+    std::uint64_t recordedFrames() const;
+    std::uint64_t droppedFrames() const;
+    std::uint64_t bytesWritten() const;
+
+private:
+    // Live slots of one step, as copied by record().
+    struct Frame
+    {
+        std::int64_t timeMs;
+        std::vector<std::int32_t> slot;
+        std::vector<std::uint32_t> id;
+        std::vector<std::int32_t> lane;
+        std::vector<std::uint8_t> state;
+        std::vector<float> x, y, s;
+        std::vector<std::uint8_t> lightGreen;
+    };
+
+    // Writer thread body.
+    void run();
+
+    // Derives the events of `frame` and appends it to the current chunk (writer thread).
+    void encode(const Frame &frame);
+
+    // Writes the current chunk, if any (writer thread).
+    void flushChunk();
+
+    // Appends raw bytes to the file, remembering the first failure.
+    void write(const void *data, std::size_t size);
+
+    std::FILE *m_file;
+    std::string m_error;
+    std::thread m_thread;
+
+    // Frame pool, shared under m_mutex
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;     // Frames queued, or closing
+    std::condition_variable m_freed;    // A buffer went back to the pool
+    std::vector<Frame> m_frames;
+    std::vector<int> m_free;            // Buffers record() may fill
+    std::deque<int> m_queued;           // Filled buffers, oldest first
+    bool m_closing;
+    bool m_dropWhenFull;
+    std::uint64_t m_recorded;
+    std::uint64_t m_dropped;
+
+    // Writer state
+    std::vector<double> m_stopS;        // Stop line per lane, -1 if none
+    std::vector<std::uint8_t> m_slotLive;   // Per slot, as of the previous frame
+    std::vector<std::uint32_t> m_slotId;
+    std::vector<std::int32_t> m_slotLane;
+    std::vector<std::uint8_t> m_slotState;
+    std::vector<std::int32_t> m_slotX, m_slotY;
+    std::vector<float> m_slotS;
+    std::vector<std::uint32_t> m_slotSeen;  // Frame number that last listed the slot
+    std::vector<std::int32_t> m_slotIndex;  // Position of the slot in that frame
+    std::vector<std::int32_t> m_liveSlots;  // Slots of the previous frame
+    std::vector<std::uint8_t> m_lights;     // Light states of the previous frame
+    std::uint32_t m_frameNumber;
+    std::vector<std::uint8_t> m_events, m_cars;  // Sections of the frame being encoded
+    std::vector<std::uint8_t> m_chunk;      // Payload of the current chunk
+    std::int64_t m_chunkFirstMs, m_chunkLastMs;
+    std::uint32_t m_chunkFrames;
+    std::uint64_t m_bytes;
+};
+
+#endif // RECORDER_H
@@ -0,0 +1,130 @@
+#include "replay.h"     // Header file for the TrajectoryReplay class
+#include <algorithm>    // std::upper_bound, std::min, std::max
+
+// Reads the header, then rebuilds the lanes and lights it lists in a layout-only simulation.
+TrajectoryReplay::TrajectoryReplay(const std::uint8_t *data, std::size_t size)
+    : m_reader(data, size)
+    , m_chunk(-1)
+    , m_hasNext(false)
+    , m_shownChunk(-1)
+    , m_shownFrame(-1)
+{
+    if (!m_reader.isValid()) {
+        m_error = m_reader.error();
+        return;
+    }
+    if (m_reader.chunks().empty()) {
+        m_error = "the recording holds no complete chunk";
+        return;
+    }
+
+    // One junction and one approach hold everything; only geometry matters to a renderer
+    const int junction = m_layout.addJunction(1, 1000);
+    const int approach = m_layout.addApproach(junction, "replay");
+    double minX = 0, minY = 0, maxX = 0, maxY = 0;
+    bool first = true;
+    for (const TrajectoryLane &lane : m_reader.lanes()) {
+        const int l = m_layout.addLane(approach, lane.x0, lane.y0, lane.x1, lane.y1, 1000, lane.sprite,
+                                       lane.scale, lane.rotation, lane.carLength);
+        m_layout.setCarBody(l, lane.bodyX, lane.bodyY, lane.bodyW, lane.bodyH);
+        const double xs[2] = {lane.x0, lane.x1};
+        const double ys[2] = {lane.y0, lane.y1};
+        for (int k = 0; k < 2; ++k) {
+            minX = first ? xs[k] : std::min(minX, xs[k]);
+            minY = first ? ys[k] : std::min(minY, ys[k]);
+            maxX = first ? xs[k] : std::max(maxX, xs[k]);
+            maxY = first ? ys[k] : std::max(maxY, ys[k]);
+            first = false;
+        }
+    }
+    for (const TrajectoryLight &light : m_reader.lights())
+        m_layout.addLight(junction, 0, light.x, light.y, light.rotation);
+
+    // The recording does not keep the grid of the simulation; cover the lanes with some margin
+    const double margin = 200;
+    m_layout.setGridBounds(float(minX - margin), float(minY - margin), float(maxX - minX + 2 * margin),
+                           float(maxY - minY + 2 * margin), 64);
+}
+
+// Valid once the header and at least one chunk were read.
+bool TrajectoryReplay::isValid() const
+{
+    return m_error.empty();
+}
+
+// Why the recording cannot be played.
+const std::string &TrajectoryReplay::error() const
+{
+    return m_error;
+}
+
+// Layout built from the header.
+const Simulation &TrajectoryReplay::layout() const
+{
+    return m_layout;
+}
+
+// First recorded frame.
+std::int64_t TrajectoryReplay::startMs() const
+{
+    return m_reader.startMs();
+}
+
+// Last recorded frame.
+std::int64_t TrajectoryReplay::endMs() const
+{
+    return m_reader.endMs();
+}
+
+// Recorded step.
+int TrajectoryReplay::tickMs() const
+{
+    return m_reader.tickMs();
+}
+
+// The frame at or before `timeMs` is the previous one and the frame after it the current one, so
+// the pair changes only when the time passes a recorded frame.
+float TrajectoryReplay::show(std::int64_t timeMs, SimSnapshot &snapshot)
+{
+    timeMs = std::max(startMs(), std::min(endMs(), timeMs));
+    const int c = m_reader.chunkAt(timeMs);
+    if (c != m_chunk && !load(c))
+        return 1;
+
+    const auto after = std::upper_bound(m_frames.begin(), m_frames.end(), timeMs,
+                                        [](std::int64_t t, const TrajectoryFrame &frame) { return t < frame.timeMs; });
+    const int f = std::max(0, int(after - m_frames.begin()) - 1);
+    const TrajectoryFrame &previous = m_frames[f];
+    const TrajectoryFrame &current = f + 1 < int(m_frames.size()) ? m_frames[f + 1]
+                                     : m_hasNext                     ? m_next
+                                                                     : previous;
+    if (c != m_shownChunk || f != m_shownFrame) {
+        snapshot.capture(previous, current, m_layout);
+        m_shownChunk = c;
+        m_shownFrame = f;
+    }
+
+    if (current.timeMs <= previous.timeMs)
+        return 1;
+    return float(timeMs - previous.timeMs) / float(current.timeMs - previous.timeMs);
+}
+
+// The whole chunk is decoded at once: a chunk is short, and playback moves through it frame by frame.
+bool TrajectoryReplay::load(int c)
+{
+    m_chunk = -1;
+    m_shownChunk = -1;
+    m_frames.clear();
+    bool ok = m_reader.readChunk(c, [this](const TrajectoryFrame &frame) { m_frames.push_back(frame); });
+    m_hasNext = false;
+    if (ok && c + 1 < int(m_reader.chunks().size())) {
+        ok = m_reader.readChunk(c + 1, [this](const TrajectoryFrame &frame) { m_next = frame; }, 1);
+        m_hasNext = ok;
+    }
+    if (!ok || m_frames.empty()) {
+        m_error = ok ? "empty chunk " + std::to_string(c) : m_reader.error();
+        return false;
+    }
+    m_chunk = c;
+    return true;
+}
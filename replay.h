@@ -0,0 +1,58 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstddef>        // Buffer size
+#include <cstdint>        // Clock values
+#include <string>         // Error message
+#include <vector>         // Decoded frames
+#include "simsnapshot.h"  // What a renderer draws
+#include "simulation.h"   // Lanes and lights of the recording, as a renderer expects them
+#include "trajectory.h"   // File format
+
+// Plays back a trajectory file held in memory (typically memory-mapped): show() fills a snapshot
+// for any point in time, so a renderer draws a recording exactly as it draws a live simulation.
+//
+// Only the chunk holding the requested time is decoded, plus the keyframe of the next one; seeking
+// anywhere costs one chunk lookup (TrajectoryReader::chunkAt) and one chunk decode, whatever the
+// length of the recording, and only the pages of the chunks visited are ever read.
+class TrajectoryReplay
+{
+public:
+    // Constructor: the `size` bytes at `data` must stay valid while the replay is used.
+    TrajectoryReplay(const std::uint8_t *data, std::size_t size);
+
+    // False if the file cannot be read or holds no complete chunk; error() says why.
+    bool isValid() const;
+    const std::string &error() const;
+
+    // Lanes and lights of the recording, built from its header. It never runs.
+    const Simulation &layout() const;
+
+    // Time of the first and the last recorded frame.
+    std::int64_t startMs() const;
+    std::int64_t endMs() const;
+
+    // Step of the recorded simulation.
+    int tickMs() const;
+
+    // Fills `snapshot` with the recorded frames around `timeMs` (clamped to the recording) and returns
+    // the interpolation factor between them: the renderer draws prev + (current - prev) * alpha.
+    // The snapshot is left alone while `timeMs` stays between the same two frames.
+    float show(std::int64_t timeMs, SimSnapshot &snapshot);
+
+private:
+    // Decodes chunk `c` and the keyframe of the next one.
+    bool load(int c);
+
+    TrajectoryReader m_reader;
+    Simulation m_layout;
+    std::string m_error;
+
+    int m_chunk;                            // Chunk held in m_frames, -1 if none
+    std::vector<TrajectoryFrame> m_frames;  // Its frames
+    TrajectoryFrame m_next;                 // First frame of the next chunk, if there is one
+    bool m_hasNext;
+    int m_shownChunk, m_shownFrame;         // Frame pair last captured, -1 if none
+};
+
+#endif // REPLAY_H
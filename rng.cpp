@@ -0,0 +1,63 @@
+#include "rng.h"   // Header file for the Rng class
+
+// SplitMix64 step, used to expand a seed into a full xoshiro state.
+static std::uint64_t splitMix64(std::uint64_t &x)
+{
+    std::uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Constructor: mixes the stream id into the seed, then fills the state with SplitMix64 so
+// that nearby seeds and streams give unrelated sequences.
+Rng::Rng(std::uint64_t seed, std::uint64_t stream)
+{
+    std::uint64_t x = seed;
+    std::uint64_t mixedStream = stream;
+    x ^= splitMix64(mixedStream);
+    for (std::uint64_t &word : m_s)
+        word = splitMix64(x);
+    if (!(m_s[0] | m_s[1] | m_s[2] | m_s[3]))
+        m_s[0] = 1;  // The all-zero state would only ever produce zeros
+}
+
+// Jump polynomial from the reference xoshiro256** implementation.
+void Rng::jump()
+{
+    static const std::uint64_t polynomial[] = {
+        0x180EC6D33CFD0ABAull, 0xD5A61266F0C9392Cull, 0xA9582618E03FC9AAull, 0x39ABDC4529B1661Cull
+    };
+    std::uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (std::uint64_t word : polynomial) {
+        for (int bit = 0; bit < 64; ++bit) {
+            if (word & (std::uint64_t(1) << bit)) {
+                s0 ^= m_s[0];
+                s1 ^= m_s[1];
+                s2 ^= m_s[2];
+                s3 ^= m_s[3];
+            }
+            next();
+        }
+    }
+    m_s[0] = s0;
+    m_s[1] = s1;
+    m_s[2] = s2;
+    m_s[3] = s3;
+}
+
+// Copies the state out.
+void Rng::state(std::uint64_t out[4]) const
+{
+    for (int i = 0; i < 4; ++i)
+        out[i] = m_s[i];
+}
+
+// Replaces the state.
+void Rng::setState(const std::uint64_t in[4])
+{
+    for (int i = 0; i < 4; ++i)
+        m_s[i] = in[i];
+    if (!(m_s[0] | m_s[1] | m_s[2] | m_s[3]))
+        m_s[0] = 1;
+}
@@ -0,0 +1,66 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>     // 64-bit state words
+
+// Small, fast pseudo-random generator (xoshiro256**) with independent streams.
+// Unlike QRandomGenerator::global() it is plain state owned by whoever uses it, so runs on
+// different threads never share or lock a generator, and unlike the std distributions its
+// output is fully specified: the same seed and stream give bit-identical numbers on every
+// compiler and platform. next() and bounded() are inline because they sit on the step path.
+class Rng
+{
+public:
+    // Constructor: generator for stream `stream` of `seed`. Different streams of the same seed
+    // are statistically independent (their states are derived through SplitMix64).
+    explicit Rng(std::uint64_t seed = 0, std::uint64_t stream = 0);
+
+    // Next 64 random bits.
+    std::uint64_t next()
+    {
+        const std::uint64_t result = rotl(m_s[1] * 5, 7) * 9;
+        const std::uint64_t t = m_s[1] << 17;
+        m_s[2] ^= m_s[0];
+        m_s[3] ^= m_s[1];
+        m_s[1] ^= m_s[2];
+        m_s[0] ^= m_s[3];
+        m_s[2] ^= t;
+        m_s[3] = rotl(m_s[3], 45);
+        return result;
+    }
+
+    // Uniform integer in [low, high). Uses Lemire's multiply-shift, which is unbiased enough for
+    // ranges far below 2^32 and needs no division.
+    int bounded(int low, int high)
+    {
+        if (high <= low)
+            return low;
+        const std::uint64_t range = std::uint64_t(high - low);
+        const std::uint64_t r = next() >> 32;
+        return low + int((r * range) >> 32);
+    }
+
+    // Uniform double in [0, 1), with 53 random bits.
+    double uniform()
+    {
+        return double(next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // Advances the generator by 2^128 calls to next(); used to split one stream into
+    // non-overlapping sub-streams.
+    void jump();
+
+    // Raw state, for saving and restoring a generator.
+    void state(std::uint64_t out[4]) const;
+    void setState(const std::uint64_t in[4]);
+
+private:
+    static std::uint64_t rotl(std::uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    std::uint64_t m_s[4];   // Generator state, never all zero
+};
+
+#endif // RNG_H
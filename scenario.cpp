@@ -0,0 +1,70 @@
+#include "scenario.h"   // Header file for the Scenario tables
+
+// Constructor: an empty layout using the default grid.
+Scenario::Scenario()
+    : hasGrid(false)
+    , gridX(0)
+    , gridY(0)
+    , gridWidth(800)
+    , gridHeight(800)
+    , gridCell(64)
+    , startTimeOfDayMs(0)
+{
+}
+
+// Replays the tables through the Simulation builders.
+void Scenario::apply(Simulation &sim) const
+{
+    if (hasGrid)
+        sim.setGridBounds(gridX, gridY, gridWidth, gridHeight, gridCell);
+    sim.setStartTimeOfDay(startTimeOfDayMs);
+
+    // Junctions and lights first: a lane may stop at a light of another junction
+    std::vector<int> junctionIndex;
+    for (const ScenarioJunction &junction : junctions) {
+        int j = sim.addJunction(int(junction.phaseMs.size()), junction.phaseMs.front());
+        sim.setPhaseDurations(j, junction.phaseMs);
+        sim.setPhaseOffset(j, junction.offsetMs);
+        sim.setSignalControl(j, junction.control, junction.timing);
+        for (const ScenarioLight &light : junction.lights)
+            sim.addLight(j, light.phase, light.x, light.y, light.rotation);
+        junctionIndex.push_back(j);
+    }
+
+    for (std::size_t k = 0; k < junctions.size(); ++k) {
+        const ScenarioJunction &junction = junctions[k];
+        const int j = junctionIndex[k];
+        for (const ScenarioApproach &approach : junction.approaches) {
+            int a = sim.addApproach(j, approach.name);
+            if (approach.distribution == ArrivalDistribution::Exponential)
+                sim.setExponentialArrivals(a, approach.meanIntervalMs);
+            else if (approach.distribution == ArrivalDistribution::Profile)
+                sim.setDemandProfile(a, approach.profile);
+            else
+                sim.setArrivalInterval(a, approach.minIntervalMs, approach.maxIntervalMs);
+
+            for (const ScenarioLane &lane : approach.lanes) {
+                int l = sim.addLane(a, lane.x0, lane.y0, lane.x1, lane.y1, lane.traversalMs,
+                                    lane.sprite, lane.scale, lane.rotation, lane.carLength);
+                if (lane.light >= 0)
+                    sim.setStopLine(l, lane.light, lane.stopS);
+                if (lane.spriteWidth > 0 && lane.spriteHeight > 0)
+                    sim.setSpriteSize(l, lane.spriteWidth, lane.spriteHeight);
+            }
+        }
+        for (const ScenarioZone &zone : junction.zones)
+            sim.addConflictZone(j, zone.x0, zone.y0, zone.x1, zone.y1);
+    }
+
+    // Turns may lead onto lanes of any junction, so they come last
+    int l = 0;
+    for (const ScenarioJunction &junction : junctions) {
+        for (const ScenarioApproach &approach : junction.approaches) {
+            for (const ScenarioLane &lane : approach.lanes) {
+                for (const ScenarioTurn &turn : lane.turns)
+                    sim.addTurn(l, turn.s, turn.lane, turn.entryS, turn.share);
+                ++l;
+            }
+        }
+    }
+}
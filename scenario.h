@@ -0,0 +1,95 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <cstdint>        // Grid and id types
+#include <string>         // Names
+#include <vector>         // Tables of junctions, lights, approaches and lanes
+#include "simulation.h"   // ArrivalDistribution, and the simulation a scenario is loaded into
+
+// A layout description, independent of any running simulation.
+// It is read once (see ScenarioReader) and then applied to as many simulations as needed,
+// e.g. one per run of a sweep, without parsing the file again. Every cross-reference is
+// already resolved to an index: apply() only calls the Simulation builders.
+
+// A traffic light of a junction.
+struct ScenarioLight
+{
+    int phase;              // Phase of its junction during which it is green
+    double x, y;            // Scene position
+    double rotation;        // Rotation (degrees) of the light sprite
+};
+
+// A turning movement off a lane (see SimTurn).
+struct ScenarioTurn
+{
+    double s;               // Distance along the lane at which turning cars leave it
+    int lane;               // Index of the lane they join, over all junctions in file order
+    double entryS;          // Distance along that lane at which they join it
+    double share;           // Fraction of the lane's cars that turn
+};
+
+// A lane: spawn point, end point, car sprite and the stop line guarded by a light.
+struct ScenarioLane
+{
+    double x0, y0;          // Spawn point
+    double x1, y1;          // End point, where cars leave the scene
+    double traversalMs;     // Time a free-flowing car needs to cover the lane
+    int sprite;             // Sprite id (0..3 -> carro.png..carro4.png)
+    double scale;           // Scale the sprite is drawn with
+    double rotation;        // Rotation (degrees) the sprite is drawn with
+    double carLength;       // Length of a car along the lane
+    double spriteWidth;     // Size of the unscaled image, 0 if unknown (no conflict box)
+    double spriteHeight;
+    int light;              // Index of the light guarding the stop line, over all junctions; -1 for none
+    double stopS;           // Distance of the stop line from the spawn point
+    std::vector<ScenarioTurn> turns;    // Turning movements; the other cars go straight on
+};
+
+// A group of lanes receiving cars together.
+struct ScenarioApproach
+{
+    std::string name;                   // Name used in reports
+    ArrivalDistribution distribution;   // How arrival intervals are drawn
+    int minIntervalMs;                  // Range of uniform intervals
+    int maxIntervalMs;
+    int meanIntervalMs;                 // Mean of exponential intervals
+    std::vector<DemandPoint> profile;   // Arrival rate over the day of profile arrivals
+    std::vector<ScenarioLane> lanes;    // Lanes of the approach
+};
+
+// Rectangle of a crossing box where cars of different lanes must not overlap.
+struct ScenarioZone
+{
+    double x0, y0, x1, y1;
+};
+
+// A signal controller with its phase plan, lights, approaches and crossing boxes.
+struct ScenarioJunction
+{
+    std::string name;                       // Name used in error messages
+    std::vector<int> phaseMs;               // Duration of each phase, in cycle order
+    int offsetMs;                           // Delay of the first phase change
+    SignalControl control;                  // Policy deciding the phase changes
+    SignalTiming timing;                    // Its limits
+    std::vector<ScenarioLight> lights;      // Lights switched by this junction
+    std::vector<ScenarioApproach> approaches;  // Approaches whose intervals follow its phases
+    std::vector<ScenarioZone> zones;        // Crossing boxes
+};
+
+// A whole layout: any number of junctions, plus the area covered by the spatial index.
+struct Scenario
+{
+    std::string name;                       // Name of the layout
+    std::vector<ScenarioJunction> junctions;
+    bool hasGrid;                           // False keeps the simulation's default 800x800 grid
+    float gridX, gridY, gridWidth, gridHeight, gridCell;
+    std::int64_t startTimeOfDayMs;          // Time of day at which the simulation starts
+
+    Scenario();
+
+    // Builds the layout in an empty simulation. Lights are added first, junction by junction,
+    // so their indices match the ones stored in the lanes; turns are added once every lane exists.
+    void apply(Simulation &sim) const;
+};
+
+#endif // SCENARIO_H
@@ -0,0 +1,457 @@
+#include "scenariofile.h"   // Header file for the scenario reader
+#include <QFile>            // Reads the scenario file (or a Qt resource)
+#include <QHash>            // Light and lane ids -> indices
+#include <QJsonArray>       // JSON parsing
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonParseError>
+#include <cmath>            // std::hypot
+
+// Reads a number member. A missing member gives `fallback`, or an error if `required`.
+static bool number(const QJsonObject &object, const char *key, const QString &path, bool required,
+                   double fallback, double *value, QString *error)
+{
+    const QJsonValue member = object.value(QLatin1String(key));
+    if (member.isUndefined()) {
+        if (required) {
+            *error = QString("%1.%2: missing").arg(path, QLatin1String(key));
+            return false;
+        }
+        *value = fallback;
+        return true;
+    }
+    if (!member.isDouble()) {
+        *error = QString("%1.%2: expected a number").arg(path, QLatin1String(key));
+        return false;
+    }
+    *value = member.toDouble();
+    return true;
+}
+
+// Reads an array of exactly `count` numbers.
+static bool numbers(const QJsonValue &member, int count, const QString &path, double *values, QString *error)
+{
+    const QJsonArray array = member.toArray();
+    if (!member.isArray() || array.size() != count) {
+        *error = QString("%1: expected an array of %2 numbers").arg(path).arg(count);
+        return false;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (!array[i].isDouble()) {
+            *error = QString("%1[%2]: expected a number").arg(path).arg(i);
+            return false;
+        }
+        values[i] = array[i].toDouble();
+    }
+    return true;
+}
+
+// Reads the arrival distribution of an approach; without "arrivals" the original
+// uniform 1-6 s intervals are used. A profile lists [hour, cars per hour] pairs.
+static bool readArrivals(const QJsonObject &object, const QString &path, ScenarioApproach *approach, QString *error)
+{
+    approach->distribution = ArrivalDistribution::Uniform;
+    approach->minIntervalMs = 1000;
+    approach->maxIntervalMs = 6000;
+    approach->meanIntervalMs = 3500;
+    if (!object.contains("arrivals"))
+        return true;
+
+    const QJsonObject arrivals = object.value("arrivals").toObject();
+    const QString distribution = arrivals.value("distribution").toString("uniform");
+    double value = 0;
+    if (distribution == "uniform") {
+        if (!number(arrivals, "minMs", path, true, 0, &value, error))
+            return false;
+        approach->minIntervalMs = int(value);
+        if (!number(arrivals, "maxMs", path, true, 0, &value, error))
+            return false;
+        approach->maxIntervalMs = int(value);
+        if (approach->minIntervalMs < 1 || approach->maxIntervalMs <= approach->minIntervalMs) {
+            *error = QString("%1: need 1 <= minMs < maxMs").arg(path);
+            return false;
+        }
+    } else if (distribution == "exponential") {
+        approach->distribution = ArrivalDistribution::Exponential;
+        if (!number(arrivals, "meanMs", path, true, 0, &value, error))
+            return false;
+        approach->meanIntervalMs = int(value);
+        if (approach->meanIntervalMs < 1) {
+            *error = QString("%1.meanMs: must be at least 1").arg(path);
+            return false;
+        }
+    } else if (distribution == "profile") {
+        approach->distribution = ArrivalDistribution::Profile;
+        const QJsonArray points = arrivals.value("perHour").toArray();
+        if (points.isEmpty()) {
+            *error = path + ".perHour: expected at least one [hour, rate] pair";
+            return false;
+        }
+        bool anyDemand = false;
+        for (int i = 0; i < points.size(); ++i) {
+            const QString pointPath = QString("%1.perHour[%2]").arg(path).arg(i);
+            double point[2];
+            if (!numbers(points[i], 2, pointPath, point, error))
+                return false;
+            if (point[0] < 0 || point[0] >= 24 || point[1] < 0) {
+                *error = pointPath + ": need 0 <= hour < 24 and a rate >= 0";
+                return false;
+            }
+            approach->profile.push_back(DemandPoint{std::int64_t(point[0] * 3600000.0), point[1]});
+            anyDemand = anyDemand || point[1] > 0;
+        }
+        if (!anyDemand) {
+            *error = path + ".perHour: every rate is zero";
+            return false;
+        }
+    } else {
+        *error = QString("%1.distribution: unknown distribution \"%2\"").arg(path, distribution);
+        return false;
+    }
+    return true;
+}
+
+// Reads the signal control of a junction; without "control" the phases are fixed-time.
+static bool readControl(const QJsonObject &object, const QString &path, ScenarioJunction *junction, QString *error)
+{
+    junction->control = SignalControl::FixedTime;
+    junction->timing = SignalTiming();
+    if (!object.contains("control"))
+        return true;
+
+    const QJsonObject control = object.value("control").toObject();
+    const QString type = control.value("type").toString("fixed");
+    if (!parseSignalControl(type.toStdString(), &junction->control)) {
+        *error = QString("%1.type: unknown control \"%2\"").arg(path, type);
+        return false;
+    }
+    double minGreen = 0, maxGreen = 0, gap = 0;
+    if (!number(control, "minGreenMs", path, false, junction->timing.minGreenMs, &minGreen, error)
+        || !number(control, "maxGreenMs", path, false, junction->timing.maxGreenMs, &maxGreen, error)
+        || !number(control, "gapMs", path, false, junction->timing.gapMs, &gap, error))
+        return false;
+    if (minGreen < 1 || maxGreen < minGreen || gap < 0) {
+        *error = QString("%1: need 1 <= minGreenMs <= maxGreenMs and gapMs >= 0").arg(path);
+        return false;
+    }
+    junction->timing.minGreenMs = int(minGreen);
+    junction->timing.maxGreenMs = int(maxGreen);
+    junction->timing.gapMs = int(gap);
+    return true;
+}
+
+// Reads the turns of a lane; lane ids are resolved through `laneIds`. Distances are checked
+// once every lane is known (see checkTurns).
+static bool readTurns(const QJsonObject &object, const QString &path, const QHash<QString, int> &laneIds,
+                      ScenarioLane *lane, QString *error)
+{
+    const QJsonArray turns = object.value("turns").toArray();
+    double shares = 0;
+    for (int t = 0; t < turns.size(); ++t) {
+        const QString turnPath = QString("%1.turns[%2]").arg(path).arg(t);
+        const QJsonObject turnObject = turns[t].toObject();
+        const QString id = turnObject.value("lane").toString();
+        if (!laneIds.contains(id)) {
+            *error = QString("%1.lane: unknown lane \"%2\"").arg(turnPath, id);
+            return false;
+        }
+        ScenarioTurn turn;
+        turn.lane = laneIds.value(id);
+        if (!number(turnObject, "at", turnPath, true, 0, &turn.s, error)
+            || !number(turnObject, "entry", turnPath, true, 0, &turn.entryS, error)
+            || !number(turnObject, "share", turnPath, true, 0, &turn.share, error))
+            return false;
+        if (turn.share <= 0 || turn.share > 1) {
+            *error = turnPath + ".share: must be in (0, 1]";
+            return false;
+        }
+        shares += turn.share;
+        lane->turns.push_back(turn);
+    }
+    if (shares > 1 + 1e-9) {
+        *error = path + ".turns: shares add up to more than 1";
+        return false;
+    }
+    return true;
+}
+
+// Reads one lane; light and lane ids are resolved through `lightIds` and `laneIds`.
+static bool readLane(const QJsonObject &object, const QString &path, const QHash<QString, int> &lightIds,
+                     const QHash<QString, int> &laneIds, ScenarioLane *lane, QString *error)
+{
+    double from[2], to[2];
+    if (!numbers(object.value("from"), 2, path + ".from", from, error)
+        || !numbers(object.value("to"), 2, path + ".to", to, error))
+        return false;
+    lane->x0 = from[0];
+    lane->y0 = from[1];
+    lane->x1 = to[0];
+    lane->y1 = to[1];
+
+    double sprite = 0;
+    if (!number(object, "traversalMs", path, false, 2000, &lane->traversalMs, error)
+        || !number(object, "sprite", path, false, 0, &sprite, error)
+        || !number(object, "scale", path, false, 1, &lane->scale, error)
+        || !number(object, "rotation", path, false, 0, &lane->rotation, error)
+        || !number(object, "carLength", path, true, 0, &lane->carLength, error))
+        return false;
+    if (lane->traversalMs <= 0) {
+        *error = path + ".traversalMs: must be positive";
+        return false;
+    }
+    if (lane->carLength <= 0) {
+        *error = path + ".carLength: must be positive";
+        return false;
+    }
+    if (from[0] == to[0] && from[1] == to[1]) {  // The lane's speed is its length over traversalMs
+        *error = path + ".to: lane length must be positive";
+        return false;
+    }
+    if (sprite < 0 || sprite > 3) {
+        *error = path + ".sprite: must be 0..3";
+        return false;
+    }
+    lane->sprite = int(sprite);
+
+    lane->spriteWidth = 0;
+    lane->spriteHeight = 0;
+    if (object.contains("spriteSize")) {
+        double size[2];
+        if (!numbers(object.value("spriteSize"), 2, path + ".spriteSize", size, error))
+            return false;
+        lane->spriteWidth = size[0];
+        lane->spriteHeight = size[1];
+    }
+
+    lane->light = -1;
+    lane->stopS = 0;
+    if (object.contains("stopLine")) {
+        const QJsonObject stopLine = object.value("stopLine").toObject();
+        const QString id = stopLine.value("light").toString();
+        if (!lightIds.contains(id)) {
+            *error = QString("%1.stopLine.light: unknown light \"%2\"").arg(path, id);
+            return false;
+        }
+        lane->light = lightIds.value(id);
+        if (!number(stopLine, "distance", path + ".stopLine", true, 0, &lane->stopS, error))
+            return false;
+    }
+    return readTurns(object, path, laneIds, lane, error);
+}
+
+// Checks that every turn leaves its lane and joins the other one within their lengths.
+static bool checkTurns(const Scenario &scenario, QString *error)
+{
+    std::vector<const ScenarioLane *> lanes;
+    for (const ScenarioJunction &junction : scenario.junctions)
+        for (const ScenarioApproach &approach : junction.approaches)
+            for (const ScenarioLane &lane : approach.lanes)
+                lanes.push_back(&lane);
+
+    for (std::size_t l = 0; l < lanes.size(); ++l) {
+        const ScenarioLane &lane = *lanes[l];
+        for (std::size_t t = 0; t < lane.turns.size(); ++t) {
+            const ScenarioTurn &turn = lane.turns[t];
+            const ScenarioLane &target = *lanes[turn.lane];
+            const QString path = QString("lane %1, turn %2").arg(l).arg(t);
+            if (turn.lane == int(l)) {
+                *error = path + ": a lane cannot turn onto itself";
+                return false;
+            }
+            if (turn.s <= 0 || turn.s > std::hypot(lane.x1 - lane.x0, lane.y1 - lane.y0)) {
+                *error = path + ": \"at\" must lie on the lane";
+                return false;
+            }
+            if (turn.entryS < 0 || turn.entryS >= std::hypot(target.x1 - target.x0, target.y1 - target.y0)) {
+                *error = path + ": \"entry\" must lie on the target lane";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Parses the JSON text. Light and lane ids are collected over every junction first, so a lane
+// can refer to a light or turn onto a lane declared further down.
+bool readScenario(const QByteArray &json, Scenario *scenario, QString *error)
+{
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(json, &parseError);
+    if (document.isNull()) {
+        *error = QString("JSON error at offset %1: %2").arg(parseError.offset).arg(parseError.errorString());
+        return false;
+    }
+    const QJsonObject root = document.object();
+    const QJsonArray junctions = root.value("junctions").toArray();
+    if (junctions.isEmpty()) {
+        *error = "junctions: expected at least one junction";
+        return false;
+    }
+
+    Scenario result;
+    result.name = root.value("name").toString("scenario").toStdString();
+
+    if (root.contains("grid")) {
+        const QJsonObject grid = root.value("grid").toObject();
+        double x, y, width, height, cell;
+        if (!number(grid, "x", "grid", true, 0, &x, error) || !number(grid, "y", "grid", true, 0, &y, error)
+            || !number(grid, "width", "grid", true, 0, &width, error)
+            || !number(grid, "height", "grid", true, 0, &height, error)
+            || !number(grid, "cell", "grid", false, 64, &cell, error))
+            return false;
+        if (width <= 0 || height <= 0 || cell <= 0) {
+            *error = "grid: width, height and cell must be positive";
+            return false;
+        }
+        result.hasGrid = true;
+        result.gridX = float(x);
+        result.gridY = float(y);
+        result.gridWidth = float(width);
+        result.gridHeight = float(height);
+        result.gridCell = float(cell);
+    }
+
+    double startHour = 0;
+    if (!number(root, "startHour", "root", false, 0, &startHour, error))
+        return false;
+    if (startHour < 0 || startHour >= 24) {
+        *error = "startHour: must be in [0, 24)";
+        return false;
+    }
+    result.startTimeOfDayMs = std::int64_t(startHour * 3600000.0);
+
+    // Junctions, phase plans and lights
+    QHash<QString, int> lightIds;
+    for (int j = 0; j < junctions.size(); ++j) {
+        const QString path = QString("junctions[%1]").arg(j);
+        const QJsonObject object = junctions[j].toObject();
+        ScenarioJunction junction;
+        junction.name = object.value("name").toString(path).toStdString();
+
+        const QJsonArray phases = object.value("phasesMs").toArray();
+        if (phases.isEmpty()) {
+            *error = path + ".phasesMs: expected at least one phase duration";
+            return false;
+        }
+        for (int p = 0; p < phases.size(); ++p) {
+            const int duration = phases[p].toInt(0);
+            if (duration <= 0) {
+                *error = QString("%1.phasesMs[%2]: expected a positive duration").arg(path).arg(p);
+                return false;
+            }
+            junction.phaseMs.push_back(duration);
+        }
+        double offset = 0;
+        if (!number(object, "offsetMs", path, false, 0, &offset, error))
+            return false;
+        junction.offsetMs = int(offset);
+        if (!readControl(object, path + ".control", &junction, error))
+            return false;
+
+        const QJsonArray lights = object.value("lights").toArray();
+        for (int i = 0; i < lights.size(); ++i) {
+            const QString lightPath = QString("%1.lights[%2]").arg(path).arg(i);
+            const QJsonObject lightObject = lights[i].toObject();
+            const QString id = lightObject.value("id").toString();
+            if (id.isEmpty() || lightIds.contains(id)) {
+                *error = lightPath + ".id: expected a unique id";
+                return false;
+            }
+            ScenarioLight light;
+            double phase = 0;
+            if (!number(lightObject, "phase", lightPath, true, 0, &phase, error)
+                || !number(lightObject, "x", lightPath, true, 0, &light.x, error)
+                || !number(lightObject, "y", lightPath, true, 0, &light.y, error)
+                || !number(lightObject, "rotation", lightPath, false, 0, &light.rotation, error))
+                return false;
+            if (phase < 0 || phase >= junction.phaseMs.size()) {
+                *error = lightPath + ".phase: not a phase of this junction";
+                return false;
+            }
+            light.phase = int(phase);
+            lightIds.insert(id, int(lightIds.size()));
+            junction.lights.push_back(light);
+        }
+        result.junctions.push_back(junction);
+    }
+
+    // Lane ids, numbered in file order as Scenario::apply() adds the lanes
+    QHash<QString, int> laneIds;
+    int laneCount = 0;
+    for (int j = 0; j < junctions.size(); ++j) {
+        const QJsonArray approaches = junctions[j].toObject().value("approaches").toArray();
+        for (int a = 0; a < approaches.size(); ++a) {
+            const QJsonArray lanes = approaches[a].toObject().value("lanes").toArray();
+            for (int l = 0; l < lanes.size(); ++l, ++laneCount) {
+                const QJsonValue id = lanes[l].toObject().value("id");
+                if (id.isUndefined())
+                    continue;
+                if (id.toString().isEmpty() || laneIds.contains(id.toString())) {
+                    *error = QString("junctions[%1].approaches[%2].lanes[%3].id: expected a unique id")
+                                 .arg(j).arg(a).arg(l);
+                    return false;
+                }
+                laneIds.insert(id.toString(), laneCount);
+            }
+        }
+    }
+
+    // Approaches, lanes and crossing boxes
+    for (int j = 0; j < junctions.size(); ++j) {
+        const QString path = QString("junctions[%1]").arg(j);
+        const QJsonObject object = junctions[j].toObject();
+        ScenarioJunction &junction = result.junctions[j];
+
+        const QJsonArray approaches = object.value("approaches").toArray();
+        for (int a = 0; a < approaches.size(); ++a) {
+            const QString approachPath = QString("%1.approaches[%2]").arg(path).arg(a);
+            const QJsonObject approachObject = approaches[a].toObject();
+            ScenarioApproach approach;
+            approach.name = approachObject.value("name").toString(approachPath).toStdString();
+            if (!readArrivals(approachObject, approachPath + ".arrivals", &approach, error))
+                return false;
+
+            const QJsonArray lanes = approachObject.value("lanes").toArray();
+            if (lanes.isEmpty()) {
+                *error = approachPath + ".lanes: expected at least one lane";
+                return false;
+            }
+            for (int l = 0; l < lanes.size(); ++l) {
+                ScenarioLane lane;
+                if (!readLane(lanes[l].toObject(), QString("%1.lanes[%2]").arg(approachPath).arg(l), lightIds,
+                              laneIds, &lane, error))
+                    return false;
+                approach.lanes.push_back(lane);
+            }
+            junction.approaches.push_back(approach);
+        }
+
+        const QJsonArray zones = object.value("conflictZones").toArray();
+        for (int z = 0; z < zones.size(); ++z) {
+            double box[4];
+            if (!numbers(zones[z], 4, QString("%1.conflictZones[%2]").arg(path).arg(z), box, error))
+                return false;
+            junction.zones.push_back(ScenarioZone{box[0], box[1], box[2], box[3]});
+        }
+    }
+
+    if (!checkTurns(result, error))
+        return false;
+    *scenario = result;
+    return true;
+}
+
+// Reads the whole file (a path or a ":/" resource) and parses it.
+bool readScenarioFile(const QString &path, Scenario *scenario, QString *error)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = QString("%1: %2").arg(path, file.errorString());
+        return false;
+    }
+    if (!readScenario(file.readAll(), scenario, error)) {
+        *error = QString("%1: %2").arg(path, *error);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,21 @@
+#ifndef SCENARIOFILE_H
+#define SCENARIOFILE_H
+
+#include <QByteArray>    // Raw JSON text
+#include <QString>       // File names and error messages
+#include "scenario.h"    // Tables filled by the reader
+
+// Reading of scenario files (JSON) into Scenario tables.
+//
+// A scenario lists one or more junctions. Each junction has a phase plan, its lights (with an
+// id unique in the file), its approaches with their arrival distribution and lanes, and the
+// crossing boxes checked for conflicts. A lane may stop at any light of the file, so a road
+// crossing two junctions is described by the lanes of each junction. See scenarios/cross.json.
+//
+// Both functions return false and describe the first problem in `error` (with the path of the
+// offending value, e.g. "junctions[0].approaches[1].lanes[0].stopLine.light") if the text is
+// not a valid scenario; `scenario` is only written on success.
+bool readScenario(const QByteArray &json, Scenario *scenario, QString *error);
+bool readScenarioFile(const QString &path, Scenario *scenario, QString *error);
+
+#endif // SCENARIOFILE_H
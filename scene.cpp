@@ -1,199 +1,303 @@
 #include "scene.h"              // Header file for the Scene class
-#include "carro.h"              // Header file for the Carro (Car) class
-#include <QRandomGenerator>     // Random number generator for traffic light and car timers
 #include "semaforo.h"           // Header file for the Semaforo (Traffic light) class
+#include "scenariofile.h"       // Reads the layout of the crossing
+#include "network.h"            // City grid layouts
+#include "telemetry.h"          // Frame timings
 #include <QGraphicsScene>       // QGraphicsScene class for managing 2D graphic items
+#include <QDebug>               // Warning when the scenario cannot be read
+#include <QPainter>             // Draws the backdrop
+#include <chrono>               // Frame time, to interpolate between simulation steps
 
-// Constructor for the Scene class, initializes traffic lights, car timers, and scene setup.
-Scene::Scene(QObject *parent)
+// Constructor for the Scene class, builds the simulated crossing and the items that display it.
+Scene::Scene(const QString &layout, QObject *parent, Mode mode)
     : QGraphicsScene{parent}    // Call base class constructor (QGraphicsScene)
+    , runner(nullptr)
+    , replayFile(nullptr)
+    , replay(nullptr)
+    , replayMs(0)
+    , replayScale(1)
+    , renderStartNs(0)
 {
-    // Initialize timers to manage the timing of car and traffic light actions
-    timerHorizonTal = new QTimer(this);  // Timer for horizontal car lanes
-    timerVertical = new QTimer(this);    // Timer for vertical car lanes and semaphore switching
-
-    // Set up timers for each traffic lane's car generation
-    setUpCarLhTimer();  // Left horizontal lane
-    setUpCarRhTimer();  // Right horizontal lane
-    setUpCarTvTimer();  // Top vertical lane
-    setUpCarBvTimer();  // Bottom vertical lane
-
-    // Set up the traffic light control timer
-    setTimerVertical();
-
-    // Initialize traffic lights (Semaforo objects) with red light images and default "off" states
-    s1 = new Semaforo(QPixmap(":/imagens/semaforoRed.png"), 0);
-    s2 = new Semaforo(QPixmap(":/imagens/semaforoRed.png"), 0);
-    s3 = new Semaforo(QPixmap(":/imagens/semaforoRed.png"), 0);
-    s4 = new Semaforo(QPixmap(":/imagens/semaforoRed.png"), 0);
-
-    // Position, scale, and configure the traffic lights in the scene
-    s1->setPos(950 / 2 + 200, 800 / 2 - 200);  // Position the first traffic light
-    s1->setZValue(3);                          // Set rendering order (3 is above other items)
-    s1->setScale(0.15);                        // Scale down the size
-    addItem(s1);                               // Add to the scene
-
-    s2->setPos(440 / 2 - 100, 180 / 2 + 100);  // Position the second traffic light
-    s2->setZValue(3);
-    s2->setRotation(90);                       // Rotate 90 degrees to match lane orientation
-    s2->setScale(0.15);
-    addItem(s2);
-
-    s3->setPos(580 / 2 - 20, 350 / 2 + 20);    // Position the third traffic light
-    s3->setZValue(3);
-    s3->setScale(0.15);
-    addItem(s3);
-
-    s4->setPos(1250 / 2 - 100, 180 / 2 + 100); // Position the fourth traffic light
-    s4->setZValue(3);
-    s4->setRotation(90);
-    s4->setScale(0.15);
-    addItem(s4);
-}
-
-// Start the vertical timer that alternates traffic light states and triggers car movement on vertical lanes.
-void Scene::start()
+    // Lanes and lights of a recording come from its header
+    Simulation sim;
+    if (!layout.endsWith(".trj") || !openReplay(layout))
+        sim = buildSimulation(layout);
+
+    // All cars are drawn by one item reading the snapshots; lanes never change, so it keeps a copy
+    const Simulation &lanes = replay ? replay->layout() : sim;
+    vehicleLayer = new VehicleLayer(lanes);
+    addItem(vehicleLayer);
+
+    // Snapshots only carry numbers per approach; the overlay labels them with these names
+    for (const SimApproach &approach : lanes.approaches())
+        approaches.append(QString::fromStdString(approach.name));
+
+    // Create one traffic light item per simulated light, placed and rotated as the simulation says
+    for (const SimLight &light : lanes.lights()) {
+        Semaforo *semaforo = new Semaforo(0.15, light.rotation, light.green);  // Scaled down to 15%
+        semaforo->setPos(light.x, light.y);
+        semaforo->setZValue(3);              // Set rendering order (3 is above other items)
+        addItem(semaforo);
+        semaforos.append(semaforo);
+    }
+
+    if (replay) {
+        // The replay starts paused at the first recorded frame, as a simulation starts with empty roads
+        replayMs = double(replay->startMs());
+        replay->show(replay->startMs(), replayFrame);
+        shown = &replayFrame;
+        replayClock.start();
+    } else if (mode == DisplayOnly) {
+        // Nothing steps the layout: its first state stands until showSnapshot()
+        SimPositions previous;
+        previous.capture(sim);
+        replayFrame.capture(sim, previous);
+        shown = &replayFrame;
+    } else {
+        // From here on only the runner's thread touches the simulation
+        runner = new SimulationRunner(std::move(sim));
+        shown = &runner->snapshot();
+    }
+
+    // Refresh about 60 times per second; the simulation itself advances in fixed steps
+    frameTimer = new QTimer(this);
+    connect(frameTimer, &QTimer::timeout, this, &Scene::frame);
+    if (mode == Live)
+        frameTimer->start(16);
+}
+
+// Joins the simulation thread; the player goes before the mapping it reads (unmapped with the file).
+Scene::~Scene()
 {
-    timerVertical->start(7000);  // Start the timer with a 7-second interval for traffic light changes
+    frameTimer->stop();
+    vehicleLayer->setSnapshot(nullptr, 1);
+    delete runner;
+    delete replay;
 }
 
-// Stop all car and traffic light timers, and reset the traffic lights to red.
-void Scene::stop()
+// A grid, a scenario file, or the original crossing.
+Simulation Scene::buildSimulation(const QString &layout)
 {
-    carLhTimer->stop();  // Stop car generation on the left horizontal lane
-    carRhTimer->stop();  // Stop car generation on the right horizontal lane
-    carTvTimer->stop();  // Stop car generation on the top vertical lane
-    carBvTimer->stop();  // Stop car generation on the bottom vertical lane
-    timerVertical->stop();  // Stop the timer controlling traffic light changes
-
-    // Set all traffic lights to red (state 0)
-    s1->setEstado(0);
-    s2->setEstado(0);
-    s3->setEstado(0);
-    s4->setEstado(0);
-}
-
-// Set up the vertical traffic light timer that alternates between allowing horizontal and vertical traffic.
-void Scene::setTimerVertical()
-{
-    // Stop horizontal car timer if it's active (ensures horizontal cars stop before vertical lights turn green)
-    if(timerHorizonTal->isActive())
-        timerHorizonTal->stop();
-
-    // Initialize semaphore state to 1 (vertical lanes go, horizontal lanes stop)
-    Scene::semaforo = 1;
-
-    // Connect the vertical timer to a lambda function to alternate the traffic light states
-    connect(timerVertical, &QTimer::timeout, [=]() {
-        // Generate random timings for vertical car movements
-        int randomNumber = QRandomGenerator::global()->bounded(1000, 6000);
-        int randomNumber2 = QRandomGenerator::global()->bounded(1000, 6000);
-
-        if(Scene::semaforo) {
-            // Set vertical lanes to green, horizontal lanes to red
-            s1->setEstado(1);  // Turn traffic light 1 green
-            s2->setEstado(0);  // Turn traffic light 2 red
-            s3->setEstado(1);  // Turn traffic light 3 green
-            s4->setEstado(0);  // Turn traffic light 4 red
-
-            // Stop horizontal car movement, start vertical movement
-            carLhTimer->stop();
-            carRhTimer->stop();
-            carTvTimer->start(randomNumber);   // Start top vertical car movement
-            carBvTimer->start(randomNumber2);  // Start bottom vertical car movement
+    Simulation sim;
+    if (layout.startsWith("grid:")) {
+        // A city grid built as a single region, so every lane is linked inside this simulation
+        NetworkConfig config;
+        const QStringList size = layout.mid(5).split('x');
+        config.columns = size.value(0).toInt();
+        config.rows = size.value(1).toInt();
+        config.regionColumns = 1;
+        config.regionRows = 1;
+        RoadNetwork network(config);
+        sim = network.region(0);
+    } else {
+        // Lanes, approaches and lights of the crossing come from the scenario drawn over cross.jpg;
+        // the built-in copy of the same layout is only a fallback for a broken resource
+        const QString path = layout.isEmpty() ? QString(":/scenarios/cross.json") : layout;
+        Scenario scenario;
+        QString error;
+        if (readScenarioFile(path, &scenario, &error)) {
+            scenario.apply(sim);
         } else {
-            // Set horizontal lanes to green, vertical lanes to red
-            s1->setEstado(0);
-            s2->setEstado(1);  // Turn traffic light 2 green
-            s3->setEstado(0);
-            s4->setEstado(1);  // Turn traffic light 4 green
-
-            // Stop vertical car movement, start horizontal movement
-            carLhTimer->start(randomNumber);
-            carRhTimer->start(randomNumber2);
-            carTvTimer->stop();
-            carBvTimer->stop();
+            qWarning() << "Cannot load the scenario:" << error;
+            sim.loadDefaultCross();
         }
+    }
+    return sim;
+}
 
-        // Toggle the traffic light state for the next cycle
-        Scene::semaforo = !Scene::semaforo;
-    });
+// The file stays open and mapped for the lifetime of the scene; the header and the chunk table
+// are read now, frames only as the replay reaches them.
+bool Scene::openReplay(const QString &path)
+{
+    replayFile = new QFile(path, this);
+    const uchar *data = nullptr;
+    if (replayFile->open(QIODevice::ReadOnly))
+        data = replayFile->map(0, replayFile->size());
+    if (!data) {
+        qWarning() << "Cannot map the recording:" << replayFile->errorString();
+    } else {
+        replay = new TrajectoryReplay(data, std::size_t(replayFile->size()));
+        if (replay->isValid())
+            return true;
+        qWarning() << "Cannot play the recording:" << QString::fromStdString(replay->error());
+        delete replay;
+        replay = nullptr;
+    }
+    delete replayFile;
+    replayFile = nullptr;
+    return false;
 }
 
-// Set up the right horizontal lane timer, which spawns cars moving from right to left periodically.
-void Scene::setUpCarRhTimer()
+// Start the light cycle; the first lights turn green one phase (7 seconds) later.
+void Scene::start()
 {
-    carRhTimer = new QTimer(this);  // Create a new timer for the right horizontal lane
+    if (replay) {
+        if (replayMs >= double(replay->endMs()))
+            seek(replay->startMs());
+        return;
+    }
+    if (runner)
+        runner->post([](Simulation &sim) { sim.start(); });
+}
 
-    // Connect the timer to a lambda function to add new cars to the right horizontal lane at fixed intervals
-    connect(carRhTimer, &QTimer::timeout, [=]() {
-        // Create a car moving right to left and set its position, scale, and rotation
-        Carro *c4 = new Carro(QPixmap(":/imagens/carro4.png"), 50, 755, 12 / 2 + 245, 12 / 2 + 245);
-        c4->setScale(0.29);    // Scale down the car
-        c4->setRotation(-90);  // Rotate to face the correct direction
-        addItem(c4);           // Add the car to the scene
-    });
+// Stop spawning cars and set all traffic lights to red; the next frames show the change.
+void Scene::stop()
+{
+    if (runner)
+        runner->post([](Simulation &sim) { sim.stop(); });
 }
 
-// Set up the left horizontal lane timer, which spawns cars moving from left to right periodically.
-void Scene::setUpCarLhTimer()
+// The runner re-anchors its clock, so the change applies from the current simulated time.
+void Scene::setTimeScale(double scale)
 {
-    carLhTimer = new QTimer(this);  // Create a new timer for the left horizontal lane
+    if (replay)
+        replayScale = scale;
+    else if (runner)
+        runner->setTimeScale(scale);
+}
 
-    // Connect the timer to a lambda function to add new cars to the left horizontal lane
-    connect(carLhTimer, &QTimer::timeout, [=]() {
-        // Create a car moving left to right and set its position, scale, and rotation
-        Carro *c3 = new Carro(QPixmap(":/imagens/carro3.png"), 775, -775, 650 / 2 - 295, 650 / 2 - 295);
-        c3->setScale(0.3);    // Scale the car
-        c3->setRotation(90);  // Rotate to face the correct direction
-        addItem(c3);          // Add the car to the scene
-    });
+// Requested pace.
+double Scene::timeScale() const
+{
+    if (replay)
+        return replayScale;
+    return runner ? runner->timeScale() : 0;
 }
 
-// Set up the top vertical lane timer, which spawns cars moving from top to bottom periodically.
-void Scene::setUpCarTvTimer()
+// One step of the simulation; the next frame shows it.
+void Scene::stepOnce()
 {
-    carTvTimer = new QTimer(this);  // Create a new timer for the top vertical lane
+    if (replay)
+        seek(qint64(replayMs) + replay->tickMs());
+    else if (runner)
+        runner->step();
+}
 
-    // Connect the timer to a lambda function to add new cars to the top vertical lane
-    connect(carTvTimer, &QTimer::timeout, [=]() {
-        // Create two cars moving top to bottom and set their positions, scale, and rotation
-        Carro *c2 = new Carro(QPixmap(":/imagens/carro2.png"), 775 / 2 + 200, 775 / 2 + 260, 650 / 2 - 300, 600);
-        c2->setScale(0.27);   // Scale the car
-        c2->setRotation(180); // Rotate to face the correct direction
-        addItem(c2);          // Add the car to the scene
+// Names from the layout.
+const QStringList &Scene::approachNames() const
+{
+    return approaches;
+}
 
+// Live simulations are not replays.
+bool Scene::isReplay() const
+{
+    return replay != nullptr;
+}
 
-        // Create a second car for the top vertical lane, positioned to the left of the first car
-        Carro *c2_left = new Carro(QPixmap(":/imagens/carro2.png"), 775 / 2 - 145, 775 / 2 - 145, 650 / 2 - 300, 600);
-        c2_left->setScale(0.27);   // Scale the car
-        c2_left->setRotation(180); // Rotate to face the correct direction
-        addItem(c2_left);          // Add the car to the scene
+// First recorded frame.
+qint64 Scene::replayStartMs() const
+{
+    return replay ? replay->startMs() : 0;
+}
 
-    });
+// Last recorded frame.
+qint64 Scene::replayEndMs() const
+{
+    return replay ? replay->endMs() : 0;
+}
 
-    // Uncomment the line below to start the carTvTimer with an initial interval of 300 milliseconds
-    // carTvTimer->start(300);
+// Only the replay time changes; frame() decodes what it needs.
+void Scene::seek(qint64 timeMs)
+{
+    if (replay)
+        replayMs = double(qBound(qint64(replay->startMs()), timeMs, qint64(replay->endMs())));
 }
 
-// Set up the bottom vertical lane timer, which spawns cars moving from bottom to top periodically.
-void Scene::setUpCarBvTimer()
+// The runner keeps its thread, paused; the replay time stays where it is.
+void Scene::showSnapshot(const SimSnapshot *snapshot, float alpha)
 {
-    carBvTimer = new QTimer(this);  // Create a new timer for the bottom vertical lane
+    frameTimer->stop();
+    if (runner && runner->timeScale() != 0)
+        runner->setTimeScale(0);
+    shown = snapshot;
+    vehicleLayer->setSnapshot(shown, alpha);
+    syncItems();
+}
+
+// Any later repaint of a view shows the new picture.
+void Scene::setBackdrop(const QPixmap &picture, const QRectF &rect)
+{
+    backdrop = picture;
+    backdropRect = rect;
+    invalidate(QRectF(), QGraphicsScene::BackgroundLayer);  // Drops the views' cached backgrounds
+}
 
-    // Connect the timer to a lambda function to add new cars to the bottom vertical lane
-    connect(carBvTimer, &QTimer::timeout, [=]() {
-        // Create a car moving from bottom to top and set its position, scale, and rotation
-        Carro *c1 = new Carro(QPixmap(":/imagens/carro.png"), 775 / 2 + 200, 775 / 2 + 200, 650 / 2 + 135, 650 / 2 - 480);
-        c1->setScale(0.10);   // Scale the car
-        addItem(c1);          // Add the car to the scene
+// Lanes (as the car layer bounds them) and lights.
+QRectF Scene::layoutRect() const
+{
+    QRectF rect = vehicleLayer->boundingRect();
+    for (const Semaforo *semaforo : semaforos)
+        rect |= semaforo->sceneBoundingRect();
+    return rect;
+}
 
-        // Create a second car for the bottom vertical lane, positioned to the left of the first car
-        Carro *c1_left = new Carro(QPixmap(":/imagens/carro.png"), 775 / 2 - 200, 775 / 2 - 200, 650 / 2 + 135, 650 / 2 - 480);
-        c1_left->setScale(0.10);   // Scale the car
-        addItem(c1_left);         // Add the car to the scene
-    });
+// Snapshot of the last frame.
+const SimSnapshot &Scene::snapshot() const
+{
+    return *shown;
+}
+
+// Take the newest snapshot and draw it where the simulation stands now, between its last two steps.
+void Scene::frame()
+{
+    if (replay) {
+        // Replay time follows the wall clock at the selected pace; "as fast as possible" has no
+        // meaning for a recording, so it plays at the fastest slider speed
+        const double elapsedMs = replayClock.nsecsElapsed() / 1e6;
+        replayClock.restart();
+        replayMs = qMin(replayMs + elapsedMs * (replayScale < 0 ? 1000 : replayScale), double(replay->endMs()));
+        vehicleLayer->setSnapshot(shown, replay->show(qint64(replayMs), replayFrame));
+        syncItems();
+        emit timeChanged(qint64(replayMs));
+        return;
+    }
+    if (!runner)
+        return;
+
+    shown = &runner->snapshot();
+    const std::int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    vehicleLayer->setSnapshot(shown, shown->alphaAt(now));
+    syncItems();
+}
 
-    // Uncomment the line below to start the carBvTimer with an initial interval of 1000 milliseconds
-    // carBvTimer->start(1000);
+// Mirror the snapshot into the scene: light colours. The car layer already scheduled the
+// repaint of the cars that moved when it was given the snapshot.
+void Scene::syncItems()
+{
+    // Lights: same order as in the simulation; an unchanged light does nothing
+    for (int i = 0; i < semaforos.size(); ++i)
+        semaforos[i]->setEstado(shown->lightGreen[i] != 0);
+}
+
+// Start of a frame painted by a view, called before its paint event.
+void Scene::beginFrame(quint64 pixels)
+{
+    if (!Telemetry::enabled())
+        return;
+    renderStartNs = Telemetry::now();
+    Telemetry::count(TelemetryCounter::RepaintedPixels, pixels);
+}
+
+// Background brush, then the backdrop. Starts the frame timing of a render without a view; a
+// view started it in beginFrame(), and may not even call this when its background is cached.
+void Scene::drawBackground(QPainter *painter, const QRectF &rect)
+{
+    if (!renderStartNs && Telemetry::enabled())
+        renderStartNs = Telemetry::now();
+    QGraphicsScene::drawBackground(painter, rect);
+    if (!backdrop.isNull() && backdropRect.intersects(rect))
+        painter->drawPixmap(backdropRect, backdrop, QRectF(backdrop.rect()));
+}
+
+// End of a rendered frame: the foreground comes after every item.
+void Scene::drawForeground(QPainter *painter, const QRectF &rect)
+{
+    QGraphicsScene::drawForeground(painter, rect);
+    if (renderStartNs) {
+        Telemetry::time(TelemetryTiming::Frame, Telemetry::now() - renderStartNs);
+        Telemetry::count(TelemetryCounter::Frames);
+        renderStartNs = 0;
+    }
 }
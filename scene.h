@@ -3,54 +3,154 @@
 
 // Include necessary Qt classes and custom classes
 #include <QObject>           // Base class for all Qt objects, enables signal/slot mechanism
+#include <QElapsedTimer>     // Wall time between replay frames
+#include <QFile>             // Memory-mapped recording
 #include <QGraphicsScene>    // Provides the base class for 2D graphic scenes (used for visual content like a game or simulation)
-#include <QTimer>            // Allows timed events, frequently used for animations or periodic actions
-#include "semaforo.h"        // Custom class, likely representing a traffic light (Semáforo is Portuguese for traffic light)
+#include <QPixmap>           // Picture under the layout
+#include <QStringList>       // Approach names
+#include <QTimer>            // Allows timed events, used here to refresh the frame
+#include <QVector>           // Holds the traffic light items
+#include "replay.h"          // Playback of recorded runs
+#include "semaforo.h"        // Custom class representing a traffic light (Semáforo is Portuguese for traffic light)
+#include "simrunner.h"       // Worker thread running the simulation this scene draws
+#include "vehiclelayer.h"    // Single item drawing every car
 
+// Scene is a thin renderer: all traffic logic lives in Simulation, which a SimulationRunner
+// steps on its own thread. On every frame the scene takes the newest snapshot and mirrors it
+// into items, so a slow paint never slows the simulation down. A recorded run is drawn the same
+// way, from snapshots a TrajectoryReplay fills at the replay time.
 class Scene : public QGraphicsScene
 {
     Q_OBJECT  // Enables Qt's signal/slot mechanism, meta-object system for this class
 
 public:
+    // What moves the scene.
+    enum Mode
+    {
+        Live,           // Its own simulation thread (or replay), shown by a frame timer
+        DisplayOnly     // Nothing: only the snapshots given to showSnapshot(), e.g. by a frame export
+    };
+
     // Constructor: Initializes the scene, optionally with a parent QObject.
-    // The scene is responsible for managing graphical items (cars, traffic lights, etc.) and their interactions.
-    explicit Scene(QObject *parent = nullptr);
+    // `layout` selects what is simulated: empty for the crossing drawn over cross.jpg, a scenario
+    // JSON file, or "grid:CxR" for a city grid of C x R intersections. The scene builds it in its
+    // simulation and creates the traffic light items. A ".trj" file recorded by the batch runner
+    // (--record) is memory-mapped and played back instead. In DisplayOnly mode the layout only
+    // gives the items: no simulation thread starts, and the scene shows the empty road until the
+    // first showSnapshot(); start(), stop() and stepOnce() do nothing.
+    explicit Scene(const QString &layout = QString(), QObject *parent = nullptr, Mode mode = Live);
+
+    // Destructor: stops the simulation thread (or the replay) before the items reading its snapshots go away.
+    ~Scene();
+
+    // Simulation of `layout` (anything but a recording), built as the constructor builds it: a
+    // scenario that cannot be read falls back to the original crossing, with a warning.
+    static Simulation buildSimulation(const QString &layout);
+
+    // Area covered by the lanes and lights of the layout.
+    QRectF layoutRect() const;
 
-    // Starts the scene's operation, typically starting the timers and enabling animations/events.
+    // Picture drawn over `rect` as part of the background, under every item (e.g. cross.jpg
+    // under the original crossing). Being background, a view can cache it pre-rendered
+    // (QGraphicsView::CacheBackground) instead of repainting it under every moving car.
+    void setBackdrop(const QPixmap &picture, const QRectF &rect);
+
+    // Start of a repaint of `pixels` viewport pixels by a view showing the scene: starts the frame
+    // timing, which drawBackground() cannot do when the view draws a cached background, and
+    // counts the pixels for the telemetry.
+    void beginFrame(quint64 pixels);
+
+    // Starts the light cycle of the simulation. A replay that reached its end starts over.
     void start();
 
-    // Stops the scene's operation, usually stopping the timers and halting animations/events.
+    // Stops spawning and turns every light red; cars already on the road stop at their stop line.
+    // A recording cannot be changed, so a replay ignores it.
     void stop();
 
-private:
-    // QTimers to manage different car-related events in the scene (e.g., car movements or traffic light changes).
-    QTimer *carLhTimer;  // Timer for left-to-right horizontal car movement
-    QTimer *carRhTimer;  // Timer for right-to-left horizontal car movement
-    QTimer *carTvTimer;  // Timer for top-to-bottom vertical car movement
-    QTimer *carBvTimer;  // Timer for bottom-to-top vertical car movement
-    QTimer *timerVertical;  // General timer for vertical events (could be for controlling traffic lights or cars)
-    QTimer *timerHorizonTal;  // General timer for horizontal events
-
-    // Boolean flag to indicate the state of the semáforo (traffic lights),
-    // likely toggling between red, yellow, and green or on/off.
-    bool semaforo;
-
-    // Four instances of the Semaforo (traffic light) class, representing multiple traffic lights at intersections or crossings.
-    Semaforo *s1, *s2, *s3, *s4;
-
-    // Private helper methods to set up timers for various car movements in different directions
-    void setUpCarLhTimer();    // Sets up the timer for cars moving left to right (horizontal)
-    void setUpCarRhTimer();    // Sets up the timer for cars moving right to left (horizontal)
-    void setUpCarTvTimer();    // Sets up the timer for cars moving top to bottom (vertical)
-    void setUpCarBvTimer();    // Sets up the timer for cars moving bottom to top (vertical)
-
-    // Methods to configure the general timers for vertical and horizontal operations
-    void setTimerVertical();   // Configures the timer for vertical actions (likely traffic light or car events)
-    void setTimerHorizontal(); // Configures the timer for horizontal actions
+    // Pace of the simulation in simulated ms per real ms: 1 = real time, 0 = paused,
+    // negative = as fast as possible. Cars and lights follow the simulated clock at every pace.
+    void setTimeScale(double scale);
+    double timeScale() const;
+
+    // Advances the simulation by one fixed step (20 ms), e.g. while paused; a replay by one recorded step.
+    void stepOnce();
+
+    // Snapshot shown by the last frame, e.g. for statistics.
+    const SimSnapshot &snapshot() const;
+
+    // Names of the approaches, in the order of the snapshot's approach rows.
+    const QStringList &approachNames() const;
+
+    // True when playing back a recording.
+    bool isReplay() const;
+
+    // Time span of the recording, 0 for a live simulation.
+    qint64 replayStartMs() const;
+    qint64 replayEndMs() const;
+
+    // Moves the replay to `timeMs` (clamped to the recording); the next frame shows it.
+    void seek(qint64 timeMs);
+
+    // Draws `snapshot` (interpolated by `alpha`) from now on, for a caller stepping its own copy of
+    // the layout, e.g. a frame export. The frame timer stops and the scene's own simulation, if
+    // any, is paused. `snapshot` must stay valid until the next call or the destruction of the scene.
+    void showSnapshot(const SimSnapshot *snapshot, float alpha);
 
 signals:
-         // The class defines no signals in this version, but could be used to notify other objects
-         // about events (e.g., traffic light changes, collisions, etc.).
+    // Replay time shown by a frame, emitted on every frame of a replay.
+    void timeChanged(qint64 timeMs);
+
+protected:
+    // A view renders the background (with the backdrop) first and the foreground last: together
+    // they time each frame rendered without a view, e.g. into an image; see beginFrame().
+    void drawBackground(QPainter *painter, const QRectF &rect) override;
+    void drawForeground(QPainter *painter, const QRectF &rect) override;
+
+private:
+    // Simulation state (lanes, lights and cars as plain data) and the thread stepping it; nullptr
+    // in a replay and in DisplayOnly mode.
+    SimulationRunner *runner;
+
+    // Replay state: the mapped recording, its player and the snapshot it fills; nullptr for a live
+    // simulation. In DisplayOnly mode the snapshot holds the empty road of the layout instead.
+    QFile *replayFile;
+    TrajectoryReplay *replay;
+    SimSnapshot replayFrame;
+    double replayMs;             // Replay time; fractional so that slow paces still advance
+    double replayScale;          // Pace, as for setTimeScale()
+    QElapsedTimer replayClock;   // Wall time since the previous frame
+
+    // Maps the recording at `path` and creates its player; false (with a warning) if it cannot be played.
+    bool openReplay(const QString &path);
+
+    // Snapshot being displayed, owned by the runner and valid until the next frame.
+    const SimSnapshot *shown;
+
+    // Timer refreshing the frame.
+    QTimer *frameTimer;
+
+    // Approach names, taken from the layout before the runner owns it.
+    QStringList approaches;
+
+    // Steady-clock time at which the frame being rendered started, 0 outside of a render.
+    quint64 renderStartNs;
+
+    // Picture under the layout and the area it covers; null for none.
+    QPixmap backdrop;
+    QRectF backdropRect;
+
+    // One item per light of the simulation (s1..s4 of the original crossing).
+    QVector<Semaforo *> semaforos;
+
+    // Single item drawing all cars of the simulation in one paint pass.
+    VehicleLayer *vehicleLayer;
+
+    // Takes the newest snapshot and redraws.
+    void frame();
+
+    // Copies the light states of the shown snapshot into the light items; only the lights that
+    // changed repaint.
+    void syncItems();
 };
 
 #endif // SCENE_H
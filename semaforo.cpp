@@ -1,12 +1,23 @@
 #include "semaforo.h"
+#include "spritecache.h"
+#include "vehiclelayer.h"        // Zoom level below which cars are no longer drawn as images
 #include <QGraphicsScene>
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
 
 // Constructor for the Semaforo class
-// Initializes the traffic light with a pixmap and sets its initial state (on/off)
-Semaforo::Semaforo(QPixmap pixmap, bool estado)
-    : QGraphicsPixmapItem{pixmap} // Initialize the base class with the given pixmap
+// Takes both images from the sprite cache once and sets the initial state (on/off)
+Semaforo::Semaforo(qreal scale, qreal rotation, bool estado)
 {
-    setEstado(estado); // Set the initial state of the traffic light
+    CachedSprite redSprite = SpriteCache::instance().transformed(":/imagens/semaforoRed.png", scale, rotation);
+    CachedSprite greenSprite = SpriteCache::instance().transformed(":/imagens/semaforoGreen.png", scale, rotation);
+    red = redSprite.pixmap;
+    green = greenSprite.pixmap;
+    setOffset(redSprite.offset); // Both images have the same size, so they share the offset
+
+    // Set the initial state of the traffic light
+    this->estado = estado;
+    setPixmap(estado ? green : red);
 }
 
 // Getter method for the state of the traffic light
@@ -17,17 +28,31 @@ bool Semaforo::getEstado() const
 }
 
 // Setter method for the state of the traffic light
-// Updates the state and changes the pixmap based on the new state
+// Updates the state and changes the pixmap based on the new state. Setting the current state
+// again does nothing: swapping the pixmap would repaint the light for no change.
 void Semaforo::setEstado(bool newEstado)
 {
+    if (newEstado == estado)
+        return;
     estado = newEstado; // Update the internal state
 
     // Update the pixmap based on the state
     if (estado == 0) {
         // Set pixmap to red traffic light image when state is 0 (off/red)
-        setPixmap(QPixmap(":/imagens/semaforoRed.png"));
+        setPixmap(red);
     } else {
         // Set pixmap to green traffic light image when state is 1 (on/green)
-        setPixmap(QPixmap(":/imagens/semaforoGreen.png"));
+        setPixmap(green);
+    }
+}
+
+// Level of detail: below the zoom at which cars become dots, the light becomes a coloured square
+// the size of its image, which costs a fill instead of a scaled pixmap blit.
+void Semaforo::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    if (QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform()) >= VehicleLayer::SpriteDetail) {
+        QGraphicsPixmapItem::paint(painter, option, widget);
+        return;
     }
+    painter->fillRect(boundingRect(), estado ? QColor(40, 200, 60) : QColor(220, 40, 40));
 }
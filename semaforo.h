@@ -4,6 +4,7 @@
 // Include necessary Qt classes
 #include <QObject>                // Base class for all Qt objects, providing signal/slot support
 #include <QGraphicsPixmapItem>    // Allows the class to represent a pixmap (image) in a QGraphicsScene
+#include <QPixmap>                // Red and green images of the light
 
 // Semaforo class represents a traffic light in the graphical scene. It inherits from QObject
 // to use Qt's signal/slot system and QGraphicsPixmapItem to display a graphical image.
@@ -12,9 +13,10 @@ class Semaforo : public QObject, public QGraphicsPixmapItem
     Q_OBJECT  // Required for any class that uses Qt's signal/slot system or meta-object features
 
 public:
-    // Constructor: Initializes the traffic light (Semaforo) with an image (QPixmap)
-    // and an initial state (true or false). The state (`estado`) likely represents whether the light is on or off.
-    explicit Semaforo(QPixmap pixmap, bool estado);
+    // Constructor: Initializes the traffic light (Semaforo) drawn with the given scale and rotation,
+    // and an initial state (true = green, false = red). The red and green images are taken from the
+    // sprite cache already scaled and rotated, so the item itself draws them without a transform.
+    explicit Semaforo(qreal scale, qreal rotation, bool estado);
 
     // Getter for the `estado` variable, which returns the current state of the traffic light.
     // The state could represent whether the traffic light is green (true) or red (false), for example.
@@ -22,13 +24,21 @@ public:
 
     // Setter for the `estado` variable, which changes the state of the traffic light.
     // This would typically be used to toggle the traffic light between on and off states or switch between colors.
+    // Setting the current state again is a no-op, so callers may set every light on every change.
     void setEstado(bool newEstado);
 
+    // Draws the image, or just a red or green square when the view is zoomed out too far for it to be seen.
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+
 private:
     // A boolean representing the current state of the traffic light.
     // It could be used to indicate if the light is red/green, on/off, etc.
     bool estado;
 
+    // Pre-transformed red and green images, shared with every other light drawn the same way.
+    QPixmap red;
+    QPixmap green;
+
 signals:
          // This is where signals would be declared. Signals could be used to notify other objects when the state changes,
          // but no signals are defined in this version of the class.
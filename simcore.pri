@@ -0,0 +1,47 @@
+# Headless simulation core shared by the GUI application and the batch runner.
+# It only uses standard C++, so it builds without Qt widgets.
+
+CONFIG += thread
+
+# The scalar and AVX2 car kernels give bit-identical results only if the compiler rounds every
+# product and sum as written, without fusing them into multiply-adds (see kinematics.h)
+!msvc: QMAKE_CXXFLAGS += -ffp-contract=off
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/kinematics.cpp \
+    $$PWD/metrics.cpp \
+    $$PWD/network.cpp \
+    $$PWD/recorder.cpp \
+    $$PWD/replay.cpp \
+    $$PWD/rng.cpp \
+    $$PWD/scenario.cpp \
+    $$PWD/simrunner.cpp \
+    $$PWD/simsnapshot.cpp \
+    $$PWD/simstate.cpp \
+    $$PWD/simulation.cpp \
+    $$PWD/soak.cpp \
+    $$PWD/spatialgrid.cpp \
+    $$PWD/sweep.cpp \
+    $$PWD/telemetry.cpp \
+    $$PWD/trajectory.cpp \
+    $$PWD/vehiclepool.cpp
+
+HEADERS += \
+    $$PWD/kinematics.h \
+    $$PWD/metrics.h \
+    $$PWD/network.h \
+    $$PWD/recorder.h \
+    $$PWD/replay.h \
+    $$PWD/rng.h \
+    $$PWD/scenario.h \
+    $$PWD/simrunner.h \
+    $$PWD/simsnapshot.h \
+    $$PWD/simulation.h \
+    $$PWD/soak.h \
+    $$PWD/spatialgrid.h \
+    $$PWD/sweep.h \
+    $$PWD/telemetry.h \
+    $$PWD/trajectory.h \
+    $$PWD/vehiclepool.h
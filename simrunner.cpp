@@ -0,0 +1,187 @@
+#include "simrunner.h"   // Header file for the SimulationRunner class
+#include <algorithm>     // std::max
+#include <chrono>        // Wall-clock pacing
+#include <limits>        // Unbounded target when running as fast as possible
+
+using Clock = std::chrono::steady_clock;
+
+// Nanoseconds of the steady clock, as stored in snapshots.
+static std::int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+// Constructor: publishes the initial state, so the renderer has something to draw, then starts the worker.
+SimulationRunner::SimulationRunner(Simulation sim)
+    : m_sim(std::move(sim))
+    , m_scale(1)
+    , m_steps(0)
+    , m_scaleChanged(false)
+    , m_quit(false)
+{
+    m_previous.capture(m_sim);
+    publish(m_scale);
+    m_thread = std::thread(&SimulationRunner::run, this);
+}
+
+// Destructor: asks the worker to return and waits for it.
+SimulationRunner::~SimulationRunner()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+    m_thread.join();
+}
+
+// Queues the command and wakes the worker.
+void SimulationRunner::post(std::function<void(Simulation &)> command)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_commands.push_back(std::move(command));
+    }
+    m_wake.notify_all();
+}
+
+// Changes the pace; the worker continues from the current simulated time.
+void SimulationRunner::setTimeScale(double scale)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_scale = scale;
+        m_scaleChanged = true;
+    }
+    m_wake.notify_all();
+}
+
+// Requested pace.
+double SimulationRunner::timeScale() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_scale;
+}
+
+// Queues single steps and wakes the worker.
+void SimulationRunner::step(int steps)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_steps += steps;
+    }
+    m_wake.notify_all();
+}
+
+// Newest published snapshot.
+const SimSnapshot &SimulationRunner::snapshot()
+{
+    return m_snapshots.acquire();
+}
+
+// Fills and publishes the back snapshot.
+void SimulationRunner::publish(double scale)
+{
+    SimSnapshot &snapshot = m_snapshots.back();
+    snapshot.capture(m_sim, m_previous);
+    snapshot.timeScale = scale;
+    snapshot.publishedNs = nowNs();
+    m_snapshots.publish();
+}
+
+// The simulated clock follows the wall clock from an anchor: target = anchorSim + elapsed * scale.
+// Steps due run in batches of at most BatchBudgetMs; the positions before the last step of a batch
+// are kept so the snapshot spans the last two steps. A worker that cannot keep up re-anchors
+// instead of piling up backlog, i.e. the simulation runs slower than asked rather than freezing.
+void SimulationRunner::run()
+{
+    Clock::time_point anchorWall = Clock::now();
+    std::int64_t anchorSim = m_sim.timeMs();
+    Clock::time_point lastPublish = anchorWall;
+    double scale = 1;
+    int steps = 0;
+    std::vector<std::function<void(Simulation &)>> commands;
+
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_quit)
+                return;
+            commands.swap(m_commands);
+            steps = m_steps;
+            m_steps = 0;
+            if (m_scaleChanged) {
+                scale = m_scale;
+                anchorWall = Clock::now();
+                anchorSim = m_sim.timeMs();
+                m_scaleChanged = false;
+            }
+        }
+
+        // Commands first, then a snapshot so their effect (e.g. lights turning red) shows at once
+        if (!commands.empty()) {
+            for (const auto &command : commands)
+                command(m_sim);
+            commands.clear();
+            m_previous.capture(m_sim);
+            publish(scale);
+            lastPublish = Clock::now();
+        }
+
+        // Single steps; the paced clock continues from where they end
+        if (steps > 0) {
+            for (; steps > 0; --steps) {
+                m_previous.capture(m_sim);
+                m_sim.step();
+            }
+            publish(scale);
+            lastPublish = Clock::now();
+            anchorWall = lastPublish;
+            anchorSim = m_sim.timeMs();
+        }
+
+        // Simulated time the wall clock asks for
+        const Clock::time_point now = Clock::now();
+        std::int64_t target = m_sim.timeMs();
+        if (scale < 0)
+            target = std::numeric_limits<std::int64_t>::max();
+        else if (scale > 0)
+            target = anchorSim + std::int64_t(std::chrono::duration<double, std::milli>(now - anchorWall).count() * scale);
+
+        if (m_sim.timeMs() + Simulation::TickMs <= target) {
+            const Clock::time_point deadline = now + std::chrono::milliseconds(BatchBudgetMs);
+            for (;;) {
+                const bool last = m_sim.timeMs() + 2 * Simulation::TickMs > target || Clock::now() >= deadline;
+                if (last) {
+                    m_previous.capture(m_sim);
+                    m_sim.step();
+                    break;
+                }
+                m_sim.step();
+            }
+            publish(scale);
+            lastPublish = Clock::now();
+
+            // More than a quarter second of wall time behind: give up the backlog
+            if (scale > 0 && target - m_sim.timeMs() > std::int64_t(250 * scale)) {
+                anchorWall = Clock::now();
+                anchorSim = m_sim.timeMs();
+            }
+            if (scale < 0)
+                continue;  // As fast as possible: no waiting at all
+        }
+
+        // Sleep until the next step is due, but not less than the publication interval
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto ready = [&] { return m_quit || m_scaleChanged || m_steps > 0 || !m_commands.empty(); };
+        if (scale <= 0) {
+            m_wake.wait(lock, ready);  // Paused: only a command or a new scale can change anything
+        } else {
+            const double nextMs = double(m_sim.timeMs() + Simulation::TickMs - anchorSim) / scale;
+            Clock::time_point due = anchorWall + std::chrono::duration_cast<Clock::duration>(
+                                                     std::chrono::duration<double, std::milli>(nextMs));
+            due = std::max(due, lastPublish + std::chrono::milliseconds(PublishIntervalMs));
+            m_wake.wait_until(lock, due, ready);
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef SIMRUNNER_H
+#define SIMRUNNER_H
+
+#include <condition_variable>  // Wakes the worker for commands
+#include <functional>          // Commands run on the worker thread
+#include <mutex>
+#include <thread>              // The worker thread
+#include <vector>              // Pending commands
+#include "simulation.h"        // The simulation the worker owns
+#include "simsnapshot.h"       // What the worker publishes
+
+// Runs a Simulation on a worker thread, paced against the wall clock, and publishes snapshots
+// for a renderer. The simulation steps at its own fixed rate whatever the display does: the
+// renderer samples the newest snapshot at its own refresh rate and interpolates between the
+// last two steps, and a busy GUI thread never holds the worker back.
+//
+// Everything that changes the simulation goes through post(), so only the worker ever touches it.
+class SimulationRunner
+{
+public:
+    // Constructor: takes over `sim` and starts the worker thread.
+    explicit SimulationRunner(Simulation sim);
+
+    // Destructor: stops and joins the worker thread.
+    ~SimulationRunner();
+
+    SimulationRunner(const SimulationRunner &) = delete;
+    SimulationRunner &operator=(const SimulationRunner &) = delete;
+
+    // Queues `command` to run on the worker thread between two steps; a snapshot follows it.
+    void post(std::function<void(Simulation &)> command);
+
+    // Simulated milliseconds per wall-clock millisecond: 1 = real time, 0 = paused,
+    // negative = as fast as the worker can step.
+    void setTimeScale(double scale);
+    double timeScale() const;
+
+    // Advances the simulation by `steps` fixed steps, whatever the time scale; meant for a paused run.
+    void step(int steps = 1);
+
+    // Newest snapshot, valid until the next call (reader thread only).
+    const SimSnapshot &snapshot();
+
+    // Shortest wall time between two publications: faster stepping publishes batches of steps.
+    static constexpr int PublishIntervalMs = 4;
+
+    // Wall time a batch of steps may take before the worker publishes and checks for commands.
+    static constexpr int BatchBudgetMs = 8;
+
+private:
+    // Worker thread body.
+    void run();
+
+    // Captures the simulation into the back snapshot and publishes it.
+    void publish(double scale);
+
+    Simulation m_sim;                   // Owned by the worker thread once it runs
+    SnapshotBuffer m_snapshots;         // Worker -> renderer
+    SimPositions m_previous;            // Slots one step before the next snapshot
+
+    mutable std::mutex m_mutex;         // Guards the members below
+    std::condition_variable m_wake;     // Signalled on commands, steps, scale changes and quit
+    std::vector<std::function<void(Simulation &)>> m_commands;  // Waiting to run
+    double m_scale;                     // Requested time scale
+    int m_steps;                        // Single steps requested with step()
+    bool m_scaleChanged;                // The worker must re-anchor its clock
+    bool m_quit;                        // The worker must return
+
+    std::thread m_thread;               // Started last, once every member is ready
+};
+
+#endif // SIMRUNNER_H
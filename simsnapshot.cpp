@@ -0,0 +1,200 @@
+#include "simsnapshot.h"   // Header file for SimSnapshot and SnapshotBuffer
+#include "simulation.h"    // Source of the captured state
+#include "trajectory.h"    // Recorded frames
+#include <algorithm>       // std::min, std::max
+#include <utility>         // std::swap
+
+// Copies position, id and state of every slot below the high-water mark.
+void SimPositions::capture(const Simulation &sim)
+{
+    const VehiclePool &pool = sim.vehicles();
+    const int end = pool.highWater();
+    x.assign(pool.x.begin(), pool.x.begin() + end);
+    y.assign(pool.y.begin(), pool.y.begin() + end);
+    id.assign(pool.id.begin(), pool.id.begin() + end);
+    state.assign(pool.state.begin(), pool.state.begin() + end);
+}
+
+// Constructor: an empty snapshot at time zero.
+SimSnapshot::SimSnapshot()
+    : timeMs(0)
+    , timeScale(0)
+    , publishedNs(0)
+    , conflicts(0)
+    , spawned(0)
+    , despawned(0)
+    , grid(0, 0, 800, 800, 64)
+    , m_gridReady(false)
+{
+}
+
+// Cars in the snapshot.
+int SimSnapshot::count() const
+{
+    return int(x.size());
+}
+
+// Packs the live slots densely; a slot holding the same car one step earlier gives the
+// previous position. The arrays keep their capacity, so capturing does not allocate once warm.
+void SimSnapshot::capture(const Simulation &sim, const SimPositions &previous)
+{
+    const VehiclePool &pool = sim.vehicles();
+    const std::vector<SimLane> &lanes = sim.lanes();
+    const int end = pool.highWater();
+    const int known = int(previous.x.size());
+
+    x.clear();
+    y.clear();
+    prevX.clear();
+    prevY.clear();
+    lane.clear();
+    id.clear();
+    state.clear();
+    for (int slot = 0; slot < end; ++slot) {
+        if (pool.state[slot] == VehiclePool::Free)
+            continue;
+        const bool same = slot < known && previous.state[slot] != VehiclePool::Free && previous.id[slot] == pool.id[slot];
+        x.push_back(pool.x[slot]);
+        y.push_back(pool.y[slot]);
+        prevX.push_back(same ? previous.x[slot] : pool.x[slot]);
+        prevY.push_back(same ? previous.y[slot] : pool.y[slot]);
+        lane.push_back(pool.lane[slot]);
+        id.push_back(pool.id[slot]);
+        state.push_back(pool.state[slot]);
+    }
+    index(sim);
+
+    lightGreen.resize(sim.lights().size());
+    for (std::size_t i = 0; i < lightGreen.size(); ++i)
+        lightGreen[i] = sim.lights()[i].green ? 1 : 0;
+    laneLoad.resize(lanes.size());
+    for (std::size_t l = 0; l < lanes.size(); ++l)
+        laneLoad[l] = lanes[l].count + int(lanes[l].waiting.size());
+    const std::vector<SimApproachStats> &approaches = sim.approachStats();
+    approachThroughput.resize(approaches.size());
+    approachQueue.resize(approaches.size());
+    approachDelay.resize(approaches.size());
+    for (std::size_t a = 0; a < approaches.size(); ++a) {
+        approachThroughput[a] = approaches[a].delays.count();
+        approachQueue[a] = approaches[a].queue;
+        approachDelay[a] = float(approaches[a].delays.mean());
+    }
+
+    timeMs = sim.timeMs();
+    conflicts = sim.totalConflicts();
+    spawned = sim.spawnedCount();
+    despawned = sim.despawnedCount();
+}
+
+// Both frames list their cars in slot order, so the cars present in both are matched by walking
+// the two lists together; a slot holding another car id was reused and has no earlier position.
+void SimSnapshot::capture(const TrajectoryFrame &previous, const TrajectoryFrame &current, const Simulation &layout)
+{
+    x.clear();
+    y.clear();
+    prevX.clear();
+    prevY.clear();
+    lane.clear();
+    id.clear();
+    state.clear();
+    std::size_t p = 0;
+    for (const TrajectoryCar &car : current.cars) {
+        while (p < previous.cars.size() && previous.cars[p].slot < car.slot)
+            ++p;
+        const bool same = p < previous.cars.size() && previous.cars[p].slot == car.slot && previous.cars[p].id == car.id;
+        x.push_back(car.x);
+        y.push_back(car.y);
+        prevX.push_back(same ? previous.cars[p].x : car.x);
+        prevY.push_back(same ? previous.cars[p].y : car.y);
+        lane.push_back(car.lane);
+        id.push_back(car.id);
+        state.push_back(car.state);
+    }
+    index(layout);
+
+    // Lane loads count the cars on each lane; cars waiting to enter are not recorded
+    lightGreen = current.lightGreen;
+    laneLoad.assign(layout.lanes().size(), 0);
+    for (std::int32_t l : lane)
+        ++laneLoad[l];
+    approachThroughput.clear();
+    approachQueue.clear();
+    approachDelay.clear();
+
+    // Totals are not recorded; the replay paces itself, so no clock is published
+    timeMs = current.timeMs;
+    timeScale = 0;
+    publishedNs = 0;
+    conflicts = 0;
+    spawned = 0;
+    despawned = 0;
+}
+
+// Boxes from the lane bodies, then the grid; the arrays keep their capacity.
+void SimSnapshot::index(const Simulation &layout)
+{
+    const std::vector<SimLane> &lanes = layout.lanes();
+    const int cars = count();
+    minX.resize(cars);
+    minY.resize(cars);
+    maxX.resize(cars);
+    maxY.resize(cars);
+    for (int i = 0; i < cars; ++i) {
+        const SimLane &carLane = lanes[lane[i]];
+        minX[i] = float(x[i] + carLane.bodyX);
+        minY[i] = float(y[i] + carLane.bodyY);
+        maxX[i] = float(minX[i] + carLane.bodyW);
+        maxY[i] = float(minY[i] + carLane.bodyH);
+    }
+    live.assign(cars, 1);
+
+    // Same cells as the simulation's own index; the tables are copied only the first time
+    if (!m_gridReady) {
+        grid = layout.grid();
+        m_gridReady = true;
+    }
+    grid.build(minX.data(), minY.data(), maxX.data(), maxY.data(), live.data(), cars);
+}
+
+// Progress through the step that follows the snapshot, in simulated time.
+float SimSnapshot::alphaAt(std::int64_t nowNs) const
+{
+    if (timeScale <= 0)
+        return 1;  // Paused, or too fast for interpolation to matter
+    const double elapsedMs = double(nowNs - publishedNs) / 1e6 * timeScale;
+    return float(std::min(1.0, std::max(0.0, elapsedMs / Simulation::TickMs)));
+}
+
+// Constructor: the reader starts on an empty snapshot.
+SnapshotBuffer::SnapshotBuffer()
+    : m_back(0)
+    , m_ready(1)
+    , m_front(2)
+    , m_fresh(false)
+{
+}
+
+// The writer's snapshot.
+SimSnapshot &SnapshotBuffer::back()
+{
+    return m_snapshots[m_back];
+}
+
+// Makes the back snapshot the newest one.
+void SnapshotBuffer::publish()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::swap(m_back, m_ready);
+    m_fresh = true;
+}
+
+// Takes the newest snapshot if there is one, otherwise keeps the current one.
+const SimSnapshot &SnapshotBuffer::acquire()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_fresh) {
+        std::swap(m_front, m_ready);
+        m_fresh = false;
+    }
+    return m_snapshots[m_front];
+}
@@ -0,0 +1,104 @@
+#ifndef SIMSNAPSHOT_H
+#define SIMSNAPSHOT_H
+
+#include <cstdint>        // Clock values and ids
+#include <mutex>          // Guards the buffer swap
+#include <vector>         // Per-car and per-lane arrays
+#include "spatialgrid.h"  // Index of the captured cars, for culling
+
+class Simulation;
+struct TrajectoryFrame;
+
+// Positions of every slot of a simulation, captured one step before a snapshot so that the
+// snapshot can carry both of the last two steps.
+struct SimPositions
+{
+    std::vector<float> x, y;            // Position per slot
+    std::vector<std::uint32_t> id;      // Car in the slot, to tell a reused slot from the same car
+    std::vector<std::uint8_t> state;    // VehiclePool::State per slot
+
+    // Copies the slots in use.
+    void capture(const Simulation &sim);
+};
+
+// Copy of what a renderer needs from a simulation at one instant: cars (densely packed, with
+// their position at this step and at the previous one), light states, lane loads and totals.
+// Renderers only ever read snapshots, so they never touch a simulation another thread is stepping.
+struct SimSnapshot
+{
+    std::int64_t timeMs;                // Simulated time of the current positions
+    double timeScale;                   // Simulated ms per wall-clock ms when published; 0 = paused,
+                                        // negative = as fast as possible
+    std::int64_t publishedNs;           // Steady-clock time of publication, in nanoseconds
+
+    // Cars, one entry each
+    std::vector<float> x, y;            // Position at timeMs
+    std::vector<float> prevX, prevY;    // Position one step earlier (equal to x, y for new cars)
+    std::vector<std::int32_t> lane;     // Lane of the car
+    std::vector<std::uint32_t> id;      // Car id
+    std::vector<std::uint8_t> state;    // VehiclePool::State
+
+    std::vector<std::uint8_t> lightGreen;   // Per light: 1 = green
+    std::vector<std::int32_t> laneLoad;     // Per lane: cars on it plus cars waiting to enter
+
+    // Per approach, empty in a replay
+    std::vector<std::uint64_t> approachThroughput;  // Cars that left the scene
+    std::vector<std::int32_t> approachQueue;        // Cars queued now
+    std::vector<float> approachDelay;               // Mean delay in seconds
+
+    std::uint64_t conflicts;            // Simulation::totalConflicts()
+    std::uint64_t spawned;              // Simulation::spawnedCount()
+    std::uint64_t despawned;            // Simulation::despawnedCount()
+
+    // Car boxes at timeMs and their index, so a renderer can look up what is on screen
+    std::vector<float> minX, minY, maxX, maxY;
+    std::vector<std::uint8_t> live;
+    SpatialGrid grid;
+
+    SimSnapshot();
+
+    // Number of cars.
+    int count() const;
+
+    // Fills the snapshot from `sim`; `previous` holds the slots one step earlier.
+    void capture(const Simulation &sim, const SimPositions &previous);
+
+    // Fills the snapshot from a recording: cars and lights of `current`, earlier positions from
+    // `previous` for the cars present in both. `layout` gives the lanes and the grid cells.
+    void capture(const TrajectoryFrame &previous, const TrajectoryFrame &current, const Simulation &layout);
+
+    // Interpolation factor between the previous and the current positions at steady-clock time `nowNs`:
+    // 0 right after publication, reaching 1 one simulation step of wall time later.
+    float alphaAt(std::int64_t nowNs) const;
+
+private:
+    // Computes the car boxes from the positions and indexes them.
+    void index(const Simulation &layout);
+
+    bool m_gridReady;                   // The grid has the simulation's dimensions
+};
+
+// Hands snapshots from one writer thread to one reader thread without either waiting for the other.
+// Three snapshots rotate: the writer fills `back`, publish() swaps it with `ready`, and acquire()
+// swaps `ready` with `front` if a newer one was published. The reader keeps using its front
+// snapshot while the writer already fills the next one; the lock only covers the index swaps.
+class SnapshotBuffer
+{
+public:
+    SnapshotBuffer();
+
+    // Writer side: the snapshot to fill, and its publication.
+    SimSnapshot &back();
+    void publish();
+
+    // Reader side: the newest published snapshot. It stays valid until the next acquire().
+    const SimSnapshot &acquire();
+
+private:
+    SimSnapshot m_snapshots[3];
+    int m_back, m_ready, m_front;       // Roles of the three snapshots
+    bool m_fresh;                       // `ready` is newer than `front`
+    std::mutex m_mutex;
+};
+
+#endif // SIMSNAPSHOT_H
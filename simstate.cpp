@@ -0,0 +1,568 @@
+#include "simulation.h"   // Header file for the Simulation class
+#include <cstring>        // std::memcmp, std::memcpy
+
+// Saved simulation states (Simulation::saveState / restoreState).
+//
+// Integers are LEB128 varints (zigzag for signed ones), reals are little-endian IEEE 754 bit
+// patterns: f64 for the measurements, f32 for the car attributes, exactly as they are held.
+//
+//   header      "CARSTA01", varint lane, light, junction, approach and conflict zone counts,
+//               u32 layout hash (lane geometry, links and turns, approaches, lights, phase counts)
+//   clock       timeMs, measuredSinceMs, pendingMs, nextId, seed, spawned, despawned, dropped,
+//               handedOff, received, totalConflicts
+//   junctions   phase, remainingMs, elapsedMs, cyclePhase, cycleRemainingMs, running,
+//               detectedMs per phase, conflicts per phase plus one
+//   lights      green
+//   approaches  active, intervalMs, remainingMs, 4 x u64 arrival and 4 x u64 turn generator state,
+//               queue, maxQueue, delay histogram (sparse buckets, f64 sum, f64 max)
+//   detectors   count, lastMs
+//   pool        highWater, reusable slot count, then the slots in free list order
+//   lanes       throughput, f64 totalDelay, f64 maxDelay, queue, maxQueue,
+//               waiting count, then per waiting car arrivedMs and transfer,
+//               car count, then per car front to back: slot, id, sprite, state, turn + 2, f32 s, v, age
+//   conflicts   pair count, then the id pairs overlapping during the last step
+//   outbox      count, then per car region and lane
+//
+// Positions, accelerations, the lane lists and the spatial index are not stored: they follow
+// from the lanes and the distances travelled, or are recomputed by the next step.
+
+namespace {
+
+constexpr char StateMagic[8] = {'C', 'A', 'R', 'S', 'T', 'A', '0', '1'};
+
+// Encoding into a byte vector.
+struct Output
+{
+    std::vector<std::uint8_t> &out;
+
+    void u8(std::uint8_t value)
+    {
+        out.push_back(value);
+    }
+
+    void u32(std::uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i)
+            out.push_back(std::uint8_t(value >> (8 * i)));
+    }
+
+    void u64(std::uint64_t value)
+    {
+        u32(std::uint32_t(value));
+        u32(std::uint32_t(value >> 32));
+    }
+
+    void f32(float value)
+    {
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof bits);
+        u32(bits);
+    }
+
+    void f64(double value)
+    {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof bits);
+        u64(bits);
+    }
+
+    void varint(std::uint64_t value)
+    {
+        while (value >= 0x80) {
+            out.push_back(std::uint8_t(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(std::uint8_t(value));
+    }
+
+    void zigzag(std::int64_t value)
+    {
+        varint((std::uint64_t(value) << 1) ^ std::uint64_t(value >> 63));
+    }
+};
+
+// Bounds-checked decoding over a byte range; once a read fails, every later one returns 0.
+struct Input
+{
+    const std::uint8_t *at;
+    const std::uint8_t *end;
+    bool ok = true;
+
+    bool need(std::size_t bytes)
+    {
+        if (ok && std::size_t(end - at) < bytes)
+            ok = false;
+        return ok;
+    }
+
+    std::uint8_t u8()
+    {
+        return need(1) ? *at++ : 0;
+    }
+
+    std::uint32_t u32()
+    {
+        if (!need(4))
+            return 0;
+        std::uint32_t value = std::uint32_t(at[0]) | std::uint32_t(at[1]) << 8 | std::uint32_t(at[2]) << 16
+                              | std::uint32_t(at[3]) << 24;
+        at += 4;
+        return value;
+    }
+
+    std::uint64_t u64()
+    {
+        std::uint64_t low = u32();
+        std::uint64_t high = u32();
+        return low | high << 32;
+    }
+
+    float f32()
+    {
+        std::uint32_t bits = u32();
+        float value;
+        std::memcpy(&value, &bits, sizeof value);
+        return value;
+    }
+
+    double f64()
+    {
+        std::uint64_t bits = u64();
+        double value;
+        std::memcpy(&value, &bits, sizeof value);
+        return value;
+    }
+
+    std::uint64_t varint()
+    {
+        std::uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            std::uint8_t byte = u8();
+            if (!ok)
+                return 0;
+            value |= std::uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        ok = false;
+        return 0;
+    }
+
+    std::int64_t zigzag()
+    {
+        std::uint64_t value = varint();
+        return std::int64_t(value >> 1) ^ -std::int64_t(value & 1);
+    }
+
+    // A count or index below `limit`; anything else makes the input invalid.
+    int index(std::uint64_t limit)
+    {
+        std::uint64_t value = varint();
+        if (value >= limit)
+            ok = false;
+        return ok ? int(value) : 0;
+    }
+};
+
+// FNV-1a over the bytes of plain values.
+struct LayoutHash
+{
+    std::uint32_t value = 2166136261u;
+
+    template <typename T>
+    void add(const T &field)
+    {
+        unsigned char bytes[sizeof field];
+        std::memcpy(bytes, &field, sizeof field);
+        for (unsigned char byte : bytes) {
+            value ^= byte;
+            value *= 16777619u;
+        }
+    }
+};
+
+}  // namespace
+
+// Hash of everything a state refers to by index: lanes and where they lead, approaches,
+// lights and phases. Durations, controllers and arrival rates may differ between the two sides.
+static std::uint32_t layoutHash(const Simulation &sim)
+{
+    LayoutHash hash;
+    for (const SimLane &lane : sim.lanes()) {
+        for (double value : {lane.x0, lane.y0, lane.x1, lane.y1})
+            hash.add(value);
+        for (int value : {lane.approach, lane.light, lane.exitRegion, lane.exitLane})
+            hash.add(value);
+        for (const SimTurn &turn : lane.turns)
+            hash.add(turn.lane);
+    }
+    for (const SimApproach &approach : sim.approaches()) {
+        hash.add(approach.junction);
+        for (int lane : approach.lanes)
+            hash.add(lane);
+    }
+    for (const SimLight &light : sim.lights()) {
+        hash.add(light.junction);
+        hash.add(light.phase);
+    }
+    for (const SimJunction &junction : sim.junctions())
+        hash.add(junction.phaseCount);
+    for (const SimConflictZone &zone : sim.conflictZones())
+        hash.add(zone.junction);
+    return hash.value;
+}
+
+// Sections in the order of the format description above.
+void Simulation::saveState(std::vector<std::uint8_t> &data) const
+{
+    Output out{data};
+    data.insert(data.end(), StateMagic, StateMagic + sizeof StateMagic);
+    for (std::size_t count : {m_lanes.size(), m_lights.size(), m_junctions.size(), m_approaches.size(), m_zones.size()})
+        out.varint(count);
+    out.u32(layoutHash(*this));
+
+    out.zigzag(m_timeMs);
+    out.zigzag(m_measuredSinceMs);
+    out.varint(std::uint64_t(m_pendingMs));
+    out.varint(m_nextId);
+    out.u64(m_seed);
+    for (std::uint64_t count : {m_spawned, m_despawned, m_dropped, m_handedOff, m_received, m_totalConflicts})
+        out.varint(count);
+
+    for (const SimJunction &junction : m_junctions) {
+        for (int value : {junction.phase, junction.remainingMs, junction.elapsedMs, junction.cyclePhase,
+                          junction.cycleRemainingMs})
+            out.zigzag(value);
+        out.u8(junction.running);
+        for (std::int64_t detected : junction.detectedMs)
+            out.zigzag(detected);
+        for (std::uint64_t conflicts : junction.conflicts)
+            out.varint(conflicts);
+    }
+
+    for (const SimLight &light : m_lights)
+        out.u8(light.green);
+
+    for (std::size_t a = 0; a < m_approaches.size(); ++a) {
+        const SimApproach &approach = m_approaches[a];
+        out.u8(approach.active);
+        out.zigzag(approach.intervalMs);
+        out.zigzag(approach.remainingMs);
+        std::uint64_t rng[4];
+        approach.rng.state(rng);
+        for (std::uint64_t word : rng)
+            out.u64(word);
+        approach.turnRng.state(rng);
+        for (std::uint64_t word : rng)
+            out.u64(word);
+
+        // Delays are mostly short, so only the few filled buckets are listed
+        const SimApproachStats &stats = m_approachStats[a];
+        out.varint(std::uint64_t(stats.queue));
+        out.varint(std::uint64_t(stats.maxQueue));
+        const std::vector<std::uint32_t> &buckets = stats.delays.buckets();
+        std::uint64_t filled = 0;
+        for (std::uint32_t count : buckets)
+            filled += count != 0;
+        out.varint(filled);
+        std::size_t previous = 0;
+        for (std::size_t b = 0; b < buckets.size(); ++b) {
+            if (buckets[b] == 0)
+                continue;
+            out.varint(b - previous);
+            out.varint(buckets[b]);
+            previous = b;
+        }
+        out.f64(stats.delays.sum());
+        out.f64(stats.delays.max());
+    }
+
+    for (const SimDetector &detector : m_detectors) {
+        out.varint(detector.count);
+        out.zigzag(detector.lastMs);
+    }
+
+    const std::vector<std::int32_t> reusable = m_vehicles.reusableSlots();
+    out.varint(std::uint64_t(m_vehicles.highWater()));
+    out.varint(reusable.size());
+    for (std::int32_t slot : reusable)
+        out.varint(std::uint64_t(slot));
+
+    for (std::size_t l = 0; l < m_lanes.size(); ++l) {
+        const SimLane &lane = m_lanes[l];
+        const SimLaneStats &stats = m_laneStats[l];
+        out.varint(stats.throughput);
+        out.f64(stats.totalDelay);
+        out.f64(stats.maxDelay);
+        out.varint(std::uint64_t(stats.queue));
+        out.varint(std::uint64_t(stats.maxQueue));
+
+        out.varint(lane.waiting.size());
+        for (const SimArrival &arrival : lane.waiting) {
+            out.zigzag(arrival.arrivedMs);
+            out.u8(arrival.transfer);
+        }
+
+        out.varint(std::uint64_t(lane.count));
+        for (int slot = lane.head; slot >= 0; slot = m_vehicles.follower[slot]) {
+            out.varint(std::uint64_t(slot));
+            out.varint(m_vehicles.id[slot]);
+            out.u8(m_vehicles.sprite[slot]);
+            out.u8(m_vehicles.state[slot]);
+            out.u8(std::uint8_t(m_vehicles.turn[slot] + 2));
+            out.f32(m_vehicles.s[slot]);
+            out.f32(m_vehicles.v[slot]);
+            out.f32(m_vehicles.age[slot]);
+        }
+    }
+
+    out.varint(m_lastConflictPairs.size());
+    for (std::uint64_t pair : m_lastConflictPairs)
+        out.u64(pair);
+
+    out.varint(m_outbox.size());
+    for (const SimHandoff &handoff : m_outbox) {
+        out.varint(std::uint64_t(handoff.region));
+        out.varint(std::uint64_t(handoff.lane));
+    }
+}
+
+// Decodes everything into temporaries first, so the simulation only changes once the whole
+// state proved valid. The car pool is never copied: only the saved slots are written.
+bool Simulation::restoreState(const std::uint8_t *data, std::size_t size, std::string *error)
+{
+    auto fail = [error](const std::string &message) {
+        if (error)
+            *error = message;
+        return false;
+    };
+
+    Input in{data, data + size};
+    if (!in.need(sizeof StateMagic) || std::memcmp(in.at, StateMagic, sizeof StateMagic) != 0)
+        return fail("not a simulation state");
+    in.at += sizeof StateMagic;
+    for (std::size_t count : {m_lanes.size(), m_lights.size(), m_junctions.size(), m_approaches.size(), m_zones.size()}) {
+        if (in.varint() != count)
+            return fail("state of another layout (different number of lanes, lights, junctions or approaches)");
+    }
+    if (in.u32() != layoutHash(*this))
+        return fail("state of another layout (lanes, links or phases differ)");
+
+    const std::int64_t timeMs = in.zigzag();
+    const std::int64_t measuredSinceMs = in.zigzag();
+    const int pendingMs = in.index(TickMs);
+    const std::uint32_t nextId = std::uint32_t(in.varint());
+    const std::uint64_t seed = in.u64();
+    std::uint64_t counters[6];
+    for (std::uint64_t &count : counters)
+        count = in.varint();
+
+    std::vector<SimJunction> junctions = m_junctions;
+    for (SimJunction &junction : junctions) {
+        junction.phase = int(in.zigzag());
+        junction.remainingMs = int(in.zigzag());
+        junction.elapsedMs = int(in.zigzag());
+        junction.cyclePhase = int(in.zigzag());
+        junction.cycleRemainingMs = int(in.zigzag());
+        junction.running = in.u8() != 0;
+        if (junction.phase < -1 || junction.phase >= junction.phaseCount || junction.cyclePhase < -1
+            || junction.cyclePhase >= junction.phaseCount)
+            in.ok = false;
+        for (std::int64_t &detected : junction.detectedMs)
+            detected = in.zigzag();
+        for (std::uint64_t &conflicts : junction.conflicts)
+            conflicts = in.varint();
+    }
+
+    std::vector<std::uint8_t> green(m_lights.size());
+    for (std::uint8_t &light : green)
+        light = in.u8() != 0;
+
+    std::vector<SimApproach> approaches = m_approaches;
+    std::vector<SimApproachStats> approachStats(m_approachStats.size());
+    for (std::size_t a = 0; a < approaches.size() && in.ok; ++a) {
+        SimApproach &approach = approaches[a];
+        approach.active = in.u8() != 0;
+        approach.intervalMs = int(in.zigzag());
+        approach.remainingMs = int(in.zigzag());
+        for (Rng *generator : {&approach.rng, &approach.turnRng}) {
+            std::uint64_t rng[4];
+            for (std::uint64_t &word : rng)
+                word = in.u64();
+            if (!(rng[0] | rng[1] | rng[2] | rng[3]))
+                in.ok = false;  // xoshiro never reaches the all-zero state
+            generator->setState(rng);
+        }
+
+        SimApproachStats &stats = approachStats[a];
+        stats.queue = in.index(std::uint64_t(1) << 31);
+        stats.maxQueue = in.index(std::uint64_t(1) << 31);
+        std::vector<std::uint32_t> buckets(DelayHistogram::BucketCount, 0);
+        const int filled = in.index(DelayHistogram::BucketCount + 1);
+        std::uint64_t b = 0;
+        for (int i = 0; i < filled && in.ok; ++i) {
+            b += in.varint();
+            if (b >= buckets.size()) {
+                in.ok = false;
+                break;
+            }
+            buckets[std::size_t(b)] = std::uint32_t(in.varint());
+        }
+        const double sum = in.f64();
+        const double max = in.f64();
+        stats.delays.setState(buckets, sum, max);
+    }
+
+    std::vector<SimDetector> detectors(m_detectors.size());
+    for (SimDetector &detector : detectors) {
+        detector.count = in.varint();
+        detector.lastMs = in.zigzag();
+    }
+
+    // A slot below the high-water mark takes at least a byte, which bounds it by the data size
+    const int highWater = in.index(size);
+    const int reusableCount = in.index(std::uint64_t(highWater) + 1);
+    std::vector<std::uint8_t> used(in.ok ? std::size_t(highWater) : 0, 0);
+    std::vector<std::int32_t> reusable;
+    reusable.reserve(std::size_t(reusableCount));
+    for (int i = 0; i < reusableCount && in.ok; ++i) {
+        const int slot = in.index(std::uint64_t(highWater));
+        if (used[slot])
+            in.ok = false;
+        used[slot] = 1;
+        reusable.push_back(slot);
+    }
+
+    // Cars in lane order, front to back; every used slot must be taken exactly once
+    struct SavedCar
+    {
+        int slot;
+        std::uint32_t id;
+        std::uint8_t sprite, state;
+        std::int8_t turn;
+        float s, v, age;
+    };
+    std::vector<SimLaneStats> laneStats(m_laneStats.size());
+    std::vector<std::deque<SimArrival>> waiting(m_lanes.size());
+    std::vector<int> laneCars(m_lanes.size(), 0);
+    std::vector<SavedCar> cars;
+    cars.reserve(std::size_t(highWater - reusableCount));
+    for (std::size_t l = 0; l < m_lanes.size() && in.ok; ++l) {
+        SimLaneStats &stats = laneStats[l];
+        stats.throughput = in.varint();
+        stats.totalDelay = in.f64();
+        stats.maxDelay = in.f64();
+        stats.queue = in.index(std::uint64_t(1) << 31);
+        stats.maxQueue = in.index(std::uint64_t(1) << 31);
+
+        const std::size_t waitingCount = std::size_t(in.index(size));
+        for (std::size_t i = 0; i < waitingCount && in.ok; ++i) {
+            const std::int64_t arrivedMs = in.zigzag();
+            waiting[l].push_back(SimArrival{arrivedMs, in.u8() != 0});
+        }
+
+        laneCars[l] = in.index(std::uint64_t(highWater) + 1);
+        for (int i = 0; i < laneCars[l] && in.ok; ++i) {
+            SavedCar car;
+            car.slot = in.index(std::uint64_t(highWater));
+            car.id = std::uint32_t(in.varint());
+            car.sprite = in.u8();
+            car.state = in.u8();
+            car.turn = std::int8_t(int(in.u8()) - 2);
+            car.s = in.f32();
+            car.v = in.f32();
+            car.age = in.f32();
+            if (!in.ok || used[car.slot] || (car.state != VehiclePool::Driving && car.state != VehiclePool::Stopped)
+                || car.turn < VehiclePool::Turned || car.turn >= int(m_lanes[l].turns.size())) {
+                in.ok = false;
+                break;
+            }
+            used[car.slot] = 1;
+            cars.push_back(car);
+        }
+    }
+    if (in.ok && int(cars.size()) + reusableCount != highWater)
+        in.ok = false;  // A slot neither free nor taken would be lost for good
+
+    std::vector<std::uint64_t> conflictPairs;
+    const std::size_t pairs = std::size_t(in.index(size));
+    for (std::size_t i = 0; i < pairs && in.ok; ++i)
+        conflictPairs.push_back(in.u64());
+
+    std::vector<SimHandoff> outbox;
+    const std::size_t handoffs = std::size_t(in.index(size));
+    for (std::size_t i = 0; i < handoffs && in.ok; ++i) {
+        const int region = in.index(std::uint64_t(1) << 31);
+        outbox.push_back(SimHandoff{region, in.index(std::uint64_t(1) << 31)});
+    }
+
+    if (!in.ok)
+        return fail("truncated or corrupt simulation state");
+    if (in.at != in.end)
+        return fail("trailing bytes after the simulation state");
+
+    // Valid: apply
+    m_timeMs = timeMs;
+    m_measuredSinceMs = measuredSinceMs;
+    m_pendingMs = pendingMs;
+    m_nextId = nextId;
+    m_seed = seed;
+    m_spawned = counters[0];
+    m_despawned = counters[1];
+    m_dropped = counters[2];
+    m_handedOff = counters[3];
+    m_received = counters[4];
+    m_totalConflicts = counters[5];
+    m_junctions.swap(junctions);
+    for (std::size_t i = 0; i < m_lights.size(); ++i)
+        m_lights[i].green = green[i] != 0;
+    m_approaches.swap(approaches);
+    m_approachStats.swap(approachStats);
+    m_detectors.swap(detectors);
+    m_laneStats.swap(laneStats);
+    m_lastConflictPairs.swap(conflictPairs);
+    m_outbox.swap(outbox);
+
+    // Slots above the old high-water mark are already free
+    VehiclePool &pool = m_vehicles;
+    for (int slot = 0; slot < pool.highWater(); ++slot)
+        pool.state[slot] = VehiclePool::Free;
+    pool.reserve(highWater);
+    std::size_t next = 0;
+    m_waiting = 0;
+    for (std::size_t l = 0; l < m_lanes.size(); ++l) {
+        SimLane &lane = m_lanes[l];
+        lane.waiting.swap(waiting[l]);
+        m_waiting += int(lane.waiting.size());
+        lane.head = -1;
+        lane.tail = -1;
+        lane.count = 0;
+        for (int i = 0; i < laneCars[l]; ++i) {
+            const SavedCar &car = cars[next++];
+            const int slot = car.slot;
+            pool.id[slot] = car.id;
+            pool.sprite[slot] = car.sprite;
+            pool.state[slot] = car.state;
+            pool.turn[slot] = car.turn;
+            pool.s[slot] = car.s;
+            pool.v[slot] = car.v;
+            pool.age[slot] = car.age;
+            pool.lane[slot] = int(l);
+            pool.x[slot] = float(lane.x0 + lane.dirX * car.s);
+            pool.y[slot] = float(lane.y0 + lane.dirY * car.s);
+            pool.a[slot] = 0;
+            pool.leader[slot] = lane.tail;
+            pool.follower[slot] = -1;
+            if (lane.tail >= 0)
+                pool.follower[lane.tail] = slot;
+            else
+                lane.head = slot;
+            lane.tail = slot;
+            ++lane.count;
+        }
+    }
+    pool.restore(highWater, reusable);
+
+    indexCars();
+    return true;
+}
@@ -0,0 +1,1166 @@
+#include "simulation.h"   // Header file for the Simulation class
+#include "telemetry.h"    // Step counters and timings
+#include <algorithm>      // std::max, std::min
+#include <cmath>          // std::hypot for lane lengths
+#include <limits>         // Longest arrival interval
+
+// Default limits, tuned on the original crossing and on a city grid: an actuated green runs
+// from 3 s to 10 s and ends once a second passes without a car, i.e. when the queue has cleared.
+SignalTiming::SignalTiming()
+    : minGreenMs(3000)
+    , maxGreenMs(10000)
+    , gapMs(1000)
+{
+}
+
+// Names used by scenario files and the batch runner.
+const char *signalControlName(SignalControl control)
+{
+    switch (control) {
+    case SignalControl::Actuated:
+        return "actuated";
+    case SignalControl::MaxPressure:
+        return "max-pressure";
+    case SignalControl::FixedTime:
+        break;
+    }
+    return "fixed";
+}
+
+// Inverse of signalControlName.
+bool parseSignalControl(const std::string &name, SignalControl *control)
+{
+    for (SignalControl candidate : {SignalControl::FixedTime, SignalControl::Actuated, SignalControl::MaxPressure}) {
+        if (name == signalControlName(candidate)) {
+            *control = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Constructor: the simulation starts empty, at time zero, with its own seeded random generator.
+Simulation::Simulation(std::uint64_t seed)
+    : m_grid(0, 0, 800, 800, 64)  // The 800x800 scene, in cells about half a car long
+    , m_totalConflicts(0)
+    , m_kinematicsIsa(bestKinematicsIsa())
+    , m_vehicleLimit(0)
+    , m_waiting(0)
+    , m_seed(seed)
+    , m_timeMs(0)
+    , m_measuredSinceMs(0)
+    , m_dayStartMs(0)
+    , m_pendingMs(0)
+    , m_nextId(0)
+    , m_spawned(0)
+    , m_despawned(0)
+    , m_dropped(0)
+    , m_handedOff(0)
+    , m_received(0)
+{
+    // Driver behaviour tuned to the scene scale (a car is roughly 100-140 units long)
+    m_idm.maxAccel = 250;
+    m_idm.comfortDecel = 400;
+    m_idm.maxDecel = 1200;
+    m_idm.minGap = 12;
+    m_idm.headway = 0.4;
+    m_idm.stoppedSpeed = 5;
+}
+
+// Builds the crossing that Scene used to hard-code in its spawn lambdas and constructor.
+// Positions, scales and rotations are the same literals the original code passed to Carro and Semaforo.
+// Stop lines sit just before the zebra crossing each lane reaches first on cross.jpg.
+void Simulation::loadDefaultCross()
+{
+    // One controller with two phases of 7 seconds: phase 0 = vertical green, phase 1 = horizontal green.
+    int j = addJunction(2, 7000);
+
+    // The four lights: s1 and s3 guard the vertical lanes, s2 and s4 the horizontal ones
+    int s1 = addLight(j, 0, 950 / 2 + 200, 800 / 2 - 200, 0);
+    int s2 = addLight(j, 1, 440 / 2 - 100, 180 / 2 + 100, 90);
+    int s3 = addLight(j, 0, 580 / 2 - 20, 350 / 2 + 20, 0);
+    int s4 = addLight(j, 1, 1250 / 2 - 100, 180 / 2 + 100, 90);
+
+    // Top vertical lanes (carro2.png), receiving two cars at once
+    int tv = addApproach(j, "north");
+    int lane = addLane(tv, 775 / 2 + 260, 650 / 2 - 300, 775 / 2 + 260, 600, 2000, 1, 0.27, 180, 116);
+    setStopLine(lane, s1, 65);
+    setSpriteSize(lane, 583, 428);
+    lane = addLane(tv, 775 / 2 - 145, 650 / 2 - 300, 775 / 2 - 145, 600, 2000, 1, 0.27, 180, 116);
+    setStopLine(lane, s3, 65);
+    setSpriteSize(lane, 583, 428);
+
+    // Bottom vertical lanes (carro.png), driving upwards
+    int bv = addApproach(j, "south");
+    lane = addLane(bv, 775 / 2 + 200, 650 / 2 + 135, 775 / 2 + 200, 650 / 2 - 480, 2000, 0, 0.10, 0, 102);
+    setStopLine(lane, s1, 215);
+    setSpriteSize(lane, 1024, 1024);
+    lane = addLane(bv, 775 / 2 - 200, 650 / 2 + 135, 775 / 2 - 200, 650 / 2 - 480, 2000, 0, 0.10, 0, 102);
+    setStopLine(lane, s3, 215);
+    setSpriteSize(lane, 1024, 1024);
+
+    // Horizontal lane entering from the right (carro3.png)
+    int lh = addApproach(j, "east");
+    lane = addLane(lh, 775, 650 / 2 - 295, -775, 650 / 2 - 295, 2000, 2, 0.3, 90, 140);
+    setStopLine(lane, s2, 317);
+    setSpriteSize(lane, 536, 466);
+
+    // Horizontal lane entering from the left (carro4.png)
+    int rh = addApproach(j, "west");
+    lane = addLane(rh, 50, 12 / 2 + 245, 755, 12 / 2 + 245, 2000, 3, 0.29, -90, 135);
+    setStopLine(lane, s4, 300);
+    setSpriteSize(lane, 536, 466);
+
+    // The two crossing boxes of cross.jpg (scaled to 800 wide)
+    addConflictZone(j, 134, 95, 276, 194);
+    addConflictZone(j, 528, 95, 673, 194);
+}
+
+// Adds a signal controller cycling through `phaseCount` phases of `phaseMs` each.
+int Simulation::addJunction(int phaseCount, int phaseMs)
+{
+    SimJunction junction;
+    junction.phaseCount = phaseCount;
+    junction.phase = -1;            // Every light red until the first phase change
+    junction.phaseMs.assign(phaseCount, phaseMs);
+    junction.offsetMs = 0;
+    junction.remainingMs = phaseMs;
+    junction.elapsedMs = 0;
+    junction.cyclePhase = -1;
+    junction.cycleRemainingMs = phaseMs;
+    junction.running = false;
+    junction.control = SignalControl::FixedTime;
+    junction.detectedMs.assign(phaseCount, -1);
+    junction.conflicts.assign(phaseCount + 1, 0);
+    m_junctions.push_back(junction);
+    return int(m_junctions.size()) - 1;
+}
+
+// Adds an approach whose arrival interval is redrawn at every phase change of `junction`.
+int Simulation::addApproach(int junction, const std::string &name)
+{
+    SimApproach approach;
+    approach.name = name;
+    approach.junction = junction;
+    approach.active = false;
+    approach.distribution = ArrivalDistribution::Uniform;
+    approach.minIntervalMs = 1000;
+    approach.maxIntervalMs = 6000;
+    approach.meanIntervalMs = 3500;
+    approach.intervalMs = 0;
+    approach.remainingMs = 0;
+    approach.rng = Rng(m_seed, m_approaches.size() + 1);
+    approach.turnRng = approach.rng;
+    approach.turnRng.jump();
+    m_approaches.push_back(approach);
+    m_approachStats.push_back(SimApproachStats{DelayHistogram(), 0, 0});
+    return int(m_approaches.size()) - 1;
+}
+
+// Adds a lane to `approach`. Free-flowing cars cover it in `traversalMs`, like the old 2000 ms animations.
+int Simulation::addLane(int approach, double x0, double y0, double x1, double y1, double traversalMs,
+                        int sprite, double scale, double rotation, double carLength)
+{
+    SimLane lane;
+    lane.x0 = x0;
+    lane.y0 = y0;
+    lane.x1 = x1;
+    lane.y1 = y1;
+    lane.length = std::hypot(x1 - x0, y1 - y0);
+    lane.dirX = lane.length > 0 ? (x1 - x0) / lane.length : 0;
+    lane.dirY = lane.length > 0 ? (y1 - y0) / lane.length : 0;
+    lane.speed = lane.length / (traversalMs / 1000.0);
+    lane.approach = approach;
+    lane.sprite = sprite;
+    lane.scale = scale;
+    lane.rotation = rotation;
+    lane.carLength = carLength;
+    lane.bodyX = 0;
+    lane.bodyY = 0;
+    lane.bodyW = 0;
+    lane.bodyH = 0;
+    lane.light = -1;
+    lane.stopS = 0;
+    lane.detectorS = -1;
+    lane.exitRegion = -1;
+    lane.exitLane = -1;
+    lane.head = -1;
+    lane.tail = -1;
+    lane.count = 0;
+    m_lanes.push_back(lane);
+    m_laneStats.push_back(SimLaneStats{0, 0, 0, 0, 0});
+    m_detectors.push_back(SimDetector{0, -1});
+
+    int index = int(m_lanes.size()) - 1;
+    m_approaches[approach].lanes.push_back(index);
+    return index;
+}
+
+// Adds a light that is green while `junction` is in `phase`.
+int Simulation::addLight(int junction, int phase, double x, double y, double rotation)
+{
+    SimLight light;
+    light.x = x;
+    light.y = y;
+    light.rotation = rotation;
+    light.junction = junction;
+    light.phase = phase;
+    light.green = false;
+    m_lights.push_back(light);
+    return int(m_lights.size()) - 1;
+}
+
+// Replaces the phase durations of the junction.
+void Simulation::setPhaseDurations(int junction, const std::vector<int> &phaseMs)
+{
+    m_junctions[junction].phaseMs = phaseMs;
+    m_junctions[junction].phaseMs.resize(m_junctions[junction].phaseCount, phaseMs.empty() ? 1000 : phaseMs.back());
+}
+
+// Stores the junction's offset; start() applies it before the first phase change.
+void Simulation::setPhaseOffset(int junction, int offsetMs)
+{
+    m_junctions[junction].offsetMs = std::max(0, offsetMs);
+}
+
+// Switches the approach to uniform intervals in the given range.
+void Simulation::setArrivalInterval(int approach, int minMs, int maxMs)
+{
+    m_approaches[approach].distribution = ArrivalDistribution::Uniform;
+    m_approaches[approach].minIntervalMs = minMs;
+    m_approaches[approach].maxIntervalMs = maxMs;
+}
+
+// Switches the approach to exponential intervals with the given mean.
+void Simulation::setExponentialArrivals(int approach, int meanMs)
+{
+    m_approaches[approach].distribution = ArrivalDistribution::Exponential;
+    m_approaches[approach].meanIntervalMs = std::max(1, meanMs);
+}
+
+// Points are kept sorted by time of day, each within [0, DayMs). A profile without any positive
+// rate means no arrivals at all.
+void Simulation::setDemandProfile(int approach, const std::vector<DemandPoint> &profile)
+{
+    std::vector<DemandPoint> points;
+    bool demand = false;
+    for (DemandPoint point : profile) {
+        point.timeMs = ((point.timeMs % DayMs) + DayMs) % DayMs;
+        point.perHour = std::max(0.0, point.perHour);
+        demand = demand || point.perHour > 0;
+        points.push_back(point);
+    }
+    std::stable_sort(points.begin(), points.end(),
+                     [](const DemandPoint &a, const DemandPoint &b) { return a.timeMs < b.timeMs; });
+    m_approaches[approach].distribution = demand ? ArrivalDistribution::Profile : ArrivalDistribution::None;
+    m_approaches[approach].profile = points;
+}
+
+// Switches the approach's arrivals off.
+void Simulation::setNoArrivals(int approach)
+{
+    m_approaches[approach].distribution = ArrivalDistribution::None;
+}
+
+// Stores the junction's policy.
+void Simulation::setSignalControl(int junction, SignalControl control, const SignalTiming &timing)
+{
+    m_junctions[junction].control = control;
+    m_junctions[junction].timing = timing;
+}
+
+// Gives the lane a stop line guarded by `light`, and lists the lane with the light's junction.
+void Simulation::setStopLine(int lane, int light, double stopS)
+{
+    SimLane &l = m_lanes[lane];
+    if (l.light >= 0) {
+        std::vector<int> &served = m_junctions[m_lights[l.light].junction].lanes;
+        served.erase(std::remove(served.begin(), served.end(), lane), served.end());
+    }
+    l.light = light;
+    l.stopS = stopS;
+    if (light >= 0) {
+        m_junctions[m_lights[light].junction].lanes.push_back(lane);
+        l.detectorS = std::max(0.0, stopS - DetectorSetback * l.carLength);
+    }
+}
+
+// Places the lane's detector.
+void Simulation::setDetector(int lane, double s)
+{
+    m_lanes[lane].detectorS = s < 0 ? -1 : s;
+}
+
+// Stores the car box directly.
+void Simulation::setCarBody(int l, double x, double y, double width, double height)
+{
+    m_lanes[l].bodyX = x;
+    m_lanes[l].bodyY = y;
+    m_lanes[l].bodyW = width;
+    m_lanes[l].bodyH = height;
+}
+
+// Rotates the scaled image rectangle around the car position, as the renderer draws it,
+// and keeps its bounding box.
+void Simulation::setSpriteSize(int l, double width, double height)
+{
+    SimLane &lane = m_lanes[l];
+    const double radians = lane.rotation * 3.14159265358979323846 / 180.0;
+    const double c = std::cos(radians) * lane.scale;
+    const double sn = std::sin(radians) * lane.scale;
+    const double cornersX[4] = {0, width, 0, width};
+    const double cornersY[4] = {0, 0, height, height};
+    double minX = 0, minY = 0, maxX = 0, maxY = 0;
+    for (int k = 0; k < 4; ++k) {
+        double px = cornersX[k] * c - cornersY[k] * sn;
+        double py = cornersX[k] * sn + cornersY[k] * c;
+        if (k == 0 || px < minX) minX = px;
+        if (k == 0 || px > maxX) maxX = px;
+        if (k == 0 || py < minY) minY = py;
+        if (k == 0 || py > maxY) maxY = py;
+    }
+    lane.bodyX = minX;
+    lane.bodyY = minY;
+    lane.bodyW = maxX - minX;
+    lane.bodyH = maxY - minY;
+}
+
+// Turning movements of a lane; the shares of all its turns should not exceed 1.
+int Simulation::addTurn(int lane, double s, int nextLane, double entryS, double share)
+{
+    m_lanes[lane].turns.push_back(SimTurn{s, nextLane, entryS, std::max(0.0, share)});
+    return int(m_lanes[lane].turns.size()) - 1;
+}
+
+// Stores the lane's successor.
+void Simulation::setLaneExit(int lane, int region, int nextLane)
+{
+    m_lanes[lane].exitRegion = region;
+    m_lanes[lane].exitLane = nextLane;
+}
+
+// Cars waiting to be delivered to other simulations.
+const std::vector<SimHandoff> &Simulation::outbox() const
+{
+    return m_outbox;
+}
+
+// Forgets the delivered cars.
+void Simulation::clearOutbox()
+{
+    m_outbox.clear();
+}
+
+// The car arrives now and enters the lane at the next step if there is room.
+void Simulation::receive(int lane)
+{
+    m_lanes[lane].waiting.push_back(SimArrival{m_timeMs, true});
+    ++m_waiting;
+    ++m_received;
+}
+
+// Adds a conflict zone whose conflicts are attributed to the phases of `junction`.
+int Simulation::addConflictZone(int junction, double x0, double y0, double x1, double y1)
+{
+    m_zones.push_back(SimConflictZone{junction, x0, y0, x1, y1});
+    return int(m_zones.size()) - 1;
+}
+
+// Replaces the spatial index with one covering the given area.
+void Simulation::setGridBounds(float x, float y, float width, float height, float cellSize)
+{
+    m_grid = SpatialGrid(x, y, width, height, cellSize);
+}
+
+// Starts every junction's phase timer and the arrivals; cars reaching a red light queue.
+void Simulation::start()
+{
+    for (SimJunction &junction : m_junctions) {
+        junction.running = true;
+        junction.elapsedMs = 0;
+        if (junction.phase < 0) {
+            junction.remainingMs = junction.phaseMs[0] + junction.offsetMs;  // Only the very first cycle is shifted
+        } else {
+            junction.remainingMs = junction.control == SignalControl::FixedTime ? junction.phaseMs[junction.phase]
+                                                                                : junction.timing.minGreenMs;
+        }
+        junction.cycleRemainingMs = junction.phaseMs[std::max(0, junction.cyclePhase)];
+        if (junction.cyclePhase < 0)
+            junction.cycleRemainingMs += junction.offsetMs;
+    }
+    for (SimApproach &approach : m_approaches) {
+        approach.active = approach.distribution != ArrivalDistribution::None;
+        approach.intervalMs = randomIntervalMs(approach);
+        approach.remainingMs = approach.intervalMs;
+    }
+}
+
+// Stops the phase timers and spawning, and turns every light red.
+void Simulation::stop()
+{
+    for (SimJunction &junction : m_junctions)
+        junction.running = false;
+    for (SimApproach &approach : m_approaches)
+        approach.active = false;
+    for (SimLight &light : m_lights)
+        light.green = false;
+}
+
+// Advances by `ms` of simulated time in whole steps, keeping the leftover for the next call.
+int Simulation::advance(int ms)
+{
+    m_pendingMs += ms;
+    int steps = 0;
+    while (m_pendingMs >= TickMs) {
+        step();
+        m_pendingMs -= TickMs;
+        ++steps;
+    }
+    return steps;
+}
+
+// One fixed step: light timers, spawn timers, admission of waiting cars, then car following.
+void Simulation::step()
+{
+    // Counts the step and its allocations, and times one step in Telemetry::StepSampling
+    const TelemetryStepScope telemetry;
+
+    // Phase changes happen first so spawns of this step already see the new lights.
+    // Controllers only run once their timer is out, so most junctions cost a decrement per step.
+    // Arrival intervals follow the nominal fixed-time cycle rather than the lights, so every
+    // controller faces the same arrivals; under fixed-time control both cycles coincide.
+    for (int j = 0; j < int(m_junctions.size()); ++j) {
+        SimJunction &junction = m_junctions[j];
+        if (!junction.running)
+            continue;
+        junction.remainingMs -= TickMs;
+        junction.elapsedMs += TickMs;
+        if (junction.remainingMs <= 0)
+            control(j);
+        junction.cycleRemainingMs -= TickMs;
+        if (junction.cycleRemainingMs <= 0)
+            nextCyclePhase(j);
+    }
+
+    // Spawning on every active approach: uniform intervals repeat until the next phase change,
+    // Poisson ones are drawn afresh after each arrival; several arrivals may fall in one step
+    for (int a = 0; a < int(m_approaches.size()); ++a) {
+        SimApproach &approach = m_approaches[a];
+        if (!approach.active)
+            continue;
+        approach.remainingMs -= TickMs;
+        while (approach.remainingMs <= 0) {
+            if (approach.distribution == ArrivalDistribution::Exponential
+                || approach.distribution == ArrivalDistribution::Profile)
+                approach.intervalMs = randomIntervalMs(approach);
+            approach.remainingMs += approach.intervalMs;
+            spawn(a);
+        }
+    }
+
+    // Cars held back by a queue reaching the lane start enter as soon as there is room
+    for (int l = 0; l < int(m_lanes.size()); ++l) {
+        if (!m_lanes[l].waiting.empty())
+            admit(l);
+    }
+
+    // Car following and integration run as the two passes of the kinematics kernel over the pool
+    // arrays (see kinematics.h). Accelerations are computed from the positions at the start of
+    // the step, for every car, before any car moves, so the result does not depend on the slot order.
+    const int end = m_vehicles.highWater();
+    const KinematicsParams params{m_idm.maxAccel, m_idm.comfortDecel, m_idm.maxDecel, m_idm.minGap, m_idm.headway,
+                                  TickMs / 1000.0f, float(m_idm.stoppedSpeed)};
+    m_kinematicsLanes.update(m_lanes, m_lights);
+    computeAccelerations(m_kinematicsIsa, m_vehicles, m_kinematicsLanes, params, end);
+    if (int(m_moveFlags.size()) < end)
+        m_moveFlags.resize(m_vehicles.capacity());
+    integrateCars(m_kinematicsIsa, m_vehicles, m_kinematicsLanes, params, end, m_moveFlags.data());
+
+    // Then the few cars the kernel flagged: detector passages, turns and lane ends; and the queues
+    const std::int32_t *laneOf = m_vehicles.lane.data();
+    std::uint8_t *state = m_vehicles.state.data();
+    const std::uint8_t *flags = m_moveFlags.data();
+    const float stopped = params.stoppedSpeed;
+    float *s = m_vehicles.s.data();
+    float *v = m_vehicles.v.data();
+    float *x = m_vehicles.x.data();
+    float *y = m_vehicles.y.data();
+    float *age = m_vehicles.age.data();
+    for (SimLaneStats &stats : m_laneStats)
+        stats.queue = 0;
+    const std::int8_t *turn = m_vehicles.turn.data();
+    for (int i = 0; i < end; ++i) {
+        if (flags[i] == 0) {
+            if (state[i] == VehiclePool::Stopped)
+                ++m_laneStats[laneOf[i]].queue;
+            continue;
+        }
+        const SimLane &lane = m_lanes[laneOf[i]];
+
+        // Detector passage; the phase serving the lane remembers it for actuated control
+        if (flags[i] & KinematicsDetector) {
+            SimDetector &detector = m_detectors[laneOf[i]];
+            ++detector.count;
+            detector.lastMs = m_timeMs;
+            if (lane.light >= 0) {
+                const SimLight &light = m_lights[lane.light];
+                m_junctions[light.junction].detectedMs[light.phase] = m_timeMs;
+            }
+        }
+
+        // Cars reaching their turn change lanes once every car has moved (see below)
+        if ((flags[i] & KinematicsTurn) && s[i] >= lane.turns[turn[i]].s) {
+            m_turning.push_back(i);
+            continue;
+        }
+
+        if (flags[i] & KinematicsEnd) {
+            // Delay is the time spent beyond what a free-flowing car needs for the lane
+            if (turn[i] != VehiclePool::Turned)
+                recordDelay(laneOf[i], std::max(0.0, age[i] - lane.length / lane.speed));
+            removeVehicle(i);
+            if (lane.exitLane < 0) {
+                ++m_despawned;
+                Telemetry::count(TelemetryCounter::Despawns);
+            } else {
+                // The car continues on the linked lane; its delay there is measured from now
+                if (lane.exitRegion < 0) {
+                    m_lanes[lane.exitLane].waiting.push_back(SimArrival{m_timeMs + TickMs, true});
+                    ++m_waiting;
+                } else {
+                    m_outbox.push_back(SimHandoff{lane.exitRegion, lane.exitLane});
+                }
+                ++m_handedOff;
+            }
+            continue;
+        }
+
+        if (state[i] == VehiclePool::Stopped)
+            ++m_laneStats[laneOf[i]].queue;
+    }
+
+    // Turns look for a gap among the new positions, so a car never merges in front of one that
+    // is still to move; a car that turns is measured where it leaves its lane
+    for (std::int32_t i : m_turning) {
+        const int from = laneOf[i];
+        const double turnS = m_lanes[from].turns[turn[i]].s;
+        if (turnVehicle(i))
+            recordDelay(from, std::max(0.0, age[i] - turnS / m_lanes[from].speed));
+        const SimLane &lane = m_lanes[laneOf[i]];
+        state[i] = v[i] < stopped ? VehiclePool::Stopped : VehiclePool::Driving;
+        if (state[i] == VehiclePool::Stopped)
+            ++m_laneStats[laneOf[i]].queue;
+        x[i] = float(lane.x0 + lane.dirX * s[i]);
+        y[i] = float(lane.y0 + lane.dirY * s[i]);
+    }
+    m_turning.clear();
+
+    for (SimApproachStats &stats : m_approachStats)
+        stats.queue = 0;
+    for (int l = 0; l < int(m_lanes.size()); ++l) {
+        SimLaneStats &stats = m_laneStats[l];
+        stats.queue += int(m_lanes[l].waiting.size());
+        stats.maxQueue = std::max(stats.maxQueue, stats.queue);
+        m_approachStats[m_lanes[l].approach].queue += stats.queue;
+    }
+    for (SimApproachStats &stats : m_approachStats)
+        stats.maxQueue = std::max(stats.maxQueue, stats.queue);
+
+    detectConflicts();
+
+    m_timeMs += TickMs;
+}
+
+// Whether a turn of `lane` leads onto lane `other`.
+static bool turnsOnto(const SimLane &lane, int other)
+{
+    for (const SimTurn &turn : lane.turns) {
+        if (turn.lane == other)
+            return true;
+    }
+    return false;
+}
+
+// Boxes follow the car positions, so they only change when the cars move.
+void Simulation::indexCars()
+{
+    const int end = m_vehicles.highWater();
+    if (int(m_boxMinX.size()) < m_vehicles.capacity()) {
+        m_boxMinX.resize(m_vehicles.capacity());
+        m_boxMinY.resize(m_vehicles.capacity());
+        m_boxMaxX.resize(m_vehicles.capacity());
+        m_boxMaxY.resize(m_vehicles.capacity());
+    }
+    const std::uint8_t *state = m_vehicles.state.data();
+    const std::int32_t *laneOf = m_vehicles.lane.data();
+    for (int i = 0; i < end; ++i) {
+        if (state[i] == VehiclePool::Free)
+            continue;
+        const SimLane &lane = m_lanes[laneOf[i]];
+        m_boxMinX[i] = float(m_vehicles.x[i] + lane.bodyX);
+        m_boxMinY[i] = float(m_vehicles.y[i] + lane.bodyY);
+        m_boxMaxX[i] = float(m_boxMinX[i] + lane.bodyW);
+        m_boxMaxY[i] = float(m_boxMinY[i] + lane.bodyH);
+    }
+    m_grid.build(m_boxMinX.data(), m_boxMinY.data(), m_boxMaxX.data(), m_boxMaxY.data(), state, end);
+}
+
+// Indexes every car box in the grid, then looks for overlapping cars of different lanes inside
+// each conflict zone. A pair overlapping over several steps is one conflict, counted in the
+// phase its junction was in when the overlap started.
+void Simulation::detectConflicts()
+{
+    indexCars();
+
+    const std::int32_t *laneOf = m_vehicles.lane.data();
+    m_conflictHits.clear();
+    for (int z = 0; z < int(m_zones.size()); ++z) {
+        const SimConflictZone &zone = m_zones[z];
+        m_grid.overlappingPairs(float(zone.x0), float(zone.y0), float(zone.x1), float(zone.y1), [&](int i, int j) {
+            if (laneOf[i] == laneOf[j])
+                return;
+            // Consecutive lanes of one road are a car following another, not a conflict
+            const SimLane &laneI = m_lanes[laneOf[i]];
+            const SimLane &laneJ = m_lanes[laneOf[j]];
+            if ((laneI.exitLane == laneOf[j] && laneI.exitRegion < 0)
+                || (laneJ.exitLane == laneOf[i] && laneJ.exitRegion < 0))
+                return;
+            // So are a car that just turned onto a lane and the cars it leaves behind or joins
+            if (turnsOnto(laneI, laneOf[j]) || turnsOnto(laneJ, laneOf[i]))
+                return;
+            std::uint64_t a = m_vehicles.id[i], b = m_vehicles.id[j];
+            std::uint64_t key = a < b ? (a << 32 | b) : (b << 32 | a);
+            m_conflictHits.emplace_back(key, z);
+        });
+    }
+
+    // Sorted by pair, then zone: the first hit of a pair is in the first zone that found it
+    std::sort(m_conflictHits.begin(), m_conflictHits.end());
+    m_conflictPairs.clear();
+    for (const std::pair<std::uint64_t, int> &hit : m_conflictHits) {
+        if (!m_conflictPairs.empty() && m_conflictPairs.back() == hit.first)
+            continue;
+        m_conflictPairs.push_back(hit.first);
+
+        // New pair: count it once, in the current phase of the zone's junction
+        if (!std::binary_search(m_lastConflictPairs.begin(), m_lastConflictPairs.end(), hit.first)) {
+            SimJunction &junction = m_junctions[m_zones[hit.second].junction];
+            int phase = junction.phase >= 0 && junction.running ? junction.phase : junction.phaseCount;
+            ++junction.conflicts[phase];
+            ++m_totalConflicts;
+        }
+    }
+    m_conflictPairs.swap(m_lastConflictPairs);
+}
+
+// The junction's timer ran out: fixed-time control moves on, actuated control extends a green
+// whose detectors saw a car less than gapMs ago (up to maxGreenMs), and max-pressure control
+// gives the next minGreenMs to the phase with the highest pressure, which may be the current one.
+void Simulation::control(int j)
+{
+    SimJunction &junction = m_junctions[j];
+    if (junction.phase < 0 || junction.control == SignalControl::FixedTime) {
+        nextPhase(j);
+        return;
+    }
+
+    const SignalTiming &timing = junction.timing;
+    if (junction.control == SignalControl::Actuated) {
+        const std::int64_t detected = junction.detectedMs[junction.phase];
+        const std::int64_t gapEnd = detected < 0 ? 0 : detected + timing.gapMs;
+        const int extension = int(std::min<std::int64_t>(gapEnd - m_timeMs, timing.maxGreenMs - junction.elapsedMs));
+        if (extension > 0)
+            junction.remainingMs = extension;
+        else
+            nextPhase(j);
+        return;
+    }
+
+    // Max pressure; ties keep the current phase, then favour the lowest phase index
+    int best = junction.phase;
+    int bestPressure = pressure(junction, best);
+    for (int p = 0; p < junction.phaseCount; ++p) {
+        const int value = pressure(junction, p);
+        if (value > bestPressure) {
+            best = p;
+            bestPressure = value;
+        }
+    }
+    if (best == junction.phase)
+        junction.remainingMs += timing.minGreenMs;
+    else
+        enterPhase(j, best, timing.minGreenMs);
+}
+
+// Next phase in cycle order, for its fixed duration or the actuated minimum green.
+void Simulation::nextPhase(int j)
+{
+    SimJunction &junction = m_junctions[j];
+    const int phase = (junction.phase + 1) % junction.phaseCount;
+    enterPhase(j, phase, junction.control == SignalControl::FixedTime ? junction.phaseMs[phase]
+                                                                      : junction.timing.minGreenMs);
+}
+
+// Queues (stopped cars and cars waiting to enter, as of the last step) on the phase's lanes, minus
+// those on the lanes they feed. Lanes continuing in another simulation count as empty exits.
+int Simulation::pressure(const SimJunction &junction, int phase) const
+{
+    int value = 0;
+    for (int l : junction.lanes) {
+        const SimLane &lane = m_lanes[l];
+        if (m_lights[lane.light].phase != phase)
+            continue;
+        value += m_laneStats[l].queue;
+        if (lane.exitLane >= 0 && lane.exitRegion < 0)
+            value -= m_laneStats[lane.exitLane].queue;
+    }
+    return value;
+}
+
+// Enters a phase: lights of that phase turn green, the others red. The time left over from the
+// previous phase (zero or less) is carried over, so fixed-time cycles do not drift.
+void Simulation::enterPhase(int j, int phase, int durationMs)
+{
+    SimJunction &junction = m_junctions[j];
+    junction.phase = phase;
+    junction.remainingMs += durationMs;
+    junction.elapsedMs = 0;
+
+    for (SimLight &light : m_lights) {
+        if (light.junction == j)
+            light.green = (light.phase == junction.phase);
+    }
+}
+
+// Every approach of the junction draws a fresh random arrival interval at each phase change
+// of the nominal cycle, as the old spawn timers did at each light change.
+void Simulation::nextCyclePhase(int j)
+{
+    SimJunction &junction = m_junctions[j];
+    junction.cyclePhase = (junction.cyclePhase + 1) % junction.phaseCount;
+    junction.cycleRemainingMs += junction.phaseMs[junction.cyclePhase];
+
+    for (SimApproach &approach : m_approaches) {
+        if (approach.junction != j || !approach.active)
+            continue;
+        approach.intervalMs = randomIntervalMs(approach);
+        approach.remainingMs = approach.intervalMs;
+    }
+}
+
+// A car arrives at the start of every lane of the approach; it enters now if there is room.
+void Simulation::spawn(int a)
+{
+    for (int laneIndex : m_approaches[a].lanes) {
+        if (m_vehicleLimit > 0 && m_vehicles.size() + m_waiting >= m_vehicleLimit) {
+            ++m_dropped;  // Over the cap: the car never arrives
+            continue;
+        }
+        m_lanes[laneIndex].waiting.push_back(SimArrival{m_timeMs, false});
+        ++m_waiting;
+        admit(laneIndex);
+    }
+}
+
+// Moves the longest-waiting car onto the lane when the last car has left enough room.
+void Simulation::admit(int l)
+{
+    SimLane &lane = m_lanes[l];
+    if (lane.tail >= 0 && m_vehicles.s[lane.tail] - lane.carLength < m_idm.minGap)
+        return;  // The queue reaches back to the lane start
+
+    const float speed = float(lane.tail >= 0 ? std::min(lane.speed, double(m_vehicles.v[lane.tail])) : lane.speed);
+    int slot = m_vehicles.spawn(m_nextId, l, std::uint8_t(lane.sprite), speed);
+    const SimArrival arrival = lane.waiting.front();
+    if (slot < 0 && arrival.transfer)
+        return;  // No free slot: a car handed over keeps its place until one frees up
+    lane.waiting.pop_front();
+    --m_waiting;
+    if (slot < 0) {
+        ++m_dropped;  // No free slot: a new car never enters the road
+        return;
+    }
+
+    m_vehicles.x[slot] = float(lane.x0);
+    m_vehicles.y[slot] = float(lane.y0);
+    m_vehicles.age[slot] = float(m_timeMs - arrival.arrivedMs) / 1000.0f;
+
+    // Movement by turning ratio; the remaining share goes straight on
+    if (!lane.turns.empty()) {
+        double u = m_approaches[lane.approach].turnRng.uniform();
+        for (std::size_t t = 0; t < lane.turns.size(); ++t) {
+            u -= lane.turns[t].share;
+            if (u < 0) {
+                m_vehicles.turn[slot] = std::int8_t(t);
+                break;
+            }
+        }
+    }
+
+    // Append at the back of the lane list
+    m_vehicles.leader[slot] = lane.tail;
+    if (lane.tail >= 0)
+        m_vehicles.follower[lane.tail] = slot;
+    else
+        lane.head = slot;
+    lane.tail = slot;
+    ++lane.count;
+
+    ++m_nextId;
+    if (!arrival.transfer) {
+        ++m_spawned;  // Cars coming from a linked lane were counted where they first entered
+        Telemetry::count(TelemetryCounter::Spawns);
+    }
+}
+
+// Unlinks the car from its lane list and returns its slot to the pool.
+void Simulation::removeVehicle(int slot)
+{
+    SimLane &lane = m_lanes[m_vehicles.lane[slot]];
+    int ahead = m_vehicles.leader[slot];
+    int behind = m_vehicles.follower[slot];
+    if (ahead >= 0)
+        m_vehicles.follower[ahead] = behind;
+    else
+        lane.head = behind;
+    if (behind >= 0)
+        m_vehicles.leader[behind] = ahead;
+    else
+        lane.tail = ahead;
+    --lane.count;
+    m_vehicles.despawn(slot);
+}
+
+// The car keeps its slot, id, speed and age. It is unlinked from its lane and inserted into
+// the list of the new one behind the last car ahead of its entry point, normally the tail.
+bool Simulation::turnVehicle(int slot)
+{
+    VehiclePool &pool = m_vehicles;
+    SimLane &from = m_lanes[pool.lane[slot]];
+    const SimTurn turn = from.turns[pool.turn[slot]];
+    SimLane &to = m_lanes[turn.lane];
+    const float s = float(turn.entryS + (pool.s[slot] - turn.s));
+
+    // The cars it would join between, found walking from the tail of the lane
+    int leader = to.tail;
+    while (leader >= 0 && pool.s[leader] < s)
+        leader = pool.leader[leader];
+    const int follower = leader >= 0 ? pool.follower[leader] : to.head;
+    const double room = to.carLength + m_idm.minGap;
+    if ((leader >= 0 && pool.s[leader] - s < room) || (follower >= 0 && s - pool.s[follower] < room)) {
+        pool.turn[slot] = VehiclePool::Straight;
+        return false;
+    }
+
+    const int ahead = pool.leader[slot];
+    const int behind = pool.follower[slot];
+    if (ahead >= 0)
+        pool.follower[ahead] = behind;
+    else
+        from.head = behind;
+    if (behind >= 0)
+        pool.leader[behind] = ahead;
+    else
+        from.tail = ahead;
+    --from.count;
+
+    pool.s[slot] = s;
+    pool.lane[slot] = turn.lane;
+    pool.turn[slot] = VehiclePool::Turned;
+    pool.leader[slot] = leader;
+    pool.follower[slot] = follower;
+    if (leader >= 0)
+        pool.follower[leader] = slot;
+    else
+        to.head = slot;
+    if (follower >= 0)
+        pool.leader[follower] = slot;
+    else
+        to.tail = slot;
+    ++to.count;
+    return true;
+}
+
+// Lane and approach measurements of one car.
+void Simulation::recordDelay(int l, double delay)
+{
+    SimLaneStats &stats = m_laneStats[l];
+    ++stats.throughput;
+    stats.totalDelay += delay;
+    stats.maxDelay = std::max(stats.maxDelay, delay);
+    m_approachStats[m_lanes[l].approach].delays.add(delay);
+}
+
+// Arrival interval drawn from the approach's distribution. Exponential intervals are rounded
+// to whole milliseconds and never shorter than 1 ms; arrivals closer than one step simply
+// queue at the lane start.
+int Simulation::randomIntervalMs(SimApproach &approach)
+{
+    if (approach.distribution == ArrivalDistribution::Profile)
+        return profileIntervalMs(approach);
+    if (approach.distribution == ArrivalDistribution::Exponential) {
+        const double u = approach.rng.uniform();
+        return std::max(1, int(std::lround(-std::log1p(-u) * approach.meanIntervalMs)));
+    }
+    return approach.rng.bounded(approach.minIntervalMs, approach.maxIntervalMs);
+}
+
+// Non-homogeneous Poisson arrivals by thinning (Lewis and Shedler): candidates come at a constant
+// rate at least as high as the profile's, and each is kept with probability rate(t) / that rate.
+// The bound is taken per profile segment, from the rates at its ends (the rate is linear in
+// between), and a candidate falling past the segment end restarts from there, which the
+// memoryless exponential allows. Quiet hours thus cost as few draws as busy ones.
+int Simulation::profileIntervalMs(SimApproach &approach)
+{
+    const std::vector<DemandPoint> &profile = approach.profile;
+    const double perMs = 1.0 / 3600000.0;
+    const double from = double(m_timeMs);
+    double t = from;
+    for (;;) {
+        // Segment of the time of day t falls in: from the last point at or before it to the next one
+        const double day = std::fmod(t + double(m_dayStartMs), double(DayMs));
+        std::size_t next = 0;
+        while (next < profile.size() && double(profile[next].timeMs) <= day)
+            ++next;
+        const DemandPoint &a = profile[(next + profile.size() - 1) % profile.size()];
+        const DemandPoint &b = profile[next % profile.size()];
+        double startMs = double(a.timeMs);
+        double endMs = double(b.timeMs);
+        if (startMs > day)
+            startMs -= double(DayMs);  // Before the first point: the segment from the last one, yesterday
+        if (endMs <= startMs)
+            endMs += double(DayMs);
+        const double slope = (b.perHour - a.perHour) / (endMs - startMs);
+        const double segmentEnd = t + (endMs - day);
+
+        const double peak = std::max(a.perHour + slope * (day - startMs), b.perHour) * perMs;
+        if (peak <= 0) {
+            t = segmentEnd;
+            continue;
+        }
+        t += -std::log1p(-approach.rng.uniform()) / peak;
+        if (t >= segmentEnd) {
+            t = segmentEnd;
+            continue;
+        }
+        const double rate = (a.perHour + slope * (t - segmentEnd + endMs - startMs)) * perMs;
+        if (approach.rng.uniform() * peak < rate)
+            return int(std::max(1.0, std::min(std::round(t - from), double(std::numeric_limits<int>::max()))));
+    }
+}
+
+// Seed of every random stream.
+std::uint64_t Simulation::seed() const
+{
+    return m_seed;
+}
+
+// Same derivation as addApproach(): stream a + 1 of the seed for approach a, jumped for its turns.
+void Simulation::reseed(std::uint64_t seed)
+{
+    m_seed = seed;
+    for (std::size_t a = 0; a < m_approaches.size(); ++a) {
+        m_approaches[a].rng = Rng(m_seed, a + 1);
+        m_approaches[a].turnRng = m_approaches[a].rng;
+        m_approaches[a].turnRng.jump();
+    }
+}
+
+// Simulated clock in milliseconds.
+std::int64_t Simulation::timeMs() const
+{
+    return m_timeMs;
+}
+
+// Time of day at the start.
+void Simulation::setStartTimeOfDay(std::int64_t timeOfDayMs)
+{
+    m_dayStartMs = ((timeOfDayMs % DayMs) + DayMs) % DayMs;
+}
+
+// Clock time, wrapped at midnight.
+std::int64_t Simulation::timeOfDayMs() const
+{
+    return (m_dayStartMs + m_timeMs) % DayMs;
+}
+
+// Current queues stay, as the new maxima; only what accumulates over time starts again from zero.
+void Simulation::resetMeasurements()
+{
+    for (SimLaneStats &stats : m_laneStats) {
+        stats.throughput = 0;
+        stats.totalDelay = 0;
+        stats.maxDelay = 0;
+        stats.maxQueue = stats.queue;
+    }
+    for (SimApproachStats &stats : m_approachStats) {
+        stats.delays = DelayHistogram();
+        stats.maxQueue = stats.queue;
+    }
+    for (SimJunction &junction : m_junctions)
+        std::fill(junction.conflicts.begin(), junction.conflicts.end(), 0);
+    m_totalConflicts = 0;
+    m_spawned = 0;
+    m_despawned = 0;
+    m_dropped = 0;
+    m_handedOff = 0;
+    m_received = 0;
+    m_measuredSinceMs = m_timeMs;
+}
+
+// Start of the measurement period.
+std::int64_t Simulation::measuredSinceMs() const
+{
+    return m_measuredSinceMs;
+}
+
+// Lane geometry.
+const std::vector<SimLane> &Simulation::lanes() const
+{
+    return m_lanes;
+}
+
+// Per-lane throughput, delay and queue measurements.
+const std::vector<SimLaneStats> &Simulation::laneStats() const
+{
+    return m_laneStats;
+}
+
+// Approaches and their arrival timers.
+const std::vector<SimApproach> &Simulation::approaches() const
+{
+    return m_approaches;
+}
+
+// Per-approach delays and queues.
+const std::vector<SimApproachStats> &Simulation::approachStats() const
+{
+    return m_approachStats;
+}
+
+// Light states.
+const std::vector<SimLight> &Simulation::lights() const
+{
+    return m_lights;
+}
+
+// Signal controllers, with their conflict counters.
+const std::vector<SimJunction> &Simulation::junctions() const
+{
+    return m_junctions;
+}
+
+// Loop detector counts, per lane.
+const std::vector<SimDetector> &Simulation::detectors() const
+{
+    return m_detectors;
+}
+
+// Crossing boxes checked for conflicts.
+const std::vector<SimConflictZone> &Simulation::conflictZones() const
+{
+    return m_zones;
+}
+
+// Spatial index of the car boxes.
+const SpatialGrid &Simulation::grid() const
+{
+    return m_grid;
+}
+
+// Overlapping pairs found during the last step.
+int Simulation::currentConflicts() const
+{
+    return int(m_lastConflictPairs.size());
+}
+
+// Conflicts started since construction.
+std::uint64_t Simulation::totalConflicts() const
+{
+    return m_totalConflicts;
+}
+
+// Cars currently on the road.
+const VehiclePool &Simulation::vehicles() const
+{
+    return m_vehicles;
+}
+
+// Car-following parameters.
+const CarFollowing &Simulation::carFollowing() const
+{
+    return m_idm;
+}
+
+// Replaces the car-following parameters for every car.
+void Simulation::setCarFollowing(const CarFollowing &parameters)
+{
+    m_idm = parameters;
+}
+
+// Kernel in use.
+KinematicsIsa Simulation::kinematicsIsa() const
+{
+    return m_kinematicsIsa;
+}
+
+// Switches kernels; they agree bit for bit, so this can happen at any step.
+void Simulation::setKinematicsIsa(KinematicsIsa isa)
+{
+    if (kinematicsIsaSupported(isa))
+        m_kinematicsIsa = isa;
+}
+
+// Grows the car pool; the arrays are only reallocated here, never while stepping.
+void Simulation::setVehicleCapacity(int capacity)
+{
+    m_vehicles.reserve(capacity);
+}
+
+// Configured cap.
+int Simulation::vehicleLimit() const
+{
+    return m_vehicleLimit;
+}
+
+// Takes effect at the next arrival; cars already on the road or waiting stay.
+void Simulation::setVehicleLimit(int limit)
+{
+    m_vehicleLimit = std::max(0, limit);
+}
+
+// Kept up to date as cars join and leave the queues.
+int Simulation::waitingCount() const
+{
+    return m_waiting;
+}
+
+// Total cars spawned.
+std::uint64_t Simulation::spawnedCount() const
+{
+    return m_spawned;
+}
+
+// Total cars that reached the end of their lane.
+std::uint64_t Simulation::despawnedCount() const
+{
+    return m_despawned;
+}
+
+// Total cars that could not be spawned because every slot was taken or the cap was reached.
+std::uint64_t Simulation::droppedCount() const
+{
+    return m_dropped;
+}
+
+// Cars moved on to a linked lane.
+std::uint64_t Simulation::handedOffCount() const
+{
+    return m_handedOff;
+}
+
+// Cars received from other simulations.
+std::uint64_t Simulation::receivedCount() const
+{
+    return m_received;
+}
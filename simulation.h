@@ -0,0 +1,490 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+// Only standard C++ is used here: the simulation must be able to run without Qt widgets,
+// a QGraphicsScene or even an event loop (e.g. on a batch server).
+#include <cstddef>     // Sizes of saved states
+#include <cstdint>     // Fixed-width integer types for ids, clocks and seeds
+#include <deque>       // Cars waiting to enter a full lane
+#include <string>      // Approach names
+#include <utility>     // Conflict pairs with their zone
+#include <vector>      // Contiguous storage for lanes and lights
+#include "vehiclepool.h"  // Structure-of-arrays storage for the cars
+#include "kinematics.h"   // Per-step car update over the pool arrays
+#include "spatialgrid.h"  // Uniform grid used to find overlapping cars
+#include "metrics.h"      // Delay histograms
+#include "rng.h"          // Seeded random streams
+
+// A car queued at the start of a lane, waiting for room to enter.
+struct SimArrival
+{
+    std::int64_t arrivedMs;  // Simulated time at which it reached the lane start
+    bool transfer;           // True if it came from another lane rather than from a spawn point
+};
+
+// A car that reached the end of a lane linked to a lane of another simulation (see setLaneExit).
+// The owner of both simulations delivers it with receive() before the next step.
+struct SimHandoff
+{
+    int region;              // Simulation the car continues in, as numbered by the owner
+    int lane;                // Lane of that simulation it enters
+};
+
+// A turning movement: part of a lane's cars leave it inside the crossing box for another lane,
+// e.g. a left turn onto the crossing road. Together with the cars that go straight on, this
+// gives each lane its turning ratios.
+struct SimTurn
+{
+    double s;           // Distance along the lane at which turning cars leave it
+    int lane;           // Lane they continue on
+    double entryS;      // Distance along that lane at which they join it; before its stop line they obey it
+    double share;       // Fraction of the lane's cars that take this turn
+};
+
+// A straight lane that cars travel along, from a spawn point to a despawn point.
+// Coordinates are the scene coordinates of the car sprite's origin, exactly as the old
+// Carro::setPos() calls used them, so the renderer can draw a car at (x, y) unchanged.
+// Distances along the lane (`s`) are measured from the spawn point to the sprite origin.
+struct SimLane
+{
+    double x0, y0;      // Position where a car appears
+    double x1, y1;      // Position where a car leaves the scene
+    double length;      // Distance between the two points (filled in by addLane)
+    double dirX, dirY;  // Unit vector pointing from the start to the end of the lane
+    double speed;       // Desired (free-flow) speed in scene units per second
+    int approach;       // Approach (group of lanes spawning together) this lane belongs to
+    int sprite;         // Sprite id used by the renderer (0..3 -> carro.png..carro4.png)
+    double scale;       // Scale factor the sprite is drawn with
+    double rotation;    // Rotation (degrees) the sprite is drawn with
+    double carLength;   // Length of a car on this lane, along the direction of travel
+    double bodyX, bodyY;  // Box covered by a car, relative to its position (see setSpriteSize)
+    double bodyW, bodyH;
+
+    int light;          // Light guarding the stop line, -1 if the lane has none
+    double stopS;       // Distance along the lane at which a car waits for green
+    double detectorS;   // Distance along the lane of its loop detector, -1 if it has none
+
+    int exitRegion;     // Simulation the next lane belongs to, -1 for this one
+    int exitLane;       // Lane cars continue on after the end of this one, -1 if they leave the road
+    std::vector<SimTurn> turns;  // Movements leaving the lane before its end; the other cars go straight on
+
+    // Cars on the lane form a linked list ordered front to back (see VehiclePool::leader)
+    int head;           // Slot of the front-most car, -1 if the lane is empty
+    int tail;           // Slot of the last car, -1 if the lane is empty
+    int count;          // Cars currently on the lane
+    std::deque<SimArrival> waiting;  // Cars that could not enter yet, oldest first
+};
+
+// Throughput and delay measured on one lane.
+struct SimLaneStats
+{
+    std::uint64_t throughput;   // Cars that reached the end of the lane, or turned off it
+    double totalDelay;          // Sum of their delays in seconds (time lost against free flow)
+    double maxDelay;            // Largest single delay in seconds
+    int queue;                  // Cars currently stopped on the lane or waiting to enter it
+    int maxQueue;               // Largest queue seen
+};
+
+// A loop detector: counts the cars whose front passes a point of a lane.
+struct SimDetector
+{
+    std::uint64_t count;        // Cars detected since construction
+    std::int64_t lastMs;        // Simulated time of the last detection, -1 before the first
+};
+
+// How the interval between two arrivals of an approach is drawn.
+enum class ArrivalDistribution
+{
+    Uniform,        // Uniformly in [minIntervalMs, maxIntervalMs), as the original timers did
+    Exponential,    // Exponentially with mean meanIntervalMs (Poisson arrivals)
+    Profile,        // Poisson arrivals whose rate follows the approach's demand profile over the day
+    None            // No arrivals: the lanes are only fed by the lanes linked to them
+};
+
+// Arrival rate of an approach at one time of day. A profile interpolates linearly between its
+// points and wraps around midnight, so a single point gives a constant rate.
+struct DemandPoint
+{
+    std::int64_t timeMs;     // Time of day, in ms since midnight
+    double perHour;          // Arrivals per hour at that time
+};
+
+// A set of lanes that receive cars at the same random interval (one spawn timer in the old Scene).
+// Cars keep arriving whatever the lights show; on red they queue behind the stop line.
+struct SimApproach
+{
+    std::string name;        // Name used in reports
+    std::vector<int> lanes;  // Lanes that receive one car each time the approach spawns
+    int junction;            // Junction whose (nominal) phase changes draw a new arrival interval
+    bool active;             // True while the approach is spawning cars
+    ArrivalDistribution distribution;  // Distribution of the arrival intervals
+    int minIntervalMs;       // Range of uniform intervals
+    int maxIntervalMs;
+    int meanIntervalMs;      // Mean of exponential intervals
+    std::vector<DemandPoint> profile;  // Arrival rate over the day, sorted by time
+    int intervalMs;          // Interval between two spawns while active
+    int remainingMs;         // Time left until the next spawn
+    Rng rng;                 // Random stream of this approach (stream index + 1 of the simulation seed)
+    Rng turnRng;             // Turning choices of its cars: the same stream, jumped 2^128 draws ahead,
+                             // so changing turning ratios never shifts the arrivals
+};
+
+// Measurements of one approach, over all of its lanes.
+struct SimApproachStats
+{
+    DelayHistogram delays;   // Delay of every car that left the scene, or turned off the approach
+    int queue;               // Cars currently queued on the approach's lanes
+    int maxQueue;            // Longest queue seen
+};
+
+// A traffic light as plain state; Semaforo only mirrors it on screen.
+struct SimLight
+{
+    double x, y;        // Scene position of the light
+    double rotation;    // Rotation (degrees) of the light sprite
+    int junction;       // Junction controlling this light
+    int phase;          // Phase of that junction during which the light is green
+    bool green;         // Current state: true = green, false = red
+};
+
+// How a junction decides when to change phase.
+enum class SignalControl
+{
+    FixedTime,      // Every phase lasts its phaseMs, in cycle order (the original 7-second toggle)
+    Actuated,       // Phases in cycle order; green lasts while the phase's detectors keep seeing cars,
+                    // between minGreenMs and maxGreenMs
+    MaxPressure     // Every minGreenMs, green goes to the phase whose queues outweigh their exits the most
+};
+
+// Limits of the demand-responsive controllers, in ms of simulated time.
+struct SignalTiming
+{
+    int minGreenMs;     // Shortest green; for max-pressure, also the interval between two decisions
+    int maxGreenMs;     // Longest green of an actuated phase
+    int gapMs;          // An actuated green ends once no detector of its phase saw a car for this long
+
+    SignalTiming();
+};
+
+// Name of a control policy ("fixed", "actuated", "max-pressure"), and the reverse; false if unknown.
+const char *signalControlName(SignalControl control);
+bool parseSignalControl(const std::string &name, SignalControl *control);
+
+// A signal controller cycling through phases (previously Scene::semaforo and timerVertical).
+struct SimJunction
+{
+    int phaseCount;     // Number of phases in the cycle
+    int phase;          // Last phase entered, -1 before the first phase change
+    std::vector<int> phaseMs;  // Duration of each phase under fixed-time control
+    int offsetMs;       // Extra delay before the first phase change, to coordinate neighbouring junctions
+    int remainingMs;    // Time left until the next phase change (or decision)
+    int elapsedMs;      // Time since the current phase started
+    int cyclePhase;     // Phase of the nominal fixed-time cycle, which times the arrival intervals
+    int cycleRemainingMs;  // Time left in it
+    bool running;       // True between start() and stop()
+    SignalControl control;     // Policy deciding the phase changes
+    SignalTiming timing;       // Its limits
+    std::vector<int> lanes;    // Lanes whose stop line a light of this junction guards
+    std::vector<std::int64_t> detectedMs;  // Per phase: last car seen by a detector of a lane it serves
+    std::vector<std::uint64_t> conflicts;  // Conflicts that started in each phase; the last entry
+                                           // counts those that started while every light was red
+};
+
+// Part of the road (the box of a crossing) where cars of different lanes must never overlap.
+struct SimConflictZone
+{
+    int junction;           // Junction whose phase the conflicts are attributed to
+    double x0, y0, x1, y1;  // Rectangle in scene coordinates
+};
+
+// Parameters of the Intelligent Driver Model used for every car, in scene units and seconds.
+struct CarFollowing
+{
+    double maxAccel;      // Maximum acceleration
+    double comfortDecel;  // Comfortable braking deceleration
+    double maxDecel;      // Hardest braking a driver accepts before running a light that just turned red
+    double minGap;        // Bumper-to-bumper distance kept when stopped
+    double headway;       // Desired time gap to the car ahead
+    double stoppedSpeed;  // Below this speed a car counts as queued
+};
+
+// Deterministic, fixed-timestep traffic simulation of the crossing.
+// Advancing it never depends on wall-clock time: the same seed and the same sequence of
+// calls always produce the same state, so it can run faster than real time without a GUI.
+// Cars follow the Intelligent Driver Model: each one reacts to the car ahead on its lane
+// (found in O(1) through the lane's linked list) and to a red light at the lane's stop line.
+class Simulation
+{
+public:
+    // Length of one simulation step in milliseconds.
+    static constexpr int TickMs = 20;
+
+    // Length of the day demand profiles repeat over.
+    static constexpr std::int64_t DayMs = 24 * 3600 * 1000;
+
+    // Constructor: creates an empty simulation whose random numbers all derive from `seed`.
+    // Each approach draws from its own stream of that seed, so adding or reordering arrivals on one
+    // approach never shifts the random numbers of another.
+    explicit Simulation(std::uint64_t seed = 0);
+
+    // Seed the simulation was created with (or last reseeded with).
+    std::uint64_t seed() const;
+
+    // Restarts every random stream from `seed`, as if the simulation had been created with it;
+    // e.g. to give each run forked from one saved state arrivals of its own.
+    void reseed(std::uint64_t seed);
+
+    // Appends the whole changing state to `out`: cars with their slots and progress, waiting
+    // queues, lights, controller timers, detectors, random streams, clock and measurements.
+    // The layout and its settings (lanes, phase durations, controllers, arrival distributions,
+    // car following) are not saved: a state is restored into a simulation built the same way,
+    // whose settings may then differ to explore a variant. The format is described in simstate.cpp.
+    void saveState(std::vector<std::uint8_t> &out) const;
+
+    // Replaces the state by one saved with saveState() from a simulation with the same lanes,
+    // lights, junctions and approaches. Stepping on gives exactly what the saved simulation gave.
+    // Returns false and sets `error` (leaving the simulation untouched) if the data is not a
+    // state of this layout.
+    bool restoreState(const std::uint8_t *data, std::size_t size, std::string *error);
+
+    // Builds the lanes, approaches and four lights of the original crossing drawn over cross.jpg.
+    // scenarios/cross.json describes the same layout; this built-in copy needs no file.
+    void loadDefaultCross();
+
+    // Starts the light cycle; the first phase change happens one phase duration later.
+    void start();
+
+    // Stops spawning and turns every light red. Cars already on the road drive up to their stop line
+    // and wait there; the ones past it leave the scene.
+    void stop();
+
+    // Advances the simulation by exactly one step of TickMs.
+    void step();
+
+    // Advances the simulation by `ms` milliseconds of simulated time, running as many whole
+    // steps as fit; the remainder is carried over to the next call. Returns the steps run.
+    int advance(int ms);
+
+    // Current simulated time in milliseconds since construction.
+    std::int64_t timeMs() const;
+
+    // Time of day at simulated time 0 (default midnight), and the current time of day; demand
+    // profiles are read at the time of day.
+    void setStartTimeOfDay(std::int64_t timeOfDayMs);
+    std::int64_t timeOfDayMs() const;
+
+    // Clears the measurements (lane and approach statistics, conflict and car counters) without
+    // touching the cars, lights or timers, e.g. to leave a warm-up period out of a report, and
+    // returns the time they were last cleared (0 if never).
+    void resetMeasurements();
+    std::int64_t measuredSinceMs() const;
+
+    // Read-only access to the simulation state, used by renderers and reports.
+    const std::vector<SimLane> &lanes() const;
+    const std::vector<SimLaneStats> &laneStats() const;
+    const std::vector<SimApproach> &approaches() const;
+    const std::vector<SimApproachStats> &approachStats() const;
+    const std::vector<SimLight> &lights() const;
+    const std::vector<SimJunction> &junctions() const;
+    const std::vector<SimDetector> &detectors() const;  // Indexed by lane
+    const std::vector<SimConflictZone> &conflictZones() const;
+    const VehiclePool &vehicles() const;
+
+    // Spatial index of the car boxes, rebuilt at the end of every step.
+    const SpatialGrid &grid() const;
+
+    // Replaces the area covered by the spatial index (cars outside it fall into the border cells).
+    void setGridBounds(float x, float y, float width, float height, float cellSize);
+
+    // Pairs of cars of different lanes overlapping inside a conflict zone during the last step,
+    // and the number of such conflicts that started since construction (or resetMeasurements()).
+    int currentConflicts() const;
+    std::uint64_t totalConflicts() const;
+
+    // Car-following parameters shared by every car.
+    const CarFollowing &carFollowing() const;
+    void setCarFollowing(const CarFollowing &parameters);
+
+    // Instruction set of the kinematics kernel (default: the best this CPU supports). Every
+    // choice gives the same results; an unsupported one is ignored.
+    KinematicsIsa kinematicsIsa() const;
+    void setKinematicsIsa(KinematicsIsa isa);
+
+    // Grows the car pool to hold at least `capacity` cars. New cars finding the pool full are
+    // dropped; cars handed over from another lane wait at the lane start for a free slot.
+    void setVehicleCapacity(int capacity);
+
+    // Hard cap on the cars of this simulation, on the road and waiting to enter it: arrivals
+    // beyond it are dropped, so a saturated layout cannot grow its queues without bound over a
+    // long run. 0 (the default) for no cap other than the pool capacity. Only new arrivals are
+    // checked: cars handed over from a linked lane or another region count towards the cap, but
+    // are never dropped, and wait at the lane start while the pool is full.
+    int vehicleLimit() const;
+    void setVehicleLimit(int limit);
+
+    // Cars waiting at the start of a lane for room to enter it, all lanes together.
+    int waitingCount() const;
+
+    // Number of cars spawned, despawned and dropped (pool full or over the vehicle limit) since construction (or resetMeasurements()).
+    std::uint64_t spawnedCount() const;
+    std::uint64_t despawnedCount() const;
+    std::uint64_t droppedCount() const;
+
+    // Number of cars that left a lane for a linked lane (here or in another simulation), and
+    // that arrived from another simulation.
+    std::uint64_t handedOffCount() const;
+    std::uint64_t receivedCount() const;
+
+    // Builders used to describe a layout. Each returns the index of the element it added.
+    int addJunction(int phaseCount, int phaseMs);
+    int addApproach(int junction, const std::string &name);
+    int addLane(int approach, double x0, double y0, double x1, double y1, double traversalMs,
+                int sprite, double scale, double rotation, double carLength);
+    int addLight(int junction, int phase, double x, double y, double rotation);
+
+    // Replaces the duration of every phase of `junction`; takes effect at its next phase change.
+    void setPhaseDurations(int junction, const std::vector<int> &phaseMs);
+
+    // Delays the first phase change of `junction` by `offsetMs` after start().
+    void setPhaseOffset(int junction, int offsetMs);
+
+    // Draws the arrival intervals of `approach` uniformly from [minMs, maxMs).
+    void setArrivalInterval(int approach, int minMs, int maxMs);
+
+    // Draws the arrival intervals of `approach` exponentially with mean `meanMs` (Poisson arrivals).
+    void setExponentialArrivals(int approach, int meanMs);
+
+    // Makes the arrivals of `approach` a non-homogeneous Poisson process whose rate follows
+    // `profile` over the day (see DemandPoint), e.g. a morning and an evening peak.
+    void setDemandProfile(int approach, const std::vector<DemandPoint> &profile);
+
+    // Turns off the arrivals of `approach`; its lanes only receive cars from linked lanes.
+    void setNoArrivals(int approach);
+
+    // Selects how `junction` changes phase; takes effect at its next phase change.
+    void setSignalControl(int junction, SignalControl control, const SignalTiming &timing = SignalTiming());
+
+    // Makes cars on `lane` wait at distance `stopS` while `light` is red, and places the lane's
+    // detector DetectorSetback car lengths before the stop line.
+    void setStopLine(int lane, int light, double stopS);
+
+    // Moves the detector of `lane` to distance `s` along it; a negative `s` removes it.
+    void setDetector(int lane, double s);
+
+    // Car lengths between a detector placed by setStopLine and the stop line, so that it sees
+    // cars approaching a green light in time to extend it.
+    static constexpr double DetectorSetback = 2;
+
+    // Derives the box a car of `lane` covers from the size of its image before scaling and
+    // rotation, using the lane's scale and rotation around the car position.
+    void setSpriteSize(int lane, double width, double height);
+
+    // Sets the box a car of `lane` covers, relative to its position, for layouts without sprites.
+    void setCarBody(int lane, double x, double y, double width, double height);
+
+    // Adds a rectangle in which overlaps between cars of different lanes are counted as conflicts.
+    int addConflictZone(int junction, double x0, double y0, double x1, double y1);
+
+    // Links the end of `lane` to the start of `nextLane`: cars reaching the end queue to enter
+    // `nextLane` instead of leaving. With `region` >= 0 the next lane belongs to another
+    // simulation, and the cars are put in the outbox for the owner to deliver.
+    void setLaneExit(int lane, int region, int nextLane);
+
+    // Sends a `share` of the cars entering `lane` on to `nextLane`: they leave `lane` at distance
+    // `s` and join `nextLane` at distance `entryS`, keeping their speed. Each car picks its
+    // movement when it enters the lane; cars that take no turn go straight on to the lane end, as
+    // do turning cars that find no gap on `nextLane`. Turned cars are measured where they turn,
+    // against the approach they came from.
+    int addTurn(int lane, double s, int nextLane, double entryS, double share);
+
+    // Cars handed to other simulations since the last clearOutbox(), in the order they left.
+    const std::vector<SimHandoff> &outbox() const;
+    void clearOutbox();
+
+    // Queues a car coming from another simulation at the start of `lane`.
+    void receive(int lane);
+
+private:
+    // Lets the junction's controller decide on a phase change once its timer ran out.
+    void control(int junction);
+
+    // Computes the box of every car and rebuilds the spatial index from them.
+    void indexCars();
+
+    // Moves a car that reached its turn from its lane to the lane of the turn, if there is room
+    // for it there; otherwise the car goes straight on. Returns whether it turned.
+    bool turnVehicle(int slot);
+
+    // Counts a car leaving `lane` (at its end or at a turn) with `delay` seconds of delay.
+    void recordDelay(int lane, double delay);
+
+    // Switches a junction to its next phase in cycle order.
+    void nextPhase(int junction);
+
+    // Switches a junction to `phase` for at least `durationMs`, updating its lights.
+    void enterPhase(int junction, int phase, int durationMs);
+
+    // Moves the junction's nominal cycle on by one phase; its approaches draw new arrival intervals.
+    void nextCyclePhase(int junction);
+
+    // Max-pressure weight of `phase`: cars queued on the lanes it serves minus cars queued on
+    // the lanes those continue on.
+    int pressure(const SimJunction &junction, int phase) const;
+
+    // Queues one new car at the start of every lane of the approach.
+    void spawn(int approach);
+
+    // Lets the first waiting car onto the lane if there is room behind the last car.
+    void admit(int lane);
+
+    // Removes a car from its lane's list and frees its slot.
+    void removeVehicle(int slot);
+
+    // Rebuilds the spatial index and counts the car overlaps inside the conflict zones.
+    void detectConflicts();
+
+    // Returns a random arrival interval for the approach from its distribution, by default
+    // uniform in [1000, 6000) ms as the old timerVertical lambda drew them.
+    int randomIntervalMs(SimApproach &approach);
+
+    // Time to the next arrival of a demand profile, drawn by thinning (see simulation.cpp).
+    int profileIntervalMs(SimApproach &approach);
+
+    std::vector<SimLane> m_lanes;           // Lane geometry and per-lane car lists
+    std::vector<SimLaneStats> m_laneStats;  // Per-lane measurements
+    std::vector<SimApproach> m_approaches;  // Spawn groups and their timers
+    std::vector<SimApproachStats> m_approachStats;  // Per-approach measurements
+    std::vector<SimLight> m_lights;         // Traffic lights
+    std::vector<SimJunction> m_junctions;   // Signal controllers
+    std::vector<SimDetector> m_detectors;   // Loop detector of each lane
+    std::vector<SimConflictZone> m_zones;   // Crossing boxes checked for conflicts
+    VehiclePool m_vehicles;                 // Cars currently on the road
+    SpatialGrid m_grid;                     // Index of the car boxes
+    std::vector<float> m_boxMinX, m_boxMinY, m_boxMaxX, m_boxMaxY;  // Car boxes, indexed by slot
+    std::vector<std::pair<std::uint64_t, int>> m_conflictHits;  // Pairs found this step, with their zone
+    std::vector<std::uint64_t> m_conflictPairs;      // Car id pairs overlapping during this step
+    std::vector<std::uint64_t> m_lastConflictPairs;  // Same for the previous step
+    std::uint64_t m_totalConflicts;         // Conflicts started since construction
+    CarFollowing m_idm;                     // Car-following parameters
+    KinematicsIsa m_kinematicsIsa;          // Kernel moving the cars
+    KinematicsLanes m_kinematicsLanes;      // Lane tables of the kernel, refreshed every step
+    std::vector<std::uint8_t> m_moveFlags;  // KinematicsFlag of every slot, from the last step
+    int m_vehicleLimit;                     // Cap on cars on the road plus waiting, 0 for none
+    int m_waiting;                          // Cars in the waiting queues of all lanes
+
+    std::uint64_t m_seed;                   // Seed every random stream derives from
+    std::int64_t m_timeMs;                  // Simulated clock
+    std::int64_t m_measuredSinceMs;         // Time of the last resetMeasurements()
+    std::int64_t m_dayStartMs;              // Time of day at simulated time 0
+    int m_pendingMs;                        // Time passed to advance() not yet consumed by a step
+    std::uint32_t m_nextId;                 // Id given to the next spawned car
+    std::uint64_t m_spawned;                // Total cars spawned
+    std::uint64_t m_despawned;              // Total cars that left the scene
+    std::uint64_t m_dropped;                // Total spawns refused: pool full or over the vehicle limit
+    std::uint64_t m_handedOff;              // Total cars moved on to a linked lane
+    std::uint64_t m_received;               // Total cars received from other simulations
+    std::vector<SimHandoff> m_outbox;       // Cars leaving for other simulations during this step
+    std::vector<std::int32_t> m_turning;    // Slots of the cars reaching their turn during this step
+};
+
+#endif // SIMULATION_H
@@ -0,0 +1,125 @@
+#include "soak.h"           // Header file of the soak run
+#include "telemetry.h"      // Heap allocations of this thread
+#include <algorithm>        // std::max, std::min
+#include <chrono>           // Wall-clock time of the reports
+#include <cstdio>           // Reads /proc on Linux
+#include <sstream>          // Failure message
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>          // GetProcessMemoryInfo
+#elif defined(__APPLE__)
+#include <mach/mach.h>      // task_info
+#elif defined(__linux__)
+#include <unistd.h>         // sysconf
+#endif
+
+// Working set on Windows, resident size from the kernel elsewhere.
+std::uint64_t residentMemoryBytes()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof counters))
+        return counters.WorkingSetSize;
+    return 0;
+#elif defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) == KERN_SUCCESS)
+        return info.resident_size;
+    return 0;
+#elif defined(__linux__)
+    // Second field of statm: resident pages
+    std::FILE *file = std::fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+    unsigned long long size = 0, resident = 0;
+    const int fields = std::fscanf(file, "%llu %llu", &size, &resident);
+    std::fclose(file);
+    if (fields != 2)
+        return 0;
+    return resident * std::uint64_t(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+// A week, reported every simulated hour; two hours to fill the road; 16 MiB of slack for the
+// allocator and the pages the standard library touches late.
+SoakConfig::SoakConfig()
+    : durationMs(7LL * 24 * 3600 * 1000)
+    , reportEveryMs(3600LL * 1000)
+    , warmupReports(2)
+    , growthToleranceBytes(16ULL << 20)
+{
+}
+
+// Steps in slices of one report each; the simulation is only read between steps.
+bool runSoak(Simulation &sim, const SoakConfig &config, const std::function<void(const SoakSample &)> &report,
+             std::string *error)
+{
+    if (config.durationMs <= 0 || config.reportEveryMs < Simulation::TickMs) {
+        if (error)
+            *error = "Invalid soak duration or report interval";
+        return false;
+    }
+    // Without a cap, a saturated approach would grow its waiting queue for the whole soak
+    if (sim.vehicleLimit() == 0)
+        sim.setVehicleLimit(sim.vehicles().capacity());
+
+    const auto wallStart = std::chrono::steady_clock::now();
+    const std::int64_t endMs = sim.timeMs() + config.durationMs;
+    const std::uint64_t spawned0 = sim.spawnedCount();
+    const std::uint64_t despawned0 = sim.despawnedCount();
+    const std::uint64_t dropped0 = sim.droppedCount();
+
+    SoakSample sample = SoakSample();
+    sample.peakCars = sim.vehicles().size();
+    int reports = 0;
+    std::uint64_t warmupPeak = 0;
+    while (sim.timeMs() < endMs) {
+        const std::int64_t sliceEndMs = std::min(endMs, sim.timeMs() + config.reportEveryMs);
+        const std::uint64_t allocations0 = Telemetry::allocations();
+        std::int64_t steps = 0;
+        while (sim.timeMs() < sliceEndMs) {
+            sim.step();
+            ++steps;
+            sample.peakCars = std::max(sample.peakCars, sim.vehicles().size());
+        }
+
+        sample.timeMs = sim.timeMs();
+        sample.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+        sample.cars = sim.vehicles().size();
+        sample.waiting = sim.waitingCount();
+        sample.vehicleLimit = sim.vehicleLimit();
+        sample.capacity = sim.vehicles().capacity();
+        sample.spawned = sim.spawnedCount() - spawned0;
+        sample.despawned = sim.despawnedCount() - despawned0;
+        sample.dropped = sim.droppedCount() - dropped0;
+        sample.allocationsPerStep = steps > 0 ? double(Telemetry::allocations() - allocations0) / double(steps) : 0;
+        sample.residentBytes = residentMemoryBytes();
+        sample.peakResidentBytes = std::max(sample.peakResidentBytes, sample.residentBytes);
+
+        // The baseline is taken once, from the warm-up (from this report without one); later
+        // reports are held against it
+        ++reports;
+        if (reports <= config.warmupReports)
+            warmupPeak = std::max(warmupPeak, sample.residentBytes);
+        else if (sample.baselineBytes == 0)
+            sample.baselineBytes = config.warmupReports > 0 ? warmupPeak : sample.residentBytes;
+        if (report)
+            report(sample);
+
+        if (sample.baselineBytes > 0 && sample.residentBytes > sample.baselineBytes + config.growthToleranceBytes) {
+            if (error) {
+                std::ostringstream message;
+                message << "resident memory grew from " << (sample.baselineBytes >> 20) << " MiB to "
+                        << (sample.residentBytes >> 20) << " MiB at " << sample.timeMs / 1000 << " s (tolerance "
+                        << (config.growthToleranceBytes >> 20) << " MiB); " << sample.cars << " cars, "
+                        << sample.waiting << " waiting, " << sample.capacity << " slots";
+                *error = message.str();
+            }
+            return false;
+        }
+    }
+    return true;
+}
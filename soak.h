@@ -0,0 +1,55 @@
+#ifndef SOAK_H
+#define SOAK_H
+
+#include <cstdint>      // Counts and byte sizes
+#include <functional>   // Report callback
+#include <string>       // Reason of a failure
+#include "simulation.h" // The simulation that is soaked
+
+// Resident memory of this process in bytes, or 0 where the platform does not tell.
+std::uint64_t residentMemoryBytes();
+
+// How long a soak runs and what it tolerates.
+struct SoakConfig
+{
+    std::int64_t durationMs;            // Simulated time of the whole soak
+    std::int64_t reportEveryMs;         // Simulated time between two reports
+    int warmupReports;                  // Reports before the memory baseline is taken
+    std::uint64_t growthToleranceBytes; // Resident memory allowed above the baseline
+
+    SoakConfig();
+};
+
+// State of the soak at a report. Counts of cars are those of the simulation, which owns every
+// car it has: its pool of slots and the queues waiting to enter the lanes.
+struct SoakSample
+{
+    std::int64_t timeMs;                // Simulated time
+    double wallSeconds;                 // Real time since the soak started
+    int cars;                           // Cars on the road now
+    int peakCars;                       // Most cars on the road at any step so far
+    int waiting;                        // Cars waiting to enter a lane now
+    int vehicleLimit;                   // Cap on cars plus waiting (Simulation::vehicleLimit)
+    int capacity;                       // Slots of the car pool
+    std::uint64_t spawned;              // Totals since the soak started
+    std::uint64_t despawned;
+    std::uint64_t dropped;
+    double allocationsPerStep;          // Heap allocations per step since the last report
+    std::uint64_t residentBytes;        // Resident memory now, 0 if unknown
+    std::uint64_t peakResidentBytes;    // Highest resident memory seen at a report
+    std::uint64_t baselineBytes;        // Steady-state baseline, 0 during the warm-up
+};
+
+// Runs `sim` (already started or restored) for config.durationMs, calling `report` every
+// config.reportEveryMs of simulated time and once at the end. A simulation without a vehicle
+// limit gets one at the capacity of its car pool, so its waiting queues stay bounded. Once the warm-up reports have
+// passed, the highest resident memory they saw becomes the baseline (without a warm-up, that of
+// the first report): the road has filled, the pool and the queues have reached their steady
+// size, and every later report must stay within the tolerance of it. A simulation that keeps
+// growing (cars never despawned, queues that are never drained, caches that are never trimmed)
+// fails the soak. False on such a growth, with the reason in `error`; without a resident memory
+// figure only the car counts are reported.
+bool runSoak(Simulation &sim, const SoakConfig &config, const std::function<void(const SoakSample &)> &report,
+             std::string *error);
+
+#endif // SOAK_H
@@ -0,0 +1,90 @@
+#include "spatialgrid.h"   // Header file for the SpatialGrid class
+#include <algorithm>       // std::fill, std::max, std::min
+#include <cmath>           // std::ceil, std::floor
+
+// Constructor: sizes the cell table; the item table grows with the first builds.
+SpatialGrid::SpatialGrid(float x, float y, float width, float height, float cellSize)
+    : m_x(x)
+    , m_y(y)
+    , m_invCell(1.0f / cellSize)
+    , m_columns(std::max(1, int(std::ceil(width / cellSize))))
+    , m_rows(std::max(1, int(std::ceil(height / cellSize))))
+    , m_cellStart(std::size_t(m_columns) * m_rows + 1, 0)
+    , m_fill(std::size_t(m_columns) * m_rows, 0)
+    , m_minX(nullptr)
+    , m_minY(nullptr)
+    , m_maxX(nullptr)
+    , m_maxY(nullptr)
+    , m_indexed(0)
+{
+}
+
+// Counting sort of the boxes into their cells.
+void SpatialGrid::build(const float *minX, const float *minY, const float *maxX, const float *maxY,
+                        const std::uint8_t *state, int count)
+{
+    m_minX = minX;
+    m_minY = minY;
+    m_maxX = maxX;
+    m_maxY = maxY;
+
+    // Pass 1: number of boxes touching each cell
+    std::fill(m_fill.begin(), m_fill.end(), 0);
+    int entries = 0;
+    m_indexed = 0;
+    for (int i = 0; i < count; ++i) {
+        if (!state[i])
+            continue;
+        int cx0, cy0, cx1, cy1;
+        cellRange(minX[i], minY[i], maxX[i], maxY[i], cx0, cy0, cx1, cy1);
+        for (int cy = cy0; cy <= cy1; ++cy)
+            for (int cx = cx0; cx <= cx1; ++cx)
+                ++m_fill[cy * m_columns + cx];
+        entries += (cx1 - cx0 + 1) * (cy1 - cy0 + 1);
+        ++m_indexed;
+    }
+
+    // Prefix sum: each cell's range in the item table
+    int cells = m_columns * m_rows;
+    m_cellStart[0] = 0;
+    for (int c = 0; c < cells; ++c) {
+        m_cellStart[c + 1] = m_cellStart[c] + m_fill[c];
+        m_fill[c] = m_cellStart[c];
+    }
+    if (int(m_items.size()) < entries)
+        m_items.resize(entries);
+
+    // Pass 2: write the box indices into their cells
+    for (int i = 0; i < count; ++i) {
+        if (!state[i])
+            continue;
+        int cx0, cy0, cx1, cy1;
+        cellRange(minX[i], minY[i], maxX[i], maxY[i], cx0, cy0, cx1, cy1);
+        for (int cy = cy0; cy <= cy1; ++cy)
+            for (int cx = cx0; cx <= cx1; ++cx)
+                m_items[m_fill[cy * m_columns + cx]++] = i;
+    }
+}
+
+// Number of boxes in the index.
+int SpatialGrid::indexedCount() const
+{
+    return m_indexed;
+}
+
+// Cell containing the point, clamped to the grid border.
+int SpatialGrid::cellOf(float px, float py) const
+{
+    int cx = std::min(m_columns - 1, std::max(0, int(std::floor((px - m_x) * m_invCell))));
+    int cy = std::min(m_rows - 1, std::max(0, int(std::floor((py - m_y) * m_invCell))));
+    return cy * m_columns + cx;
+}
+
+// Cells touched by the rectangle, clamped to the grid border.
+void SpatialGrid::cellRange(float x0, float y0, float x1, float y1, int &cx0, int &cy0, int &cx1, int &cy1) const
+{
+    cx0 = std::min(m_columns - 1, std::max(0, int(std::floor((x0 - m_x) * m_invCell))));
+    cy0 = std::min(m_rows - 1, std::max(0, int(std::floor((y0 - m_y) * m_invCell))));
+    cx1 = std::min(m_columns - 1, std::max(0, int(std::floor((x1 - m_x) * m_invCell))));
+    cy1 = std::min(m_rows - 1, std::max(0, int(std::floor((y1 - m_y) * m_invCell))));
+}
@@ -0,0 +1,118 @@
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include <cstdint>     // Fixed-width integer types for slots and flags
+#include <vector>      // Cell tables rebuilt every step without reallocating
+
+// Uniform grid over a rectangle of the scene, indexing axis-aligned boxes (one per car slot).
+// The grid is rebuilt from scratch with a counting sort every step: one pass counts the boxes
+// per cell, a prefix sum gives each cell its range, and a second pass fills the ranges.
+// Building and querying are linear in the number of boxes, and no memory is allocated once
+// the tables reached their working size. Boxes outside the rectangle are clamped to its border cells.
+class SpatialGrid
+{
+public:
+    // Constructor: grid covering [x, x + width) x [y, y + height) with square cells of `cellSize`.
+    SpatialGrid(float x, float y, float width, float height, float cellSize);
+
+    // Indexes every box whose `state` is non-zero. Box i spans [minX[i], maxX[i]] x [minY[i], maxY[i]].
+    void build(const float *minX, const float *minY, const float *maxX, const float *maxY,
+               const std::uint8_t *state, int count);
+
+    // Calls visit(i) for every indexed box overlapping the cells touched by the rectangle.
+    // A box covering several cells may be visited more than once.
+    template <typename Visitor>
+    void query(float x0, float y0, float x1, float y1, Visitor &&visit) const
+    {
+        int cx0, cy0, cx1, cy1;
+        cellRange(x0, y0, x1, y1, cx0, cy0, cx1, cy1);
+        for (int cy = cy0; cy <= cy1; ++cy) {
+            for (int cx = cx0; cx <= cx1; ++cx) {
+                int cell = cy * m_columns + cx;
+                for (int k = m_cellStart[cell]; k < m_cellStart[cell + 1]; ++k)
+                    visit(m_items[k]);
+            }
+        }
+    }
+
+    // Calls visit(i) exactly once for every indexed box overlapping the rectangle, e.g. to draw
+    // only what is on screen. A box is reported by the cell holding the top-left corner of its
+    // part inside the rectangle.
+    template <typename Visitor>
+    void queryUnique(float x0, float y0, float x1, float y1, Visitor &&visit) const
+    {
+        int cx0, cy0, cx1, cy1;
+        cellRange(x0, y0, x1, y1, cx0, cy0, cx1, cy1);
+        for (int cy = cy0; cy <= cy1; ++cy) {
+            for (int cx = cx0; cx <= cx1; ++cx) {
+                int cell = cy * m_columns + cx;
+                for (int k = m_cellStart[cell]; k < m_cellStart[cell + 1]; ++k) {
+                    int i = m_items[k];
+                    if (m_minX[i] > x1 || m_minY[i] > y1 || m_maxX[i] < x0 || m_maxY[i] < y0)
+                        continue;
+                    float px = m_minX[i] > x0 ? m_minX[i] : x0;
+                    float py = m_minY[i] > y0 ? m_minY[i] : y0;
+                    if (cellOf(px, py) == cell)
+                        visit(i);
+                }
+            }
+        }
+    }
+
+    // Calls visit(i, j) once for every pair of indexed boxes that overlap each other inside the
+    // rectangle. Each pair is reported by the single cell holding the top-left corner of the overlap's
+    // part inside the rectangle.
+    template <typename Visitor>
+    void overlappingPairs(float x0, float y0, float x1, float y1, Visitor &&visit) const
+    {
+        int cx0, cy0, cx1, cy1;
+        cellRange(x0, y0, x1, y1, cx0, cy0, cx1, cy1);
+        for (int cy = cy0; cy <= cy1; ++cy) {
+            for (int cx = cx0; cx <= cx1; ++cx) {
+                int cell = cy * m_columns + cx;
+                for (int a = m_cellStart[cell]; a < m_cellStart[cell + 1]; ++a) {
+                    int i = m_items[a];
+                    for (int b = a + 1; b < m_cellStart[cell + 1]; ++b) {
+                        int j = m_items[b];
+                        // Overlap of the two boxes, if any
+                        float ox0 = m_minX[i] > m_minX[j] ? m_minX[i] : m_minX[j];
+                        float oy0 = m_minY[i] > m_minY[j] ? m_minY[i] : m_minY[j];
+                        float ox1 = m_maxX[i] < m_maxX[j] ? m_maxX[i] : m_maxX[j];
+                        float oy1 = m_maxY[i] < m_maxY[j] ? m_maxY[i] : m_maxY[j];
+                        if (ox0 >= ox1 || oy0 >= oy1)
+                            continue;
+                        // Only inside the rectangle, and only by the cell owning the top-left corner
+                        // of the overlap's part inside it, which is always one of the cells visited
+                        if (ox0 >= x1 || oy0 >= y1 || ox1 <= x0 || oy1 <= y0)
+                            continue;
+                        if (cellOf(ox0 > x0 ? ox0 : x0, oy0 > y0 ? oy0 : y0) != cell)
+                            continue;
+                        visit(i, j);
+                    }
+                }
+            }
+        }
+    }
+
+    // Number of boxes indexed by the last build().
+    int indexedCount() const;
+
+private:
+    // Cell index of a point, clamped to the grid.
+    int cellOf(float px, float py) const;
+
+    // Range of cells touched by a rectangle, clamped to the grid.
+    void cellRange(float x0, float y0, float x1, float y1, int &cx0, int &cy0, int &cx1, int &cy1) const;
+
+    float m_x, m_y;                   // Top-left corner of the grid
+    float m_invCell;                  // 1 / cell size
+    int m_columns, m_rows;            // Grid dimensions in cells
+    std::vector<int> m_cellStart;     // For each cell, first index into m_items (plus one end marker)
+    std::vector<int> m_items;         // Box indices grouped by cell
+    std::vector<int> m_fill;          // Write cursor per cell while building
+    const float *m_minX, *m_minY;     // Boxes of the last build (owned by the caller)
+    const float *m_maxX, *m_maxY;
+    int m_indexed;                    // Boxes indexed by the last build
+};
+
+#endif // SPATIALGRID_H
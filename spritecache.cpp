@@ -0,0 +1,98 @@
+#include "spritecache.h"   // Header file for the SpriteCache class
+#include <QImage>          // Offscreen image the transformed sprites are rendered into
+#include <QPainter>        // Renders the transformed sprites
+#include <QTransform>      // Rotation and scale of a sprite
+#include <QtMath>          // qCeil
+
+// Constructor: the cache starts empty, images are decoded on first request.
+SpriteCache::SpriteCache()
+    : hitCount(0)
+    , missCount(0)
+{
+}
+
+// The single cache shared by the whole application.
+SpriteCache &SpriteCache::instance()
+{
+    static SpriteCache cache;
+    return cache;
+}
+
+// Returns the decoded image, decoding it from the resource file the first time.
+QPixmap SpriteCache::pixmap(const QString &path)
+{
+    auto it = images.constFind(path);
+    if (it != images.constEnd()) {
+        ++hitCount;
+        return it.value();
+    }
+    ++missCount;
+    QPixmap decoded(path);
+    images.insert(path, decoded);
+    return decoded;
+}
+
+// Returns the image rendered with the given scale and rotation, rendering it the first time.
+CachedSprite SpriteCache::transformed(const QString &path, qreal scale, qreal rotation)
+{
+    const QString key = path + QLatin1Char('|') + QString::number(scale) + QLatin1Char('|')
+                        + QString::number(rotation);
+    auto it = transforms.constFind(key);
+    if (it != transforms.constEnd()) {
+        ++hitCount;
+        return it.value();
+    }
+
+    QPixmap source = pixmap(path);
+    ++missCount;
+
+    // Same transformation QGraphicsItem applies: rotation and scale around the item origin
+    QTransform transform;
+    transform.rotate(rotation);
+    transform.scale(scale, scale);
+    QRectF drawn = transform.mapRect(QRectF(source.rect()));
+
+    QImage image(qCeil(drawn.width()), qCeil(drawn.height()), QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.translate(-drawn.topLeft());
+    painter.setTransform(transform, true);
+    painter.drawPixmap(0, 0, source);
+    painter.end();
+
+    CachedSprite sprite;
+    sprite.pixmap = QPixmap::fromImage(image);
+    sprite.offset = drawn.topLeft();
+    transforms.insert(key, sprite);
+    return sprite;
+}
+
+// Returns the image resized to fit `size`, resizing it the first time.
+QPixmap SpriteCache::scaled(const QString &path, const QSize &size)
+{
+    const QString key = path + QLatin1Char('|') + QString::number(size.width()) + QLatin1Char('x')
+                        + QString::number(size.height());
+    auto it = scaledImages.constFind(key);
+    if (it != scaledImages.constEnd()) {
+        ++hitCount;
+        return it.value();
+    }
+
+    QPixmap resized = pixmap(path).scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    ++missCount;
+    scaledImages.insert(key, resized);
+    return resized;
+}
+
+// Requests served from the cache.
+quint64 SpriteCache::hits() const
+{
+    return hitCount;
+}
+
+// Requests that had to decode, scale or rotate an image.
+quint64 SpriteCache::misses() const
+{
+    return missCount;
+}
@@ -0,0 +1,52 @@
+#ifndef SPRITECACHE_H
+#define SPRITECACHE_H
+
+// Including necessary Qt classes
+#include <QHash>        // Cached pixmaps keyed by image path and transformation
+#include <QPixmap>      // Decoded images
+#include <QPointF>      // Offset of a transformed image relative to the item origin
+#include <QSize>        // Target size of scaled images
+#include <QString>      // Resource paths and cache keys
+
+// A pixmap rotated and scaled ahead of time, ready to be drawn without a transform.
+struct CachedSprite
+{
+    QPixmap pixmap;   // The transformed image
+    QPointF offset;   // Where its top-left corner lies relative to the untransformed origin
+};
+
+// SpriteCache decodes every image of the resource file once and keeps the decoded,
+// scaled and rotated versions, so nothing reads or decodes a PNG on the hot path.
+// Cars, traffic lights and the background all draw from the single instance(),
+// which must only be used from the GUI thread (QPixmap is not thread-safe).
+class SpriteCache
+{
+public:
+    // The application-wide cache.
+    static SpriteCache &instance();
+
+    // The image at `path`, decoded on first use.
+    QPixmap pixmap(const QString &path);
+
+    // The image at `path` scaled by `scale` and rotated by `rotation` degrees around its
+    // top-left corner, the way QGraphicsItem::setScale()/setRotation() would draw it.
+    CachedSprite transformed(const QString &path, qreal scale, qreal rotation);
+
+    // The image at `path` scaled to fit `size`, keeping its aspect ratio.
+    QPixmap scaled(const QString &path, const QSize &size);
+
+    // Number of requests answered from the cache and number that had to decode or transform.
+    quint64 hits() const;
+    quint64 misses() const;
+
+private:
+    SpriteCache();
+
+    QHash<QString, QPixmap> images;             // Decoded originals keyed by path
+    QHash<QString, CachedSprite> transforms;    // Transformed images keyed by path, scale and rotation
+    QHash<QString, QPixmap> scaledImages;       // Resized images keyed by path and size
+    quint64 hitCount;                           // Requests served from the cache
+    quint64 missCount;                          // Requests that filled the cache
+};
+
+#endif // SPRITECACHE_H
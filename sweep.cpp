@@ -0,0 +1,182 @@
+#include "sweep.h"         // Header file for ParameterSweep
+#include "simulation.h"    // The simulation run at every point
+#include <algorithm>       // std::max, std::min
+#include <deque>           // Per-worker task queues
+#include <mutex>           // Protects each queue
+#include <thread>          // Worker threads
+#include <utility>         // std::move
+
+// Constructor: stores the layout factory and the run length.
+ParameterSweep::ParameterSweep(Setup setup, std::int64_t durationMs)
+    : m_setup(std::move(setup))
+    , m_durationMs(durationMs)
+{
+}
+
+// Cartesian product of the parameter lists, with `replications` seeds each.
+std::vector<SweepPoint> ParameterSweep::grid(const std::vector<int> &cyclesMs, const std::vector<double> &splits,
+                                             const std::vector<double> &arrivalScales,
+                                             const std::vector<SignalControl> &controls, int replications,
+                                             std::uint64_t baseSeed)
+{
+    std::vector<SweepPoint> points;
+    for (int cycle : cyclesMs)
+        for (double split : splits)
+            for (double scale : arrivalScales)
+                for (SignalControl control : controls)
+                    for (int r = 0; r < replications; ++r)
+                        points.push_back(SweepPoint{cycle, split, scale, control, baseSeed + std::uint64_t(r)});
+    return points;
+}
+
+// An arrival interval divided by the rate multiplier, capped at about eleven days so that it
+// always fits an int, whatever the interval of the layout.
+static int scaledInterval(double intervalMs, double arrivalScale)
+{
+    return int(std::min(intervalMs / arrivalScale, 1e9));
+}
+
+// Builds the layout, applies the point's timing, controller and demand, and simulates the full duration.
+SweepResult ParameterSweep::runPoint(const SweepPoint &point) const
+{
+    std::string error;
+    if (!validPoint(point, &error))
+        return SweepResult{point, RunSummary(), error};
+
+    Simulation sim(point.seed);
+    m_setup(sim);
+
+    // Phase 0 gets the split, the remaining phases share the rest of the cycle equally
+    for (int j = 0; j < int(sim.junctions().size()); ++j) {
+        const int phases = sim.junctions()[j].phaseCount;
+        std::vector<int> durations(phases);
+        const int first = phases > 1 ? int(point.cycleMs * point.split) : point.cycleMs;
+        durations[0] = std::max(Simulation::TickMs, first);
+        for (int p = 1; p < phases; ++p)
+            durations[p] = std::max(Simulation::TickMs, (point.cycleMs - first) / (phases - 1));
+        sim.setPhaseDurations(j, durations);
+        sim.setSignalControl(j, point.control, sim.junctions()[j].timing);
+    }
+
+    // A higher arrival rate means proportionally shorter intervals
+    for (int a = 0; a < int(sim.approaches().size()); ++a) {
+        const SimApproach &approach = sim.approaches()[a];
+        if (approach.distribution == ArrivalDistribution::Exponential) {
+            sim.setExponentialArrivals(a, scaledInterval(approach.meanIntervalMs, point.arrivalScale));
+            continue;
+        }
+        if (approach.distribution == ArrivalDistribution::Profile) {
+            std::vector<DemandPoint> profile = approach.profile;
+            for (DemandPoint &demand : profile)
+                demand.perHour *= point.arrivalScale;
+            sim.setDemandProfile(a, profile);
+            continue;
+        }
+        if (approach.distribution == ArrivalDistribution::None)
+            continue;
+        int minMs = std::max(Simulation::TickMs, scaledInterval(approach.minIntervalMs, point.arrivalScale));
+        int maxMs = std::max(minMs + 1, scaledInterval(approach.maxIntervalMs, point.arrivalScale));
+        sim.setArrivalInterval(a, minMs, maxMs);
+    }
+
+    // A forked run keeps the junction timers and arrivals in progress; new durations and
+    // intervals take over at the next phase change, as when they are changed during a run
+    if (m_initialState.empty()) {
+        sim.start();
+    } else {
+        sim.restoreState(m_initialState.data(), m_initialState.size(), nullptr);
+        if (sim.seed() != point.seed)
+            sim.reseed(point.seed);
+        sim.resetMeasurements();
+    }
+    const std::int64_t steps = m_durationMs / Simulation::TickMs;
+    for (std::int64_t i = 0; i < steps; ++i)
+        sim.step();
+
+    return SweepResult{point, summarize(sim), std::string()};
+}
+
+// Shorter cycles, splits outside the cycle and rates out of range would give phase
+// durations and arrival intervals that are zero, negative or out of the range of an int.
+bool ParameterSweep::validPoint(const SweepPoint &point, std::string *error)
+{
+    const char *problem = nullptr;
+    if (point.cycleMs < Simulation::TickMs)
+        problem = "cycle shorter than one step";
+    else if (!(point.split >= 0 && point.split <= 1))
+        problem = "split outside [0, 1]";
+    else if (!(point.arrivalScale >= MinArrivalScale && point.arrivalScale <= MaxArrivalScale))
+        problem = "arrival rate multiplier outside [0.001, 1000]";
+    if (problem && error)
+        *error = problem;
+    return !problem;
+}
+
+// Checked once against the layout, so runPoint() can restore it without looking.
+bool ParameterSweep::setInitialState(const std::vector<std::uint8_t> &state, std::string *error)
+{
+    Simulation sim;
+    m_setup(sim);
+    if (!sim.restoreState(state.data(), state.size(), error))
+        return false;
+    m_initialState = state;
+    return true;
+}
+
+// Work-stealing execution of the points over a fixed set of threads.
+std::vector<SweepResult> ParameterSweep::run(const std::vector<SweepPoint> &points, int threads) const
+{
+    if (threads <= 0)
+        threads = int(std::max(1u, std::thread::hardware_concurrency()));
+    threads = std::max(1, std::min(threads, int(points.size())));
+
+    // Each worker owns a queue of point indices, dealt round-robin
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+    std::vector<Queue> queues(threads);
+    for (int i = 0; i < int(points.size()); ++i)
+        queues[i % threads].tasks.push_back(i);
+
+    std::vector<SweepResult> results(points.size());
+
+    auto worker = [&](int self) {
+        for (;;) {
+            int task = -1;
+
+            // Own work first, from the front
+            {
+                std::lock_guard<std::mutex> lock(queues[self].mutex);
+                if (!queues[self].tasks.empty()) {
+                    task = queues[self].tasks.front();
+                    queues[self].tasks.pop_front();
+                }
+            }
+
+            // Otherwise steal from the back of another worker's queue
+            for (int k = 1; task < 0 && k < threads; ++k) {
+                Queue &victim = queues[(self + k) % threads];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (!victim.tasks.empty()) {
+                    task = victim.tasks.back();
+                    victim.tasks.pop_back();
+                }
+            }
+
+            if (task < 0)
+                return;  // Every queue is empty: no new work can appear
+            results[task] = runPoint(points[task]);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; ++t)
+        pool.emplace_back(worker, t);
+    worker(0);  // The calling thread works too
+    for (std::thread &thread : pool)
+        thread.join();
+
+    return results;
+}
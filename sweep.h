@@ -0,0 +1,81 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <cstdint>      // Seeds
+#include <functional>   // Layout factory passed to the sweep
+#include <string>       // Errors of the initial state
+#include <vector>       // Grid points and results
+#include "metrics.h"    // RunSummary of each run
+#include "simulation.h" // SignalControl
+
+// One combination of signal timing and demand evaluated by the sweep.
+struct SweepPoint
+{
+    int cycleMs;            // Full cycle length (sum of all phases) of every junction
+    double split;           // Share of the cycle given to phase 0; the other phases share the rest
+    double arrivalScale;    // Multiplies the arrival rate (divides the arrival intervals)
+    SignalControl control;  // Policy of every junction, replacing the layout's; limits are kept
+    std::uint64_t seed;     // Seed of this run
+};
+
+// Result of one run of the sweep.
+struct SweepResult
+{
+    SweepPoint point;       // Parameters of the run
+    RunSummary summary;     // Its metrics, empty if the point was rejected
+    std::string error;      // Why the point was rejected (see validPoint), empty if it ran
+};
+
+// Runs one independent simulation per grid point, in parallel on `threads` workers.
+// Each worker starts with an equal share of the points in its own queue and, once that is
+// empty, steals points from the back of the other workers' queues, so a few slow runs
+// (long cycles, heavy demand) do not leave cores idle. Every run owns its Simulation and its
+// random generator; nothing is shared between runs except the read-only inputs.
+class ParameterSweep
+{
+public:
+    // Loads a layout into an empty simulation (e.g. Simulation::loadDefaultCross).
+    using Setup = std::function<void(Simulation &)>;
+
+    // Constructor: `setup` builds the layout of every run, `durationMs` is the simulated time per run.
+    ParameterSweep(Setup setup, std::int64_t durationMs);
+
+    // Builds the full grid: every combination of the lists, and `replications` seeds per
+    // combination starting at `baseSeed`. Timing and controller variants share seeds (common
+    // random numbers), so their differences are not blurred by different arrivals.
+    static std::vector<SweepPoint> grid(const std::vector<int> &cyclesMs, const std::vector<double> &splits,
+                                        const std::vector<double> &arrivalScales,
+                                        const std::vector<SignalControl> &controls, int replications,
+                                        std::uint64_t baseSeed);
+
+    // Runs every point and returns the results in the order of `points`.
+    // `threads` <= 0 uses every hardware thread.
+    std::vector<SweepResult> run(const std::vector<SweepPoint> &points, int threads) const;
+
+    // Runs a single point on the calling thread. A point failing validPoint() is not simulated:
+    // its result carries the error and an empty summary.
+    SweepResult runPoint(const SweepPoint &point) const;
+
+    // Whether a point can be simulated: a cycle of at least one step, a split within [0, 1] and
+    // an arrival multiplier within [MinArrivalScale, MaxArrivalScale]. Returns false and sets
+    // `error` otherwise.
+    static bool validPoint(const SweepPoint &point, std::string *error);
+
+    // Range of SweepPoint::arrivalScale: a thousand times less to a thousand times more traffic.
+    static constexpr double MinArrivalScale = 1e-3;
+    static constexpr double MaxArrivalScale = 1e3;
+
+    // Starts every run from a state saved with Simulation::saveState (e.g. after a warm-up)
+    // instead of an empty road, and measures only what follows it. Runs whose seed differs from
+    // the state's draw their arrivals afresh from their own seed; timing and controller variants
+    // of one seed fork from the very same state and random numbers. Returns false and sets
+    // `error` if the state does not fit the layout of the setup.
+    bool setInitialState(const std::vector<std::uint8_t> &state, std::string *error);
+
+private:
+    Setup m_setup;              // Layout factory
+    std::int64_t m_durationMs;  // Simulated time per run
+    std::vector<std::uint8_t> m_initialState;  // State every run starts from, empty to start afresh
+};
+
+#endif // SWEEP_H
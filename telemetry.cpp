@@ -0,0 +1,423 @@
+#include "telemetry.h"   // Header file for the telemetry counters
+#include <algorithm>     // std::min, std::max
+#include <atomic>        // Per-thread accumulators
+#include <chrono>        // Steady clock
+#include <cstdio>        // std::snprintf for the report
+#include <cstdlib>       // std::malloc, std::free for the counting operator new
+#include <mutex>         // Guards the block registry
+#include <new>           // std::bad_alloc, std::get_new_handler
+
+// Constructor: an empty histogram.
+DurationHistogram::DurationHistogram()
+    : m_buckets(BucketCount, 0)
+    , m_count(0)
+    , m_sum(0)
+    , m_max(0)
+{
+}
+
+// Durations below 4 ns have a bucket each; above, the two bits after the leading one pick one of
+// four buckets per power of two.
+int DurationHistogram::bucketOf(std::uint64_t ns)
+{
+    if (ns < 4)
+        return int(ns);
+    int octave = 63;
+    while (!(ns >> octave))
+        --octave;
+    return (octave - 1) * 4 + int((ns >> (octave - 2)) & 3);
+}
+
+// Inverse of bucketOf() for the lower edge.
+std::uint64_t DurationHistogram::bucketStart(int bucket)
+{
+    if (bucket < 4)
+        return std::uint64_t(bucket);
+    return std::uint64_t(4 + bucket % 4) << (bucket / 4 - 1);
+}
+
+// Adds a batch of samples, as folded from a thread's accumulators.
+void DurationHistogram::add(int bucket, std::uint64_t count, std::uint64_t sumNs, std::uint64_t maxNs)
+{
+    m_buckets[bucket] += count;
+    m_count += count;
+    m_sum += sumNs;
+    m_max = std::max(m_max, maxNs);
+}
+
+// Number of durations recorded.
+std::uint64_t DurationHistogram::count() const
+{
+    return m_count;
+}
+
+// Mean duration, 0 when empty.
+double DurationHistogram::mean() const
+{
+    return m_count ? double(m_sum) / double(m_count) : 0.0;
+}
+
+// Longest duration recorded.
+std::uint64_t DurationHistogram::max() const
+{
+    return m_max;
+}
+
+// Walks the buckets until the requested share of samples is reached and returns the upper
+// edge of that bucket (never more than the real maximum).
+double DurationHistogram::percentile(double p) const
+{
+    if (m_count == 0)
+        return 0.0;
+    const double target = p * double(m_count);
+    std::uint64_t seen = 0;
+    for (int bucket = 0; bucket < BucketCount; ++bucket) {
+        seen += m_buckets[bucket];
+        if (double(seen) >= target)
+            return double(std::min(m_max, bucket + 1 < BucketCount ? bucketStart(bucket + 1) : m_max));
+    }
+    return double(m_max);
+}
+
+// Adds the other histogram's samples.
+void DurationHistogram::merge(const DurationHistogram &other)
+{
+    for (int bucket = 0; bucket < BucketCount; ++bucket)
+        m_buckets[bucket] += other.m_buckets[bucket];
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    m_max = std::max(m_max, other.m_max);
+}
+
+// Constructor: every counter at 0.
+TelemetryTotals::TelemetryTotals()
+    : counters{}
+{
+}
+
+// Value of one counter.
+std::uint64_t TelemetryTotals::counter(TelemetryCounter c) const
+{
+    return counters[int(c)];
+}
+
+// Histogram of one timing.
+const DurationHistogram &TelemetryTotals::timing(TelemetryTiming t) const
+{
+    return timings[int(t)];
+}
+
+namespace {
+constexpr int CounterCount = int(TelemetryCounter::Count);
+constexpr int TimingCount = int(TelemetryTiming::Count);
+}  // namespace
+
+// Accumulators of one thread. Written by that thread only, read by any: relaxed loads and stores
+// are enough, and an increment never needs a locked read-modify-write.
+struct TelemetryBlock
+{
+    std::atomic<std::uint64_t> counters[CounterCount];
+    std::atomic<std::uint64_t> buckets[TimingCount][DurationHistogram::BucketCount];
+    std::atomic<std::uint64_t> sum[TimingCount];
+    std::atomic<std::uint64_t> max[TimingCount];
+};
+
+// Per-thread accumulators and their registry.
+namespace {
+
+using Block = TelemetryBlock;
+
+void bump(std::atomic<std::uint64_t> &value, std::uint64_t n)
+{
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// Adds a block to totals.
+void fold(const Block &block, TelemetryTotals &totals)
+{
+    for (int c = 0; c < CounterCount; ++c)
+        totals.counters[c] += block.counters[c].load(std::memory_order_relaxed);
+    for (int t = 0; t < TimingCount; ++t) {
+        for (int b = 0; b < DurationHistogram::BucketCount; ++b) {
+            const std::uint64_t count = block.buckets[t][b].load(std::memory_order_relaxed);
+            if (count)
+                totals.timings[t].add(b, count, 0, 0);
+        }
+        totals.timings[t].add(0, 0, block.sum[t].load(std::memory_order_relaxed),
+                              block.max[t].load(std::memory_order_relaxed));
+    }
+}
+
+// Blocks of the running threads, and what the finished ones left behind.
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<Block *> blocks;
+    TelemetryTotals retired;
+};
+
+Registry &registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+std::atomic<bool> g_enabled{false};
+
+// Trivially constructed, so reaching them costs no initialisation check
+thread_local Block *t_block = nullptr;
+thread_local std::uint64_t t_allocations = 0;
+
+// Folds the thread's block into the retired totals when the thread ends.
+struct BlockOwner
+{
+    ~BlockOwner()
+    {
+        if (!t_block)
+            return;
+        Registry &r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        fold(*t_block, r.retired);
+        r.blocks.erase(std::find(r.blocks.begin(), r.blocks.end(), t_block));
+        delete t_block;
+        t_block = nullptr;
+    }
+};
+thread_local BlockOwner t_owner;
+
+// The calling thread's block, registered on first use.
+Block &block()
+{
+    if (!t_block) {
+        Block *created = new Block();
+        for (auto &counter : created->counters)
+            counter.store(0, std::memory_order_relaxed);
+        for (int t = 0; t < TimingCount; ++t) {
+            for (auto &bucket : created->buckets[t])
+                bucket.store(0, std::memory_order_relaxed);
+            created->sum[t].store(0, std::memory_order_relaxed);
+            created->max[t].store(0, std::memory_order_relaxed);
+        }
+        (void)&t_owner;  // Constructs the owner, so the block is folded when the thread ends
+        Registry &r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.blocks.push_back(created);
+        t_block = created;
+    }
+    return *t_block;
+}
+
+// Shared by every form of operator new: counts, then behaves as the standard one.
+void *allocate(std::size_t size)
+{
+    ++t_allocations;
+    if (size == 0)
+        size = 1;
+    for (;;) {
+        if (void *memory = std::malloc(size))
+            return memory;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+}  // namespace
+
+// Heap allocations are counted per thread, whether telemetry is on or not: a thread-local
+// increment is all it adds to an allocation.
+void *operator new(std::size_t size)
+{
+    return allocate(size);
+}
+
+void *operator new[](std::size_t size)
+{
+    return allocate(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    try {
+        return allocate(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    try {
+        return allocate(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t &) noexcept
+{
+    std::free(memory);
+}
+
+// Recording stays off until a front end asks for it.
+void Telemetry::setEnabled(bool enabled)
+{
+    g_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+// Whether recording is on.
+bool Telemetry::enabled()
+{
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+// One relaxed load and store on the thread's own block.
+void Telemetry::count(TelemetryCounter c, std::uint64_t n)
+{
+    if (enabled())
+        bump(block().counters[int(c)], n);
+}
+
+// Bucket, sum and maximum of the thread's own histogram.
+void Telemetry::time(TelemetryTiming t, std::uint64_t ns)
+{
+    if (!enabled())
+        return;
+    Block &b = block();
+    bump(b.buckets[int(t)][DurationHistogram::bucketOf(ns)], 1);
+    bump(b.sum[int(t)], ns);
+    if (ns > b.max[int(t)].load(std::memory_order_relaxed))
+        b.max[int(t)].store(ns, std::memory_order_relaxed);
+}
+
+// Steady clock, as the frame pacing uses.
+std::uint64_t Telemetry::now()
+{
+    return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Allocations of the calling thread.
+std::uint64_t Telemetry::allocations()
+{
+    return t_allocations;
+}
+
+// Retired totals plus a relaxed read of every live block; a block being written may be read
+// half-updated, which at worst shows a sample in the count but not yet in the sum.
+TelemetryTotals Telemetry::totals()
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    TelemetryTotals totals = r.retired;
+    for (const Block *b : r.blocks)
+        fold(*b, totals);
+    return totals;
+}
+
+// Counters as they are, durations as count, mean, median, p99 and maximum in microseconds.
+std::string Telemetry::report()
+{
+    const TelemetryTotals totals = Telemetry::totals();
+    std::string text;
+    char line[160];
+    for (int c = 0; c < CounterCount; ++c) {
+        std::snprintf(line, sizeof line, "%-12s %llu\n", name(TelemetryCounter(c)),
+                      (unsigned long long)totals.counters[c]);
+        text += line;
+    }
+    const std::uint64_t steps = totals.counter(TelemetryCounter::Steps);
+    std::snprintf(line, sizeof line, "%-12s %.3f\n", "allocs/step",
+                  steps ? double(totals.counter(TelemetryCounter::Allocations)) / double(steps) : 0.0);
+    text += line;
+    for (int t = 0; t < TimingCount; ++t) {
+        const DurationHistogram &h = totals.timings[t];
+        std::snprintf(line, sizeof line, "%-12s n %llu  mean %.2f us  p50 %.2f us  p99 %.2f us  max %.2f us\n",
+                      name(TelemetryTiming(t)), (unsigned long long)h.count(), h.mean() / 1e3,
+                      h.percentile(0.5) / 1e3, h.percentile(0.99) / 1e3, double(h.max()) / 1e3);
+        text += line;
+    }
+    return text;
+}
+
+// Counter names.
+const char *Telemetry::name(TelemetryCounter c)
+{
+    switch (c) {
+    case TelemetryCounter::Steps: return "steps";
+    case TelemetryCounter::Spawns: return "spawns";
+    case TelemetryCounter::Despawns: return "despawns";
+    case TelemetryCounter::Allocations: return "allocations";
+    case TelemetryCounter::Frames: return "frames";
+    case TelemetryCounter::RepaintedPixels: return "repainted px";
+    case TelemetryCounter::Count: break;
+    }
+    return "?";
+}
+
+// Timing names.
+const char *Telemetry::name(TelemetryTiming t)
+{
+    switch (t) {
+    case TelemetryTiming::Step: return "step time";
+    case TelemetryTiming::Frame: return "frame time";
+    case TelemetryTiming::Count: break;
+    }
+    return "?";
+}
+
+// Counts the step; the thread's step count picks the timed ones.
+TelemetryStepScope::TelemetryStepScope()
+    : m_block(nullptr)
+    , m_startNs(0)
+    , m_allocations(0)
+{
+    if (!Telemetry::enabled())
+        return;
+    Block &b = block();
+    m_block = &b;
+    std::atomic<std::uint64_t> &steps = b.counters[int(TelemetryCounter::Steps)];
+    const std::uint64_t step = steps.load(std::memory_order_relaxed);
+    steps.store(step + 1, std::memory_order_relaxed);
+    if (step % Telemetry::StepSampling == 0)
+        m_startNs = Telemetry::now();
+    m_allocations = t_allocations;
+}
+
+// Counts the allocations of the step, and records its duration if it was timed.
+TelemetryStepScope::~TelemetryStepScope()
+{
+    if (!m_block)
+        return;
+    Block &b = *m_block;
+    if (t_allocations != m_allocations)
+        bump(b.counters[int(TelemetryCounter::Allocations)], t_allocations - m_allocations);
+    if (m_startNs)
+        Telemetry::time(TelemetryTiming::Step, Telemetry::now() - m_startNs);
+}
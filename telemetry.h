@@ -0,0 +1,136 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <cstdint>     // Counters and nanosecond durations
+#include <string>      // Text report
+#include <vector>      // Histogram buckets
+
+struct TelemetryBlock;
+
+// Events counted on the hot paths.
+enum class TelemetryCounter
+{
+    Steps,          // Simulation steps, all simulations together
+    Spawns,         // Cars that entered a lane from outside (arrivals, not hand-offs)
+    Despawns,       // Cars that left the road
+    Allocations,    // Heap allocations made during simulation steps
+    Frames,         // Frames rendered
+    RepaintedPixels, // Viewport pixels repainted by those frames
+    Count
+};
+
+// Durations measured on the hot paths.
+enum class TelemetryTiming
+{
+    Step,           // One Simulation::step()
+    Frame,          // Rendering one frame of the scene
+    Count
+};
+
+// Histogram of durations in nanoseconds. Buckets are logarithmic, four per power of two, so any
+// duration from 1 ns to hours is kept to within 25% in 256 buckets.
+class DurationHistogram
+{
+public:
+    static constexpr int BucketCount = 256;
+
+    DurationHistogram();
+
+    // Bucket holding `ns`, and the smallest duration of a bucket.
+    static int bucketOf(std::uint64_t ns);
+    static std::uint64_t bucketStart(int bucket);
+
+    // Records `count` samples of bucket `bucket` summing to `sumNs`, the largest being `maxNs`.
+    void add(int bucket, std::uint64_t count, std::uint64_t sumNs, std::uint64_t maxNs);
+
+    // Number of durations recorded, their mean and their maximum, in nanoseconds.
+    std::uint64_t count() const;
+    double mean() const;
+    std::uint64_t max() const;
+
+    // Duration below which a fraction `p` (0..1) of the samples lie, to bucket precision.
+    double percentile(double p) const;
+
+    // Adds the samples of another histogram to this one.
+    void merge(const DurationHistogram &other);
+
+private:
+    std::vector<std::uint64_t> m_buckets;
+    std::uint64_t m_count;
+    std::uint64_t m_sum;
+    std::uint64_t m_max;
+};
+
+// Counters and duration histograms of the whole process at one instant.
+struct TelemetryTotals
+{
+    std::uint64_t counters[int(TelemetryCounter::Count)];
+    DurationHistogram timings[int(TelemetryTiming::Count)];
+
+    TelemetryTotals();
+
+    std::uint64_t counter(TelemetryCounter c) const;
+    const DurationHistogram &timing(TelemetryTiming t) const;
+};
+
+// Low-overhead instrumentation of the simulation and the renderer, off until setEnabled(true).
+//
+// Every thread accumulates into its own block of relaxed atomics, which only that thread writes:
+// recording is a plain load and store, without locks or contended cache lines, and a reader sums
+// the blocks at any time. A block is registered under a lock once, the first time its thread
+// records, and folded into the process totals when the thread ends.
+//
+// Step durations are sampled on one step in StepSampling, which keeps the two clock reads well
+// below 1% of even the smallest layout's step time; counters count every event.
+class Telemetry
+{
+public:
+    // Simulation steps per timed step.
+    static constexpr int StepSampling = 64;
+
+    // Turns recording on or off for every thread. Off, recording costs one relaxed load.
+    static void setEnabled(bool enabled);
+    static bool enabled();
+
+    // Adds `n` to counter `c` of the calling thread.
+    static void count(TelemetryCounter c, std::uint64_t n = 1);
+
+    // Records a duration of `ns` nanoseconds for `t`.
+    static void time(TelemetryTiming t, std::uint64_t ns);
+
+    // Steady clock in nanoseconds, for the durations passed to time().
+    static std::uint64_t now();
+
+    // Heap allocations made by the calling thread so far (counted by the global operator new).
+    static std::uint64_t allocations();
+
+    // Sum over every thread, past and present.
+    static TelemetryTotals totals();
+
+    // Human-readable dump of totals(): one line per counter, one per timing.
+    static std::string report();
+
+    // Names used in reports and overlays.
+    static const char *name(TelemetryCounter c);
+    static const char *name(TelemetryTiming t);
+};
+
+// Times the scope it lives in as one sample of a step, every StepSampling-th step of the calling
+// thread, counts the step and the heap allocations made inside it. Does nothing while telemetry
+// is off.
+class TelemetryStepScope
+{
+public:
+    TelemetryStepScope();
+    ~TelemetryStepScope();
+
+    TelemetryStepScope(const TelemetryStepScope &) = delete;
+    TelemetryStepScope &operator=(const TelemetryStepScope &) = delete;
+
+private:
+    TelemetryBlock *m_block;            // Accumulators of the thread, nullptr while telemetry is off
+    std::uint64_t m_startNs;            // 0 if this step is not timed
+    std::uint64_t m_allocations;
+};
+
+#endif // TELEMETRY_H
@@ -0,0 +1,353 @@
+#include <algorithm>           // Sorted event lists
+#include <cmath>               // Quantised positions
+#include <cstdio>              // Failures on the console, the recording read back
+#include <cstring>             // Bitwise comparison of floats
+#include <utility>             // Pairs found by the grid
+#include <vector>              // Boxes and pairs
+#include "kinematics.h"        // Instruction sets of the car kernel
+#include "metrics.h"           // Summaries compared after a restore
+#include "recorder.h"          // Trajectory recording
+#include "simulation.h"        // Simulations run by the tests
+#include "spatialgrid.h"       // The spatial index
+#include "trajectory.h"        // Trajectory reading
+
+// Checks of the simulation core, without Qt. Every failed check is printed; the program exits
+// with 1 if any check failed.
+
+static int failures = 0;
+
+// Reports a failed check.
+static void check(bool ok, const char *test, const char *what)
+{
+    if (ok)
+        return;
+    std::printf("FAIL %s: %s\n", test, what);
+    ++failures;
+}
+
+// Pairs reported by overlappingPairs() over the rectangle.
+static std::vector<std::pair<int, int>> pairsIn(const SpatialGrid &grid, float x0, float y0, float x1, float y1)
+{
+    std::vector<std::pair<int, int>> pairs;
+    grid.overlappingPairs(x0, y0, x1, y1, [&](int i, int j) { pairs.emplace_back(i, j); });
+    return pairs;
+}
+
+// Two boxes overlapping across the edge of a zone are one pair in the zone, whichever cell holds
+// the corner of their whole overlap.
+static void testPairsStraddlingZoneEdge()
+{
+    const char *test = "pairs straddling a zone edge";
+    SpatialGrid grid(0, 0, 400, 400, 32);
+    const float minX[] = {100, 110}, minY[] = {0, 40}, maxX[] = {140, 150}, maxY[] = {200, 260};
+    const std::uint8_t state[] = {1, 1};
+    grid.build(minX, minY, maxX, maxY, state, 2);
+
+    check(pairsIn(grid, 0, 0, 400, 400).size() == 1, test, "one pair over the whole grid");
+    check(pairsIn(grid, 90, 95, 300, 300).size() == 1, test, "one pair in a zone below the overlap's corner");
+    check(pairsIn(grid, 120, 100, 300, 300).size() == 1, test, "one pair in a zone right of and below it");
+    check(pairsIn(grid, 0, 0, 105, 400).empty(), test, "no pair in a zone left of the overlap");
+    check(pairsIn(grid, 0, 210, 400, 400).empty(), test, "no pair in a zone below the overlap");
+}
+
+// Whether two values hold the same bits: floats compare exactly, and -0 differs from 0.
+template <typename T>
+static bool sameBits(const T &a, const T &b)
+{
+    return std::memcmp(&a, &b, sizeof(T)) == 0;
+}
+
+// Whether two pools hold the same cars in the same slots, with bit-identical positions and
+// speeds. Free slots keep whatever their last car left, and the accelerations are recomputed
+// at the start of every step (see sameAccelerations()), so neither is compared.
+static bool samePool(const VehiclePool &a, const VehiclePool &b)
+{
+    if (a.highWater() != b.highWater() || a.size() != b.size())
+        return false;
+    for (int i = 0; i < a.highWater(); ++i) {
+        if (a.state[i] != b.state[i])
+            return false;
+        if (a.state[i] == VehiclePool::Free)
+            continue;
+        if (a.id[i] != b.id[i] || a.lane[i] != b.lane[i] || a.leader[i] != b.leader[i]
+            || a.follower[i] != b.follower[i] || a.turn[i] != b.turn[i] || a.sprite[i] != b.sprite[i]
+            || !sameBits(a.x[i], b.x[i]) || !sameBits(a.y[i], b.y[i]) || !sameBits(a.s[i], b.s[i])
+            || !sameBits(a.v[i], b.v[i]) || !sameBits(a.age[i], b.age[i]))
+            return false;
+    }
+    return true;
+}
+
+// Whether the cars of two pools holding the same cars had bit-identical accelerations in the last step.
+static bool sameAccelerations(const VehiclePool &a, const VehiclePool &b)
+{
+    for (int i = 0; i < a.highWater(); ++i) {
+        if (a.state[i] != VehiclePool::Free && !sameBits(a.a[i], b.a[i]))
+            return false;
+    }
+    return true;
+}
+
+// The original crossing with arrivals about three times as frequent as it can serve, so queues
+// form and cars start, stop and follow each other on every lane.
+static void buildBusyCross(Simulation &sim)
+{
+    sim.loadDefaultCross();
+    for (int a = 0; a < int(sim.approaches().size()); ++a)
+        sim.setArrivalInterval(a, 400, 1200);
+}
+
+// The AVX2 kernel moves every car exactly as the scalar one does, step after step.
+static void testKinematicsIsasAgree()
+{
+    const char *test = "kinematics instruction sets agree";
+    if (!kinematicsIsaSupported(KinematicsIsa::Avx2)) {
+        std::printf("skip %s: no AVX2 on this CPU\n", test);
+        return;
+    }
+    Simulation scalar(11), avx2(11);
+    buildBusyCross(scalar);
+    buildBusyCross(avx2);
+    scalar.setKinematicsIsa(KinematicsIsa::Scalar);
+    avx2.setKinematicsIsa(KinematicsIsa::Avx2);
+    scalar.start();
+    avx2.start();
+    bool same = true;
+    for (int i = 0; i < 30000 && same; ++i) {  // Ten simulated minutes, compared at every step
+        scalar.step();
+        avx2.step();
+        same = samePool(scalar.vehicles(), avx2.vehicles()) && sameAccelerations(scalar.vehicles(), avx2.vehicles());
+    }
+    check(same, test, "same cars, accelerations, positions and speeds at every step");
+    check(scalar.spawnedCount() == avx2.spawnedCount() && scalar.despawnedCount() == avx2.despawnedCount(), test,
+          "same spawns and despawns");
+    check(scalar.vehicles().size() > 0, test, "cars on the road at the end");
+}
+
+// Whether two run summaries agree exactly, approach by approach.
+static bool sameSummary(const RunSummary &a, const RunSummary &b)
+{
+    if (a.spawned != b.spawned || a.despawned != b.despawned || a.dropped != b.dropped || a.conflicts != b.conflicts
+        || a.approaches.size() != b.approaches.size())
+        return false;
+    for (std::size_t i = 0; i <= a.approaches.size(); ++i) {
+        const ApproachSummary &x = i < a.approaches.size() ? a.approaches[i] : a.total;
+        const ApproachSummary &y = i < b.approaches.size() ? b.approaches[i] : b.total;
+        if (x.throughput != y.throughput || x.meanDelay != y.meanDelay || x.p95Delay != y.p95Delay
+            || x.maxDelay != y.maxDelay || x.maxQueue != y.maxQueue)
+            return false;
+    }
+    return true;
+}
+
+// A simulation restored from a saved state carries on exactly as the one that saved it: same
+// cars in the same slots, same random arrivals and turns, same measurements.
+static void testRestoreContinuesIdentically()
+{
+    const char *test = "restored state continues identically";
+    Simulation original(23);
+    buildBusyCross(original);
+    original.start();
+    for (int i = 0; i < 9000; ++i)  // Three simulated minutes: full queues, lights mid-cycle
+        original.step();
+    std::vector<std::uint8_t> state;
+    original.saveState(state);
+
+    Simulation restored(1);  // Another seed: the state brings its own random streams
+    buildBusyCross(restored);
+    std::string error;
+    check(restored.restoreState(state.data(), state.size(), &error), test, "state restores");
+    check(samePool(original.vehicles(), restored.vehicles()), test, "same pool right after the restore");
+
+    bool same = true;
+    for (int i = 0; i < 6000 && same; ++i) {
+        original.step();
+        restored.step();
+        same = samePool(original.vehicles(), restored.vehicles());
+    }
+    check(same, test, "same cars, positions and speeds at every later step");
+    check(original.timeMs() == restored.timeMs(), test, "same clock");
+    check(original.spawnedCount() == restored.spawnedCount() && original.despawnedCount() == restored.despawnedCount()
+              && original.droppedCount() == restored.droppedCount(),
+          test, "same spawn, despawn and drop counts");
+    check(sameSummary(summarize(original), summarize(restored)), test, "same metrics");
+
+    std::vector<std::uint8_t> originalEnd, restoredEnd;
+    original.saveState(originalEnd);
+    restored.saveState(restoredEnd);
+    check(originalEnd == restoredEnd, test, "same state at the end");
+}
+
+// What a test expects of one recorded frame.
+struct ExpectedFrame
+{
+    std::int64_t timeMs;
+    std::vector<TrajectoryCar> cars;                        // In slot order, positions quantised
+    std::vector<std::uint8_t> lightGreen;
+    std::vector<std::pair<int, std::uint32_t>> events;      // (kind, car id or light), sorted
+};
+
+// The frame `sim` is recorded as, with the spawn, despawn and light events since `previous`
+// (nullptr for the first frame, where every car is new and no light changed).
+static ExpectedFrame expectedFrame(const Simulation &sim, const ExpectedFrame *previous)
+{
+    const VehiclePool &pool = sim.vehicles();
+    const float scale = 1.0f / float(TrajectoryRecorder::Quantum);
+    ExpectedFrame frame;
+    frame.timeMs = sim.timeMs();
+    for (int i = 0; i < pool.highWater(); ++i) {
+        if (pool.state[i] == VehiclePool::Free)
+            continue;
+        TrajectoryCar car;
+        car.slot = i;
+        car.id = pool.id[i];
+        car.lane = pool.lane[i];
+        car.state = pool.state[i];
+        car.x = float(std::lround(pool.x[i] * TrajectoryRecorder::Quantum)) * scale;
+        car.y = float(std::lround(pool.y[i] * TrajectoryRecorder::Quantum)) * scale;
+        frame.cars.push_back(car);
+    }
+    for (const SimLight &light : sim.lights())
+        frame.lightGreen.push_back(light.green ? 1 : 0);
+
+    std::vector<std::uint32_t> ids, previousIds;
+    for (const TrajectoryCar &car : frame.cars)
+        ids.push_back(car.id);
+    if (previous) {
+        for (const TrajectoryCar &car : previous->cars)
+            previousIds.push_back(car.id);
+        for (std::size_t l = 0; l < frame.lightGreen.size(); ++l) {
+            if (frame.lightGreen[l] != previous->lightGreen[l])
+                frame.events.emplace_back(int(TrajectoryEventKind::LightChange), std::uint32_t(l));
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+    std::sort(previousIds.begin(), previousIds.end());
+    for (std::uint32_t id : ids) {
+        if (!std::binary_search(previousIds.begin(), previousIds.end(), id))
+            frame.events.emplace_back(int(TrajectoryEventKind::Spawn), id);
+    }
+    for (std::uint32_t id : previousIds) {
+        if (!std::binary_search(ids.begin(), ids.end(), id))
+            frame.events.emplace_back(int(TrajectoryEventKind::Despawn), id);
+    }
+    std::sort(frame.events.begin(), frame.events.end());
+    return frame;
+}
+
+// A recording reads back as recorded: frame times, every car with its id, lane and quantised
+// position, and the spawn, despawn and light events. Frames are taken every three steps and
+// placed so that a light changes on the first frame of the second chunk, a keyframe.
+static void testRecordingRoundTrip()
+{
+    const char *test = "recording round trip";
+    const int every = 3;
+    const int frames = 4 * TrajectoryRecorder::FramesPerChunk;
+
+    // Step at which a light changes, late enough to start recording a chunk of frames before it
+    Simulation probe(31);
+    buildBusyCross(probe);
+    probe.start();
+    std::vector<std::uint8_t> lights(probe.lights().size(), 0);
+    int changeStep = -1;
+    for (int i = 1; changeStep < 0 && i < 100000; ++i) {
+        probe.step();
+        for (std::size_t l = 0; l < lights.size(); ++l) {
+            const std::uint8_t green = probe.lights()[l].green ? 1 : 0;
+            if (green != lights[l] && i > every * TrajectoryRecorder::FramesPerChunk)
+                changeStep = i;
+            lights[l] = green;
+        }
+    }
+    check(changeStep > 0, test, "a light changes");
+    if (changeStep < 0)
+        return;
+
+    const char *path = "carros_tests.trj";
+    Simulation sim(31);
+    buildBusyCross(sim);
+    sim.start();
+    TrajectoryRecorder recorder;
+    std::vector<ExpectedFrame> expected;
+    const int firstStep = changeStep - every * TrajectoryRecorder::FramesPerChunk;
+    for (int i = 1; int(expected.size()) < frames; ++i) {
+        sim.step();
+        if (i < firstStep || (i - firstStep) % every != 0)
+            continue;
+        if (expected.empty() && !recorder.open(path, sim)) {
+            check(false, test, "recording opens");
+            return;
+        }
+        recorder.record(sim);
+        expected.push_back(expectedFrame(sim, expected.empty() ? nullptr : &expected.back()));
+    }
+    check(recorder.close(), test, "recording closes");
+
+    std::vector<std::uint8_t> data;
+    if (std::FILE *file = std::fopen(path, "rb")) {
+        std::uint8_t buffer[65536];
+        for (std::size_t n; (n = std::fread(buffer, 1, sizeof buffer, file)) > 0;)
+            data.insert(data.end(), buffer, buffer + n);
+        std::fclose(file);
+    }
+    std::remove(path);
+    TrajectoryReader reader(data.data(), data.size());
+    check(reader.isValid(), test, "recording reads");
+    check(int(reader.chunks().size()) == frames / TrajectoryRecorder::FramesPerChunk, test, "one chunk per 50 frames");
+
+    std::size_t next = 0;
+    bool times = true, cars = true, lightStates = true, events = true;
+    for (int c = 0; c < int(reader.chunks().size()); ++c) {
+        const bool read = reader.readChunk(c, [&](const TrajectoryFrame &frame) {
+            if (next >= expected.size()) {
+                ++next;
+                return;
+            }
+            const ExpectedFrame &want = expected[next++];
+            times = times && frame.timeMs == want.timeMs;
+            lightStates = lightStates && frame.lightGreen == want.lightGreen;
+            bool sameCars = frame.cars.size() == want.cars.size();
+            for (std::size_t k = 0; sameCars && k < frame.cars.size(); ++k) {
+                const TrajectoryCar &got = frame.cars[k], &car = want.cars[k];
+                sameCars = got.slot == car.slot && got.id == car.id && got.lane == car.lane
+                           && got.state == car.state && got.x == car.x && got.y == car.y;
+            }
+            cars = cars && sameCars;
+            std::vector<std::pair<int, std::uint32_t>> got;
+            for (const TrajectoryEvent &event : frame.events) {
+                if (event.kind == TrajectoryEventKind::Spawn || event.kind == TrajectoryEventKind::Despawn
+                    || event.kind == TrajectoryEventKind::LightChange)
+                    got.emplace_back(int(event.kind), event.id);
+            }
+            std::sort(got.begin(), got.end());
+            events = events && got == want.events;
+        });
+        check(read, test, "every chunk decodes");
+    }
+    check(next == expected.size(), test, "as many frames as recorded");
+    check(times, test, "same frame times");
+    check(cars, test, "same cars, lanes and quantised positions");
+    check(lightStates, test, "same light states");
+    check(events, test, "same spawn, despawn and light change events");
+
+    // The light change on the keyframe of the second chunk, whose light list is not a change list
+    const ExpectedFrame &keyframe = expected[std::size_t(TrajectoryRecorder::FramesPerChunk)];
+    check(std::any_of(keyframe.events.begin(), keyframe.events.end(),
+                      [](const std::pair<int, std::uint32_t> &e) { return e.first == int(TrajectoryEventKind::LightChange); }),
+          test, "a light change on a keyframe");
+}
+
+// Runs every test.
+int main()
+{
+    testPairsStraddlingZoneEdge();
+    testKinematicsIsasAgree();
+    testRestoreContinuesIdentically();
+    testRecordingRoundTrip();
+    if (failures > 0) {
+        std::printf("%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,309 @@
+#include "trajectory.h"   // Header file for the trajectory format and reader
+#include <algorithm>      // std::min, std::max
+#include <cstring>        // std::memcmp, std::memcpy
+
+// Bounds-checked little-endian decoding over a byte range.
+namespace {
+
+struct Input
+{
+    const std::uint8_t *at;
+    const std::uint8_t *end;
+    bool ok = true;
+
+    bool need(std::size_t bytes)
+    {
+        if (ok && std::size_t(end - at) < bytes)
+            ok = false;
+        return ok;
+    }
+
+    std::uint8_t u8()
+    {
+        return need(1) ? *at++ : 0;
+    }
+
+    std::uint32_t u32()
+    {
+        if (!need(4))
+            return 0;
+        std::uint32_t value = std::uint32_t(at[0]) | std::uint32_t(at[1]) << 8 | std::uint32_t(at[2]) << 16
+                              | std::uint32_t(at[3]) << 24;
+        at += 4;
+        return value;
+    }
+
+    std::int64_t i64()
+    {
+        std::uint64_t low = u32();
+        std::uint64_t high = u32();
+        return std::int64_t(low | high << 32);
+    }
+
+    float f32()
+    {
+        std::uint32_t bits = u32();
+        float value;
+        std::memcpy(&value, &bits, sizeof value);
+        return value;
+    }
+
+    // LEB128: seven bits per byte, lowest first, high bit set on every byte but the last.
+    std::uint64_t varint()
+    {
+        std::uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            std::uint8_t byte = u8();
+            if (!ok)
+                return 0;
+            value |= std::uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        ok = false;  // More than ten bytes: not a varint
+        return 0;
+    }
+
+    // Zigzag: 0, -1, 1, -2 ... are stored as 0, 1, 2, 3 ...
+    std::int64_t zigzag()
+    {
+        std::uint64_t value = varint();
+        return std::int64_t(value >> 1) ^ -std::int64_t(value & 1);
+    }
+};
+
+}  // namespace
+
+// Header and chunk table; payloads are left alone.
+TrajectoryReader::TrajectoryReader(const std::uint8_t *data, std::size_t size)
+    : m_data(data)
+    , m_size(size)
+    , m_tickMs(0)
+    , m_quantum(1)
+{
+    Input in{data, data + size};
+    if (!in.need(sizeof TrajectoryMagic) || std::memcmp(in.at, TrajectoryMagic, sizeof TrajectoryMagic) != 0) {
+        m_error = "not a trajectory file";
+        return;
+    }
+    in.at += sizeof TrajectoryMagic;
+    m_tickMs = int(in.u32());
+    m_quantum = int(in.u32());
+    const std::uint32_t laneCount = in.u32();
+    const std::uint32_t lightCount = in.u32();
+    if (!in.ok || m_quantum <= 0 || !in.need(std::size_t(laneCount) * 45 + std::size_t(lightCount) * 12)) {
+        m_error = "truncated header";
+        return;
+    }
+    m_lanes.resize(laneCount);
+    for (std::uint32_t l = 0; l < laneCount; ++l) {
+        TrajectoryLane &lane = m_lanes[l];
+        lane.x0 = in.f32();
+        lane.y0 = in.f32();
+        lane.x1 = in.f32();
+        lane.y1 = in.f32();
+        lane.carLength = in.f32();
+        lane.scale = in.f32();
+        lane.rotation = in.f32();
+        lane.bodyX = in.f32();
+        lane.bodyY = in.f32();
+        lane.bodyW = in.f32();
+        lane.bodyH = in.f32();
+        lane.sprite = in.u8();
+        if (lane.sprite > 3) {  // The four car images of SimLane::sprite
+            m_error = "bad sprite id of lane " + std::to_string(l);
+            return;
+        }
+    }
+    m_lights.resize(lightCount);
+    for (TrajectoryLight &light : m_lights) {
+        light.x = in.f32();
+        light.y = in.f32();
+        light.rotation = in.f32();
+    }
+
+    // Chunk headers; an incomplete last chunk is what a run stopped mid-write leaves behind
+    while (std::size_t(in.end - in.at) >= 28) {
+        if (in.u32() != TrajectoryChunkMagic) {
+            m_error = "bad chunk header at offset " + std::to_string(std::size_t(in.at - data) - 4);
+            return;
+        }
+        TrajectoryChunk chunk;
+        chunk.size = in.u32();
+        chunk.firstMs = in.i64();
+        chunk.lastMs = in.i64();
+        chunk.frames = in.u32();
+        chunk.offset = std::size_t(in.at - data);
+        if (std::size_t(in.end - in.at) < chunk.size)
+            break;
+        in.at += chunk.size;
+        m_chunks.push_back(chunk);
+    }
+}
+
+// Valid while no error was found.
+bool TrajectoryReader::isValid() const
+{
+    return m_error.empty();
+}
+
+// Why the file could not be read.
+const std::string &TrajectoryReader::error() const
+{
+    return m_error;
+}
+
+// Step of the recorded simulation.
+int TrajectoryReader::tickMs() const
+{
+    return m_tickMs;
+}
+
+// Position units per scene unit.
+int TrajectoryReader::quantum() const
+{
+    return m_quantum;
+}
+
+// Lane table of the header.
+const std::vector<TrajectoryLane> &TrajectoryReader::lanes() const
+{
+    return m_lanes;
+}
+
+// Light table of the header.
+const std::vector<TrajectoryLight> &TrajectoryReader::lights() const
+{
+    return m_lights;
+}
+
+// Complete chunks.
+const std::vector<TrajectoryChunk> &TrajectoryReader::chunks() const
+{
+    return m_chunks;
+}
+
+// First frame of the first chunk.
+std::int64_t TrajectoryReader::startMs() const
+{
+    return m_chunks.empty() ? 0 : m_chunks.front().firstMs;
+}
+
+// Last frame of the last chunk.
+std::int64_t TrajectoryReader::endMs() const
+{
+    return m_chunks.empty() ? 0 : m_chunks.back().lastMs;
+}
+
+// Interpolation search: a first guess from the mean chunk duration, then a walk to the right chunk.
+int TrajectoryReader::chunkAt(std::int64_t timeMs) const
+{
+    const int count = int(m_chunks.size());
+    if (count <= 1 || timeMs <= m_chunks.front().firstMs)
+        return 0;
+    if (timeMs >= m_chunks.back().firstMs)
+        return count - 1;
+
+    const double span = double(m_chunks.back().firstMs - m_chunks.front().firstMs);
+    int c = int(double(timeMs - m_chunks.front().firstMs) / span * (count - 1));
+    c = std::max(0, std::min(count - 1, c));
+    while (c > 0 && m_chunks[c].firstMs > timeMs)
+        --c;
+    while (c + 1 < count && m_chunks[c + 1].firstMs <= timeMs)
+        ++c;
+    return c;
+}
+
+// Replays the deltas of one chunk onto per-slot tables, starting from its keyframe.
+bool TrajectoryReader::readChunk(int c, const std::function<void(const TrajectoryFrame &)> &visit,
+                                 std::uint32_t maxFrames)
+{
+    const TrajectoryChunk &chunk = m_chunks[c];
+    Input in{m_data + chunk.offset, m_data + chunk.offset + chunk.size};
+    const float scale = 1.0f / float(m_quantum);
+
+    TrajectoryFrame frame;
+    frame.timeMs = chunk.firstMs;
+    frame.lightGreen.assign(m_lights.size(), 0);
+    const std::uint32_t frames = std::min(chunk.frames, maxFrames);
+    for (std::uint32_t f = 0; f < frames && in.ok; ++f) {
+        frame.timeMs += std::int64_t(in.varint());
+        frame.events.clear();
+
+        const std::uint64_t lightChanges = in.varint();
+        for (std::uint64_t i = 0; i < lightChanges && in.ok; ++i) {
+            const std::uint64_t entry = in.varint();
+            const std::uint64_t light = entry >> 1;
+            if (light >= frame.lightGreen.size()) {
+                in.ok = false;
+                break;
+            }
+            frame.lightGreen[light] = std::uint8_t(entry & 1);
+            if (f > 0)  // The keyframe restates every light; its changes come as events
+                frame.events.push_back(TrajectoryEvent{frame.timeMs, TrajectoryEventKind::LightChange,
+                                                       std::uint32_t(light), std::int32_t(entry & 1)});
+        }
+
+        const std::uint64_t eventCount = in.varint();
+        for (std::uint64_t i = 0; i < eventCount && in.ok; ++i) {
+            TrajectoryEvent event;
+            event.timeMs = frame.timeMs;
+            event.kind = TrajectoryEventKind(in.u8());
+            event.id = std::uint32_t(in.varint());
+            event.lane = std::int32_t(in.varint());
+            frame.events.push_back(event);
+        }
+
+        const std::uint64_t carCount = in.varint();
+        if (carCount > chunk.size)  // At least one byte per car
+            in.ok = false;
+        if (!in.ok)
+            break;
+        frame.cars.resize(std::size_t(carCount));
+        std::int64_t slot = -1;
+        for (TrajectoryCar &car : frame.cars) {
+            slot += std::int64_t(in.varint()) + 1;
+            const std::uint8_t flags = in.u8();
+            if (slot > std::int64_t(chunk.size) * 8)
+                in.ok = false;
+            if (!in.ok)
+                break;
+            if (slot >= std::int64_t(m_slotId.size())) {
+                const std::size_t size = std::size_t(slot) + 1;
+                m_slotId.resize(size);
+                m_slotLane.resize(size);
+                m_slotX.resize(size);
+                m_slotY.resize(size);
+            }
+            if (flags & 1) {
+                m_slotId[slot] = std::uint32_t(in.varint());
+                const std::uint64_t lane = in.varint();
+                m_slotLane[slot] = lane < m_lanes.size() ? std::int32_t(lane) : -1;
+                m_slotX[slot] = std::int32_t(in.zigzag());
+                m_slotY[slot] = std::int32_t(in.zigzag());
+            } else {
+                m_slotX[slot] += std::int32_t(in.zigzag());
+                m_slotY[slot] += std::int32_t(in.zigzag());
+            }
+            // Viewers index their lane tables with it, so a car must be on a lane of the header
+            if (m_slotLane[slot] < 0 || std::size_t(m_slotLane[slot]) >= m_lanes.size()) {
+                in.ok = false;
+                break;
+            }
+            car.slot = std::int32_t(slot);
+            car.id = m_slotId[slot];
+            car.lane = m_slotLane[slot];
+            car.state = std::uint8_t((flags >> 1) & 3);
+            car.x = float(m_slotX[slot]) * scale;
+            car.y = float(m_slotY[slot]) * scale;
+        }
+        if (in.ok)
+            visit(frame);
+    }
+
+    if (!in.ok) {
+        m_error = "corrupt chunk " + std::to_string(c);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,160 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <cstddef>      // Buffer sizes
+#include <cstdint>      // Fixed-width fields of the file format
+#include <functional>   // Frame visitor
+#include <string>       // Error messages
+#include <vector>       // Tables and frames
+
+// Binary trajectory files, as written by TrajectoryRecorder.
+//
+// All integers are little-endian; floats are IEEE 754 single precision.
+//
+//   header  "CARTRJ01", u32 tickMs, u32 quantum, u32 laneCount, u32 lightCount,
+//           then per lane  f32 x0 y0 x1 y1 carLength scale rotation bodyX bodyY bodyW bodyH, u8 sprite
+//           and per light  f32 x y rotation
+//   chunks  u32 "CHNK", u32 payload bytes, i64 first frame time, i64 last frame time, u32 frame count,
+//           then the payload: frame after frame
+//
+// A frame is a varint time step (ms since the previous frame of the chunk, 0 for the first), the
+// lights that changed, the events since the previous frame and the cars:
+//
+//   lights  varint count, then per light varint (index << 1 | green)
+//   events  varint count, then per event u8 kind, varint car id, varint lane
+//   cars    varint count, then per car, in slot order, varint slot gap (slot - previous slot - 1)
+//           and u8 flags (bit 0: new in this chunk or on a new lane, bits 1-2: VehiclePool::State),
+//           followed for such a car by varint id, varint lane, zigzag x, zigzag y, and otherwise
+//           by zigzag dx, dy
+//
+// Positions are stored in units of 1/quantum scene units, so deltas are exact integers and never
+// drift. The first frame of every chunk lists all lights and every car as new: each chunk decodes
+// on its own, which is what lets a reader start anywhere in a long recording. Since its light
+// list is not a list of changes, the lights that did change at such a frame are also written as
+// LightChange events.
+
+// Magic numbers of the header and of each chunk.
+constexpr char TrajectoryMagic[8] = {'C', 'A', 'R', 'T', 'R', 'J', '0', '1'};
+constexpr std::uint32_t TrajectoryChunkMagic = 0x4b4e4843;  // "CHNK"
+
+// Lane as stored in the header: enough to draw the cars of a recording without its layout.
+struct TrajectoryLane
+{
+    float x0, y0, x1, y1;       // Start and end of the lane
+    float carLength;            // Length of a car along the lane
+    float scale, rotation;      // Sprite transform
+    float bodyX, bodyY, bodyW, bodyH;  // Box covered by a car, relative to its position
+    std::uint8_t sprite;        // Sprite id
+};
+
+// Light as stored in the header.
+struct TrajectoryLight
+{
+    float x, y;                 // Scene position
+    float rotation;             // Sprite rotation
+};
+
+// What happened between two frames.
+enum class TrajectoryEventKind : std::uint8_t
+{
+    Spawn = 0,      // A car entered the road
+    Stop = 1,       // A car came to a standstill (joined a queue)
+    Cross = 2,      // A car passed the stop line of its lane
+    Despawn = 3,    // A car left its lane (the road, or on to a linked lane)
+    LightChange = 4,// A light changed; `id` is the light index and `lane` is 1 for green, 0 for red
+    Turn = 5        // A car turned; `lane` is the lane it turned onto
+};
+
+// One event, stamped with the time of the frame that reports it.
+struct TrajectoryEvent
+{
+    std::int64_t timeMs;
+    TrajectoryEventKind kind;
+    std::uint32_t id;           // Car id (light index for LightChange)
+    std::int32_t lane;          // Lane of the car (new light state for LightChange)
+};
+
+// One car of a frame.
+struct TrajectoryCar
+{
+    std::int32_t slot;          // Pool slot of the car while it was recorded; frames list cars by slot
+    std::uint32_t id;
+    std::int32_t lane;
+    std::uint8_t state;         // VehiclePool::State
+    float x, y;                 // Position of the sprite origin
+};
+
+// A decoded frame.
+struct TrajectoryFrame
+{
+    std::int64_t timeMs;
+    std::vector<TrajectoryCar> cars;
+    std::vector<std::uint8_t> lightGreen;       // Per light: 1 = green
+    std::vector<TrajectoryEvent> events;        // Events since the previous frame, lights included
+};
+
+// Where a chunk lies in the file and what it covers.
+struct TrajectoryChunk
+{
+    std::size_t offset;         // Offset of the payload
+    std::size_t size;           // Payload bytes
+    std::int64_t firstMs;       // Time of its first frame (a keyframe)
+    std::int64_t lastMs;        // Time of its last frame
+    std::uint32_t frames;       // Frame count
+};
+
+// Reads a trajectory file from memory, e.g. a memory-mapped file. The constructor only reads the
+// header and hops from chunk header to chunk header; frames are decoded on demand, chunk by chunk.
+class TrajectoryReader
+{
+public:
+    // Constructor: the `size` bytes at `data` must stay valid while the reader is used.
+    TrajectoryReader(const std::uint8_t *data, std::size_t size);
+
+    // False if the header or a chunk header is malformed, or a lane has no valid sprite id;
+    // error() says why. A recording cut short
+    // (e.g. a crashed run) is still valid up to its last complete chunk.
+    bool isValid() const;
+    const std::string &error() const;
+
+    // Header fields.
+    int tickMs() const;
+    int quantum() const;
+    const std::vector<TrajectoryLane> &lanes() const;
+    const std::vector<TrajectoryLight> &lights() const;
+
+    // Chunks in time order. Each starts with a keyframe, so this is also the keyframe index.
+    const std::vector<TrajectoryChunk> &chunks() const;
+
+    // Time of the first and the last frame, 0 without chunks.
+    std::int64_t startMs() const;
+    std::int64_t endMs() const;
+
+    // Chunk holding time `timeMs`: the last one starting at or before it (the first one for
+    // earlier times). Recorders start chunks at regular intervals, so the index is computed from
+    // the time and only corrected by a step or two, whatever the length of the recording.
+    int chunkAt(std::int64_t timeMs) const;
+
+    // Decodes up to `maxFrames` frames of chunk `c`, calling `visit` once per frame with the
+    // frame's full state. Returns false (and sets error()) if the payload is corrupt, e.g.
+    // lists a car on a lane missing from the lane table.
+    bool readChunk(int c, const std::function<void(const TrajectoryFrame &)> &visit,
+                   std::uint32_t maxFrames = 0xffffffffu);
+
+private:
+    const std::uint8_t *m_data;             // The whole file
+    std::size_t m_size;
+    std::string m_error;                    // Empty while valid
+    int m_tickMs;
+    int m_quantum;
+    std::vector<TrajectoryLane> m_lanes;
+    std::vector<TrajectoryLight> m_lights;
+    std::vector<TrajectoryChunk> m_chunks;
+
+    // Per-slot state of the chunk being decoded
+    std::vector<std::uint32_t> m_slotId;
+    std::vector<std::int32_t> m_slotLane;
+    std::vector<std::int32_t> m_slotX, m_slotY;
+};
+
+#endif // TRAJECTORY_H
@@ -0,0 +1,326 @@
+#include "vehiclelayer.h"   // Header file for the VehicleLayer class
+#include "spritecache.h"    // Pre-transformed car images
+#include <QGraphicsScene>   // Repaints of the changed tiles
+#include <QImage>           // Offscreen image the atlas is packed into
+#include <QStyleOptionGraphicsItem>  // Exposed rectangle and level of detail of a paint
+#include <algorithm>        // std::fill
+#include <cmath>            // std::ceil
+#include <cstring>          // std::memcpy
+
+// Car images indexed by sprite id.
+static const char *const carImages[] = {
+    ":/imagens/carro.png",
+    ":/imagens/carro2.png",
+    ":/imagens/carro3.png",
+    ":/imagens/carro4.png"
+};
+
+// Scrambles the bits of `h` (the splitmix64 finaliser), so that sums of hashes tell sets apart.
+static quint64 mixHash(quint64 h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Constructor: the layer sits below the traffic lights (z 3) and above the background.
+VehicleLayer::VehicleLayer(const Simulation &layout, QGraphicsItem *parent)
+    : QGraphicsItem{parent}
+    , lanes(layout.lanes())
+    , minGap(layout.carFollowing().minGap)
+    , snapshot(nullptr)
+    , alpha(1)
+    , paintedDetail(0)
+    , hashedDetail(0)
+    , tileSize(1)
+    , tileColumns(0)
+    , tileRows(0)
+{
+    setZValue(2);
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);  // Gives paint() the exposed rectangle
+    rebuild();
+}
+
+// Takes one pre-transformed image per distinct (sprite, scale, rotation) used by the lanes
+// from the sprite cache and packs them side by side into the atlas.
+// Also computes the area the cars can be drawn in.
+void VehicleLayer::rebuild()
+{
+    prepareGeometryChange();  // The bounding rect is about to change
+    sprites.clear();
+    laneSprite.clear();
+    laneBounds.clear();
+    bounds = QRectF();
+
+    QVector<QPixmap> images;
+    for (const SimLane &lane : lanes) {
+        // Reuse the image of another lane drawn the same way (there are only a few directions)
+        int index = -1;
+        for (int i = 0; i < sprites.size(); ++i) {
+            if (sprites[i].sprite == lane.sprite && sprites[i].scale == lane.scale
+                && sprites[i].rotation == lane.rotation) {
+                index = i;
+                break;
+            }
+        }
+
+        if (index < 0) {
+            CachedSprite cached = SpriteCache::instance().transformed(carImages[lane.sprite], lane.scale, lane.rotation);
+
+            Sprite sprite;
+            sprite.offset = cached.offset;
+            sprite.sprite = lane.sprite;
+            sprite.scale = lane.scale;
+            sprite.rotation = lane.rotation;
+            sprites.append(sprite);
+            images.append(cached.pixmap);
+            index = sprites.size() - 1;
+        }
+        laneSprite.append(index);
+
+        // The car is drawn from the start to the end of the lane
+        const Sprite &sprite = sprites[index];
+        QRectF extent(sprite.offset, images[index].size());
+        QRectF laneArea = extent.translated(lane.x0, lane.y0) | extent.translated(lane.x1, lane.y1);
+        laneBounds.append(laneArea);
+        bounds |= laneArea;
+    }
+
+    // Pack the images in a row, one pixel apart so smooth sampling never bleeds between them
+    int width = 0, height = 0;
+    for (const QPixmap &image : images) {
+        width += image.width() + 1;
+        height = qMax(height, image.height());
+    }
+    QImage packed(qMax(width, 1), qMax(height, 1), QImage::Format_ARGB32_Premultiplied);
+    packed.fill(Qt::transparent);
+    QPainter painter(&packed);
+    int x = 0;
+    for (int i = 0; i < images.size(); ++i) {
+        painter.drawPixmap(x, 0, images[i]);
+        sprites[i].source = QRectF(x, 0, images[i].width(), images[i].height());
+        x += images[i].width() + 1;
+    }
+    painter.end();
+    atlas = QPixmap::fromImage(packed);
+
+    // Change tracking starts over on the new bounds
+    tileSize = qMax(qreal(1), qMax(bounds.width(), bounds.height()) / TileCount);
+    tileColumns = qMax(1, int(std::ceil(bounds.width() / tileSize)));
+    tileRows = qMax(1, int(std::ceil(bounds.height() / tileSize)));
+    tileHash.assign(std::size_t(tileColumns) * std::size_t(tileRows), 0);
+    nextTileHash.assign(tileHash.size(), 0);
+    laneColour.assign(lanes.size(), 0);
+    hashedDetail = 0;
+}
+
+// Keeps the snapshot for the next paint and repaints what it changes.
+void VehicleLayer::setSnapshot(const SimSnapshot *newSnapshot, float newAlpha)
+{
+    snapshot = newSnapshot;
+    alpha = newAlpha;
+    updateChanged();
+}
+
+// Hashes what the next paint will draw, at the level of detail of the last one, and repaints
+// the difference through the scene: QGraphicsItem::update() would merge every changed rectangle
+// into their bounding rectangle, where the scene hands the views a region. A view that zooms
+// repaints itself whole anyway, so a new level of detail simply repaints the layer.
+void VehicleLayer::updateChanged()
+{
+    QGraphicsScene *owner = scene();
+    if (!owner || owner->views().isEmpty())
+        return;  // Only render() draws the layer, whenever it is called
+    const qreal detail = paintedDetail;
+    if (!snapshot || detail <= 0) {
+        hashedDetail = 0;
+        update();
+        return;
+    }
+    const bool known = hashedDetail == detail;
+    hashedDetail = detail;
+
+    // Density bars: the lanes whose colour changed, grown by the cosmetic pen
+    if (detail < DotDetail) {
+        const qreal margin = 2 / detail;
+        for (int l = 0; l < int(lanes.size()); ++l) {
+            const QRgb colour = densityColour(l).rgb();
+            if (colour != laneColour[std::size_t(l)] && known)
+                owner->update(mapRectToScene(laneBounds[l].adjusted(-margin, -margin, margin, margin)));
+            laneColour[std::size_t(l)] = colour;
+        }
+        if (!known)
+            update();
+        return;
+    }
+
+    if (snapshot->count() > TrackedCars) {
+        hashedDetail = 0;
+        update();
+        return;
+    }
+
+    // Cars: the sprite, or the dot, of every car adds its hash to the tiles it covers. Edges are
+    // grown by a screen pixel for smooth sampling and antialiasing
+    const bool drawSprites = detail >= SpriteDetail;
+    const qreal pixel = 1 / detail;
+    const qreal dotRadius = 3 / detail;  // The 4-pixel dots, and a pixel
+    std::fill(nextTileHash.begin(), nextTileHash.end(), 0);
+    for (int i = 0; i < snapshot->count(); ++i) {
+        const QPointF at = position(i);
+        QRectF box;
+        quint64 kind;
+        if (drawSprites) {
+            const int s = laneSprite[snapshot->lane[i]];
+            box = QRectF(at + sprites[s].offset, sprites[s].source.size()).adjusted(-pixel, -pixel, pixel, pixel);
+            kind = quint64(s);
+        } else {
+            const SimLane &lane = lanes[snapshot->lane[i]];
+            const QPointF centre = at + QPointF(lane.bodyX + lane.bodyW / 2, lane.bodyY + lane.bodyH / 2);
+            box = QRectF(centre.x() - dotRadius, centre.y() - dotRadius, 2 * dotRadius, 2 * dotRadius);
+            kind = snapshot->state[i] == VehiclePool::Stopped ? 1 : 0;
+        }
+        const float x = float(at.x()), y = float(at.y());
+        quint32 xBits, yBits;
+        std::memcpy(&xBits, &x, sizeof xBits);
+        std::memcpy(&yBits, &y, sizeof yBits);
+        const quint64 hash = mixHash((quint64(xBits) << 32 | yBits) ^ mixHash(kind + 1));
+
+        const int c0 = qBound(0, int((box.left() - bounds.left()) / tileSize), tileColumns - 1);
+        const int c1 = qBound(0, int((box.right() - bounds.left()) / tileSize), tileColumns - 1);
+        const int r0 = qBound(0, int((box.top() - bounds.top()) / tileSize), tileRows - 1);
+        const int r1 = qBound(0, int((box.bottom() - bounds.top()) / tileSize), tileRows - 1);
+        for (int r = r0; r <= r1; ++r) {
+            for (int c = c0; c <= c1; ++c)
+                nextTileHash[std::size_t(r) * std::size_t(tileColumns) + std::size_t(c)] += hash;
+        }
+    }
+
+    // One rectangle per run of changed tiles along a row
+    if (known) {
+        for (int r = 0; r < tileRows; ++r) {
+            const std::size_t row = std::size_t(r) * std::size_t(tileColumns);
+            for (int c = 0; c < tileColumns;) {
+                if (nextTileHash[row + std::size_t(c)] == tileHash[row + std::size_t(c)]) {
+                    ++c;
+                    continue;
+                }
+                const int start = c;
+                while (c < tileColumns && nextTileHash[row + std::size_t(c)] != tileHash[row + std::size_t(c)])
+                    ++c;
+                owner->update(mapRectToScene(QRectF(bounds.left() + start * tileSize, bounds.top() + r * tileSize,
+                                                    (c - start) * tileSize, tileSize)));
+            }
+        }
+    } else {
+        update();
+    }
+    tileHash.swap(nextTileHash);
+}
+
+// Linear interpolation over the last simulated step.
+QPointF VehicleLayer::position(int i) const
+{
+    return QPointF(snapshot->prevX[i] + (snapshot->x[i] - snapshot->prevX[i]) * alpha,
+                   snapshot->prevY[i] + (snapshot->y[i] - snapshot->prevY[i]) * alpha);
+}
+
+// Area covered by every lane.
+QRectF VehicleLayer::boundingRect() const
+{
+    return bounds;
+}
+
+// Picks the level of detail from the painter's scale and draws only the exposed part.
+void VehicleLayer::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    Q_UNUSED(widget);
+    if (!snapshot)
+        return;
+
+    const QRectF exposed = option->exposedRect;
+    const qreal detail = QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform());
+    paintedDetail = detail;
+    if (detail >= SpriteDetail)
+        paintSprites(painter, exposed);
+    else if (detail >= DotDetail)
+        paintDots(painter, exposed);
+    else
+        paintDensity(painter, exposed);
+}
+
+// Collects one fragment per visible car and draws them all with a single call.
+// Car boxes and sprites differ slightly, and the boxes are those of the current step, so the
+// query rectangle is grown by the largest sprite.
+void VehicleLayer::paintSprites(QPainter *painter, const QRectF &exposed)
+{
+    qreal margin = 0;
+    for (const Sprite &sprite : sprites)
+        margin = qMax(margin, qMax(sprite.source.width(), sprite.source.height()));
+    const QRectF area = exposed.adjusted(-margin, -margin, margin, margin);
+
+    fragments.clear();  // Keeps the capacity reached in earlier frames
+    snapshot->grid.queryUnique(float(area.left()), float(area.top()), float(area.right()), float(area.bottom()),
+                               [&](int i) {
+        const Sprite &sprite = sprites[laneSprite[snapshot->lane[i]]];
+        // Fragments are positioned by their centre
+        const QPointF at = position(i);
+        qreal cx = at.x() + sprite.offset.x() + sprite.source.width() / 2;
+        qreal cy = at.y() + sprite.offset.y() + sprite.source.height() / 2;
+        fragments.append(QPainter::PixmapFragment::create(QPointF(cx, cy), sprite.source));
+    });
+
+    if (!fragments.isEmpty())
+        painter->drawPixmapFragments(fragments.constData(), fragments.size(), atlas);
+}
+
+// One cosmetic point per visible car, green while driving and red while queued.
+void VehicleLayer::paintDots(QPainter *painter, const QRectF &exposed)
+{
+    driving.clear();
+    stopped.clear();
+    snapshot->grid.queryUnique(float(exposed.left()), float(exposed.top()), float(exposed.right()),
+                               float(exposed.bottom()), [&](int i) {
+        const SimLane &lane = lanes[snapshot->lane[i]];
+        QPointF centre = position(i) + QPointF(lane.bodyX + lane.bodyW / 2, lane.bodyY + lane.bodyH / 2);
+        (snapshot->state[i] == VehiclePool::Stopped ? stopped : driving).append(centre);
+    });
+
+    QPen pen(QColor(40, 200, 60), 4);
+    pen.setCosmetic(true);  // Four screen pixels whatever the zoom
+    pen.setCapStyle(Qt::RoundCap);
+    painter->setPen(pen);
+    painter->drawPoints(driving.constData(), driving.size());
+    pen.setColor(QColor(220, 40, 40));
+    painter->setPen(pen);
+    painter->drawPoints(stopped.constData(), stopped.size());
+}
+
+// One line per visible lane, from green (empty) to red (bumper to bumper). Lane loads come
+// with the snapshot, so this costs one step per lane whatever the number of cars.
+void VehicleLayer::paintDensity(QPainter *painter, const QRectF &exposed)
+{
+    QPen pen;
+    pen.setCosmetic(true);
+    pen.setWidth(3);
+    for (int l = 0; l < int(lanes.size()); ++l) {
+        if (!laneBounds[l].intersects(exposed))
+            continue;
+        const SimLane &lane = lanes[l];
+        pen.setColor(densityColour(l));
+        painter->setPen(pen);
+        painter->drawLine(QPointF(lane.x0, lane.y0), QPointF(lane.x1, lane.y1));
+    }
+}
+
+// Hue 120 (green) for an empty lane down to 0 (red) for a lane bumper to bumper.
+QColor VehicleLayer::densityColour(int l) const
+{
+    const SimLane &lane = lanes[l];
+    const qreal capacity = qMax(1.0, lane.length / (lane.carLength + minGap));
+    const qreal density = qMin(1.0, snapshot->laneLoad[l] / capacity);
+    return QColor::fromHsvF((1 - density) / 3, 0.9, 0.9);
+}
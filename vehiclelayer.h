@@ -0,0 +1,106 @@
+#ifndef VEHICLELAYER_H
+#define VEHICLELAYER_H
+
+// Including necessary Qt classes
+#include <QGraphicsItem>    // Base class for items drawn in a QGraphicsScene
+#include <QPainter>         // QPainter::PixmapFragment, used to draw every car in one call
+#include <QPixmap>          // The sprite atlas
+#include <QVector>          // Per-lane sprites and the reused fragment buffer
+#include <vector>           // Tile hashes
+#include "simulation.h"     // Lane geometry
+#include "simsnapshot.h"    // Source of the car positions
+
+// VehicleLayer draws every car of a simulation snapshot in a single paint pass.
+// Instead of one QGraphicsPixmapItem per car (each with its own transform, bounding rect and
+// index entry), the scene holds this one item. The car images are rotated and scaled once,
+// for each way a lane draws them, into a single atlas pixmap; painting then issues one
+// drawPixmapFragments() call with one untransformed fragment per car.
+//
+// Cars are drawn between their positions of the snapshot's last two steps, so motion stays
+// smooth whatever the ratio between display and simulation rates.
+//
+// Only the cars inside the exposed rectangle are drawn; they are found through the
+// snapshot's spatial grid, so the cost follows what is on screen rather than the number
+// of cars. When zoomed out the sprites give way to coloured dots, and further out to one
+// bar per lane coloured by how full the lane is.
+//
+// A new snapshot repaints only what changed: the layer is cut into coarse tiles, each holding
+// an order-independent hash of what was drawn in it (every car's image and pixel position, at
+// the level of detail of the last paint), and only the tiles whose hash differs from the last
+// frame are repainted, so parked queues and empty roads cost nothing. Large snapshots, where
+// hashing would cost more than it saves, repaint the whole layer.
+class VehicleLayer : public QGraphicsItem
+{
+public:
+    // Constructor: copies the lanes of `layout` and builds the atlas and bounds for them.
+    explicit VehicleLayer(const Simulation &layout, QGraphicsItem *parent = nullptr);
+
+    // Rebuilds the atlas and bounds from the copied lanes.
+    void rebuild();
+
+    // Snapshot to draw, which must stay valid until the next call, and the interpolation factor
+    // between its previous (0) and current (1) positions. Schedules the repaint of what changed.
+    void setSnapshot(const SimSnapshot *snapshot, float alpha);
+
+    // Area covering every lane, including the sprites drawn at both ends.
+    QRectF boundingRect() const override;
+
+    // Draws the cars inside the exposed rectangle, at the level of detail of the view's zoom.
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+
+    // Scale (screen pixels per scene unit) below which cars are dots, and below which lanes are bars.
+    static constexpr qreal SpriteDetail = 0.3;
+    static constexpr qreal DotDetail = 0.06;
+
+    // Largest snapshot whose changes are tracked per tile, and tiles along the longer side.
+    static constexpr int TrackedCars = 20000;
+    static constexpr int TileCount = 64;
+
+private:
+    // Interpolated position of car `i` of the snapshot.
+    QPointF position(int i) const;
+
+    // Level-of-detail passes.
+    void paintSprites(QPainter *painter, const QRectF &exposed);
+    void paintDots(QPainter *painter, const QRectF &exposed);
+    void paintDensity(QPainter *painter, const QRectF &exposed);
+
+    // Colour of the density bar of lane `l`.
+    QColor densityColour(int l) const;
+
+    // Repaints the tiles (cars) or the lanes (density bars) whose content changed since the last
+    // call, or the whole layer when that cannot be told.
+    void updateChanged();
+
+    // A pre-transformed car image inside the atlas.
+    struct Sprite
+    {
+        QRectF source;   // Rectangle of the image inside the atlas
+        QPointF offset;  // Top-left corner of the drawn image relative to the car position
+        int sprite;      // Car image (0..3 -> carro.png..carro4.png)
+        qreal scale;     // Scale it was rendered with
+        qreal rotation;  // Rotation it was rendered with
+    };
+
+    std::vector<SimLane> lanes;                  // Lane geometry, fixed for the layer's lifetime
+    qreal minGap;                                // Bumper-to-bumper distance of queued cars
+    const SimSnapshot *snapshot;                 // Cars to draw, nullptr before the first frame
+    float alpha;                                 // Interpolation factor into the snapshot's last step
+    QPixmap atlas;                               // Every pre-transformed car image side by side
+    QVector<Sprite> sprites;                     // Distinct images in the atlas
+    QVector<int> laneSprite;                     // Index into sprites for each lane
+    QVector<QPainter::PixmapFragment> fragments; // Reused between frames to avoid allocations
+    QVector<QPointF> driving, stopped;           // Dot positions, reused the same way
+    QVector<QRectF> laneBounds;                  // Area of each lane, to cull the density bars
+    QRectF bounds;                               // Cached bounding rectangle
+
+    // Change tracking
+    qreal paintedDetail;                         // Level of detail of the last paint, 0 before any
+    qreal hashedDetail;                          // The one the hashes below were taken at, 0 if none
+    qreal tileSize;                              // Side of a tile in scene units
+    int tileColumns, tileRows;
+    std::vector<quint64> tileHash, nextTileHash; // Per tile: sum of the hashes of what it shows
+    std::vector<QRgb> laneColour;                // Per lane: colour of its density bar, 0 if unknown
+};
+
+#endif // VEHICLELAYER_H
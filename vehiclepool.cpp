@@ -0,0 +1,133 @@
+#include "vehiclepool.h"   // Header file for the VehiclePool class
+#include <algorithm>         // std::max
+
+// Constructor: the pool starts empty with every array sized for `capacity` cars.
+VehiclePool::VehiclePool(int capacity)
+    : m_alive(0)
+    , m_highWater(0)
+{
+    reserve(capacity);
+}
+
+// Grows every array to `capacity` slots and pushes the new slots on the free list so that
+// lower slots are handed out first.
+void VehiclePool::reserve(int capacity)
+{
+    int old = int(state.size());
+    if (capacity <= old)
+        return;
+
+    x.resize(capacity);
+    y.resize(capacity);
+    s.resize(capacity);
+    v.resize(capacity);
+    a.resize(capacity);
+    age.resize(capacity);
+    leader.resize(capacity);
+    follower.resize(capacity);
+    lane.resize(capacity);
+    id.resize(capacity);
+    sprite.resize(capacity);
+    state.resize(capacity, Free);
+    turn.resize(capacity, Straight);
+
+    // New slots go under the current free slots so those are reused first
+    std::vector<std::int32_t> fresh;
+    fresh.reserve(capacity);
+    for (int slot = capacity - 1; slot >= old; --slot)
+        fresh.push_back(slot);
+    fresh.insert(fresh.end(), m_free.begin(), m_free.end());
+    m_free.swap(fresh);
+}
+
+// Pops a free slot and fills it with a new car at the start of its lane.
+int VehiclePool::spawn(std::uint32_t newId, int newLane, std::uint8_t newSprite, float speed)
+{
+    if (m_free.empty())
+        return -1;  // Pool full: the caller decides whether to grow or drop the car
+
+    int slot = m_free.back();
+    m_free.pop_back();
+
+    x[slot] = 0;
+    y[slot] = 0;
+    s[slot] = 0;
+    v[slot] = speed;
+    a[slot] = 0;
+    age[slot] = 0;
+    leader[slot] = -1;
+    follower[slot] = -1;
+    lane[slot] = newLane;
+    id[slot] = newId;
+    sprite[slot] = newSprite;
+    state[slot] = Driving;
+    turn[slot] = Straight;
+
+    ++m_alive;
+    if (slot >= m_highWater)
+        m_highWater = slot + 1;
+    return slot;
+}
+
+// Marks the slot free and pushes it on the free list.
+void VehiclePool::despawn(int slot)
+{
+    state[slot] = Free;
+    m_free.push_back(slot);
+    --m_alive;
+}
+
+// Frees every slot without releasing the arrays.
+void VehiclePool::clear()
+{
+    int cap = capacity();
+    m_free.clear();
+    for (int slot = cap - 1; slot >= 0; --slot) {
+        state[slot] = Free;
+        m_free.push_back(slot);
+    }
+    m_alive = 0;
+    m_highWater = 0;
+}
+
+// reserve() puts new slots under the free ones and spawn() takes the lowest new slot first, so
+// the free list is always [capacity - 1 .. highWater] followed by the slots freed by despawn().
+std::vector<std::int32_t> VehiclePool::reusableSlots() const
+{
+    return std::vector<std::int32_t>(m_free.begin() + (capacity() - m_highWater), m_free.end());
+}
+
+// The run of never-used slots at the bottom of the list is kept and only trimmed or extended
+// down to the new high-water mark, so restoring costs the used slots, not the capacity.
+void VehiclePool::restore(int highWater, const std::vector<std::int32_t> &reusable)
+{
+    const int keep = capacity() - std::max(highWater, m_highWater);
+    m_free.resize(keep);
+    for (int slot = m_highWater - 1; slot >= highWater; --slot)
+        m_free.push_back(slot);
+    m_free.insert(m_free.end(), reusable.begin(), reusable.end());
+    m_highWater = highWater;
+    m_alive = 0;
+    for (int slot = 0; slot < highWater; ++slot) {
+        if (state[slot] != Free)
+            ++m_alive;
+    }
+}
+
+// Total number of slots.
+int VehiclePool::capacity() const
+{
+    return int(state.size());
+}
+
+// Number of cars alive.
+int VehiclePool::size() const
+{
+    return m_alive;
+}
+
+// One past the highest slot that has been used since the last clear().
+int VehiclePool::highWater() const
+{
+    return m_highWater;
+}
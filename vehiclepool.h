@@ -0,0 +1,77 @@
+#ifndef VEHICLEPOOL_H
+#define VEHICLEPOOL_H
+
+#include <cstdint>     // Fixed-width integer types for ids and per-slot flags
+#include <vector>      // Contiguous arrays, one per vehicle attribute
+
+// Structure-of-arrays storage for every car of a simulation.
+// Each attribute lives in its own contiguous array indexed by slot, so the per-step update
+// is a tight loop over plain arrays. Free slots are kept in a free list: spawning and
+// despawning a car are O(1) and never allocate once the pool has been sized.
+class VehiclePool
+{
+public:
+    // Per-slot state.
+    enum State : std::uint8_t {
+        Free = 0,      // Slot not in use
+        Driving = 1,   // Car on the road
+        Stopped = 2    // Car on the road, standing in a queue
+    };
+
+    // Values of `turn` besides an index into the turns of the car's lane.
+    static constexpr std::int8_t Straight = -1;  // Goes straight on to the end of the lane
+    static constexpr std::int8_t Turned = -2;    // Has turned onto its lane, and was measured then
+
+    // Constructor: allocates every array for `capacity` cars up front.
+    explicit VehiclePool(int capacity = 65536);
+
+    // Grows the pool to hold `capacity` cars. Existing slots keep their index.
+    void reserve(int capacity);
+
+    // Takes a free slot for a new car and returns its index, or -1 if the pool is full.
+    int spawn(std::uint32_t id, int lane, std::uint8_t sprite, float speed);
+
+    // Returns the slot to the free list.
+    void despawn(int slot);
+
+    // Removes every car.
+    void clear();
+
+    // Free slots below highWater(), in free list order (the last one is handed out next). The
+    // slots from highWater() up have never been used and always lie under these on the free
+    // list, lowest on top, so this list and highWater() describe the whole pool; e.g. to save it.
+    std::vector<std::int32_t> reusableSlots() const;
+
+    // Rebuilds the free list and the car count from `highWater` and `reusable` (as returned by
+    // reusableSlots()) once the attribute arrays were filled directly, e.g. to restore a saved
+    // pool. Every slot not holding a car must be Free; the pool must hold `highWater` slots.
+    void restore(int highWater, const std::vector<std::int32_t> &reusable);
+
+    // Number of slots, cars alive and the end of the used slot range.
+    int capacity() const;
+    int size() const;
+    int highWater() const;
+
+    // Attribute arrays, indexed by slot. Only slots below highWater() can be in use,
+    // and only slots whose state is not Free hold a car.
+    std::vector<float> x;               // Scene position of the sprite origin
+    std::vector<float> y;
+    std::vector<float> s;               // Distance travelled along the lane
+    std::vector<float> v;               // Velocity along the lane (scene units per second)
+    std::vector<float> a;               // Acceleration computed for the current step
+    std::vector<float> age;             // Seconds since the car arrived, including time waiting to enter
+    std::vector<std::int32_t> leader;   // Slot of the car ahead on the same lane, -1 if none
+    std::vector<std::int32_t> follower; // Slot of the car behind on the same lane, -1 if none
+    std::vector<std::int32_t> lane;     // Lane the car drives on
+    std::vector<std::uint32_t> id;      // Unique car id
+    std::vector<std::uint8_t> sprite;   // Sprite id used by the renderer
+    std::vector<std::uint8_t> state;    // One of State
+    std::vector<std::int8_t> turn;      // Turn the car takes off its lane (see SimTurn), or Straight or Turned
+
+private:
+    std::vector<std::int32_t> m_free;   // Stack of free slots, the most recently freed on top
+    int m_alive;                        // Cars currently alive
+    int m_highWater;                    // One past the highest slot ever used
+};
+
+#endif // VEHICLEPOOL_H